@@ -22,22 +22,24 @@
 	#include "common_defs.h"
 	#include "common_cuda.h"
 
-	#define	HEAP_MAX			2147483640	// largest heap size (range of hpos)
+	#define	HEAP_MAX			( 1LL << 40 )	// largest heap size, entries (range of hpos)
 	#define	ELEM_MAX			2147483640	// largest number of elements in a buffer (range of hval)
-	#define HEAP_INIT			8
-	#define HEAP_POS			2
+	#define HEAP_INIT			8			// smallest heap block, entries
+	#define HEAP_CLASSES		29			// block size classes, HEAP_INIT << c
 	#define REF_MAX				64
 	#define BUNDEF				65535
 
-	typedef signed int			hpos;		// pointers into heap (sint = 32-bit)
+	typedef signed long long	hpos;		// pointers into heap (64-bit)
 	typedef signed int			hval;		// values in heap (sint = 32-bit)	
 	typedef hval				href;		// values are typically references 
 	typedef unsigned short		ushort;
 	typedef unsigned char		uchar;
 	typedef signed short		bufPos;
+	typedef unsigned long long	ehandle;	// element handle, generation (hi 32) | slot (lo 32). 0 = none
+	struct strref { uint off, len; };		// string element, bytes [off,off+len) of the DataX string arena
 	
 	// Heap types
-	typedef signed int			hpos;		// pointers into heap (sint = 32-bit)
+	typedef signed long long	hpos;		// pointers into heap (64-bit)
 	typedef signed int			hval;		// values in heap (sint = 32-bit)	
 	typedef hval				href;		// values are typically references 	
 	typedef signed short		bufPos;
@@ -67,14 +69,31 @@
 		#include <string>
 		#include "vec.h"	
 		#include "dataptr.h"
+		#include <functional>
+
+		struct strview {					// string arena bytes, not null terminated
+			const char*	str;
+			uint		len;
+			std::string	toStr () const							{ return std::string ( str, len ); }
+			bool		operator== ( const strview& v ) const	{ return len == v.len && memcmp ( str, v.str, len ) == 0; }
+		};
 
 		class HELPAPI hList {				// heap data
 		public:
-			ushort		cnt;
-			ushort		max;
+			uint		cnt;
+			uint		max;
 			hpos			pos;
 		};
 
+		struct HELPAPI HeapStats {
+			hpos		num, max;					// used extent, allocated entries
+			hpos		free;						// entries on free lists
+			hpos		freeBlocks;
+			hpos		largestFree;				// largest free block, entries
+			float		frag;						// free / num. 0 = compact
+			hpos		classFree[ HEAP_CLASSES ];	// free blocks per size class
+		};
+
 		class HELPAPI DataX {
 		public:				
 			DataX ();
@@ -84,7 +103,7 @@
 		
 			// Buffer Operations
 			bool		isActive ( int buf )		{ return (mRef[buf]==BUNDEF) ? false : true; }
-			int			AddBuffer		( int ref, std::string name, ushort stride, uint64_t maxcnt, uchar dest_flags=DT_CPU );		// add buffer
+			int			AddBuffer		( int ref, std::string name, ushort stride, uint64_t maxcnt, uchar dest_flags=DT_CPU, int align=DT_ALIGN, bool pad=false );		// add buffer. see DT_ALIGN
 			void		SetBufferUsage	( int i, uchar dt, uchar flags=DT_MISC, int rx=-1, int ry=-1, int rz=-1 );
 			char*		ExpandBuffer	( int i, int max_cnt);						
 			void		ResizeBuffer	( int i, int max_cnt, bool safe=false );			// safely resize a buffer. does not change number of elements.
@@ -107,6 +126,69 @@
 			void		CopyAllBuffers ( DataX* dest, uchar dest_flags=DT_CPU );			// copy all buffers to another DataX. buffer listings must match
 			void		MatchAllBuffers ( DataX* src, uchar use_flags=DT_MISC );			// match all buffers from another DataX
 
+			// Parallel Operations
+			// Elements [first,last] of a buffer are split into chunks run on the shared
+			// TaskPool. fn must only write elements in its own range. Reductions combine
+			// chunk results in order; with SetDeterministic the chunks are a fixed size,
+			// so results are identical for any number of threads. last=-1 is the final element.
+			void		SetDeterministic ( bool on )	{ bDeterministic = on; }
+			void		ForEachRange	( int i, const std::function<void ( uint64_t begin, uint64_t end )>& fn, int first=0, int last=-1 );
+			void		ReduceF			( int i, float& vmin, float& vmax, double& sum, int first=0, int last=-1 );		// float buffer
+			void		ReduceF3		( int i, Vec3F& vmin, Vec3F& vmax, Vec3F& sum, int first=0, int last=-1 );		// Vec3F buffer
+
+			// Sorting
+			// RadixSort is a stable, parallel LSD sort returning perm, where sorted
+			// element i is old element perm[i]. ApplyPermutation gathers every buffer
+			// holding the same count as the first, and updates element handles.
+			// Morton codes interleave 10 (32-bit) or 21 (64-bit) bits per axis of the
+			// position scaled to the buffer bounds, so sorting by them groups nearby points.
+			static void	RadixSort		( const uint32_t* keys, uint64_t num, std::vector<uint32_t>& perm );
+			static void	RadixSort		( const uint64_t* keys, uint64_t num, std::vector<uint32_t>& perm );
+			void		ApplyPermutation ( const std::vector<uint32_t>& perm );
+			void		SortByKeys		( const std::vector<uint32_t>& keys );
+			void		SortByKeys		( const std::vector<uint64_t>& keys );
+			void		ComputeMorton	( int posbuf, std::vector<uint32_t>& keys );
+			void		ComputeMorton	( int posbuf, std::vector<uint64_t>& keys );
+			void		SortByMorton	( int posbuf, bool wide=false );
+
+			// Dirty Ranges
+			// See DT_DIRTY_MAX. EncodeDirty writes the element count and dirty elements of
+			// every tracked buffer, for network sync. ApplyDirty applies them to a DataX with
+			// the same buffers, marking them dirty there. Commit and EncodeDirty both clear
+			// the ranges by default, so encode before committing when doing both.
+			void		SetTracking		( int i, bool on )	{ int b = mRef[i]; if (b != BUNDEF) mBuf[b].SetTracking ( on ); }
+			void		SetTrackingAll	( bool on )			{ for (size_t b=0; b < mBuf.size(); b++) mBuf[b].SetTracking ( on ); }
+			void		MarkDirty		( int i, int n, int cnt=1 )	{ int b = mRef[i]; if (b != BUNDEF) mBuf[b].MarkDirty ( n, cnt ); }
+			uint64_t	EncodeDirty		( std::vector<char>& out, bool clear=true );		// returns bytes written
+			bool		ApplyDirty		( const char* dat, uint64_t len );
+
+			// String Arena
+			// String buffers (AddStrBuffer) hold a strref per element into one append-only
+			// arena shared by the DataX. Strings are interned, so each distinct string is
+			// stored once and equal strings have equal refs. Views point into the arena and
+			// are invalidated when it grows. CopyAllBuffers and mapped snapshots carry the
+			// arena; CopyBuffer and EncodeDirty carry refs only. Empty strings are {0,0}.
+			int			AddStrBuffer	( int ref, std::string name, uint64_t maxcnt );		// DT_STRREF buffer
+			strref		AddStr			( const char* str, uint len );						// intern, returns existing ref if present
+			strref		AddStr			( const std::string& str )	{ return AddStr ( str.c_str(), (uint) str.size() ); }
+			bool		FindStr			( const char* str, uint len, strref& ref );			// lookup only
+			strview		GetStrView		( strref r )	{ strview v; bool ok = r.len > 0 && (uint64_t) r.off + r.len <= mStrArena.mNum; v.str = ok ? mStrArena.mCpu + r.off : ""; v.len = ok ? r.len : 0; return v; }
+			void		ClearStrings	();
+			uint64_t	GetStrArenaSize ()	{ return mStrArena.mNum; }
+			uint		GetStrCount ()		{ return mStrCount; }
+
+			// Mapped Snapshots
+			// SaveMapped writes all buffers and the heap to one file: a header with
+			// each buffer's name, stride, count and usage, then the data in page aligned
+			// sections. LoadMapped maps the file and points buffers and heap into it, so
+			// loading is immediate and pages are read only when touched. Writable loads are
+			// copy-on-write; read-only loads must not be modified. A buffer or heap that
+			// grows moves to its own memory. Element handles are not saved.
+			bool		SaveMapped		( std::string fname );
+			bool		LoadMapped		( std::string fname, bool writable=true );
+			void		CloseMapped		( bool keep=true );			// release the file. keep = copy data still in it
+			bool		isMapped ()		{ return mFileMap != 0x0; }
+
 			// GPU Operations
 			#ifdef USE_CUDA
 			void		AssignToGPU ( std::string var_name, CUmodule& module );				// assign DataX to a GPU symbolic variable
@@ -122,7 +204,9 @@
 			// Buffer accessors
 			char*		printElem ( int i, int n, char* buf );
 			char*		RandomElem ( uchar b, href& ndx );				
-			bool		DelElem ( uchar b, int n );	
+			bool		DelElem ( uchar b, int n );		// delete from one buffer, shifting later elements down. O(n)
+			bool		DelElemSwap ( int n );			// delete from all buffers, last element moves into n. O(1)
+			int			DelElems ( std::vector<int>& list );	// delete many from all buffers in one pass. returns count
 			int			AddElem ();						// add element (to all buffers)
 			int			AddElem ( int b );				// add element (to specific buffer)
 			char*		AddElem ( int b, int cnt );		// add specified number of elements (return start)		
@@ -131,6 +215,7 @@
 			char*		GetStart ( int i )				{ int b=mRef[i]; return (b==BUNDEF) ? 0 : mBuf[b].mCpu; }
 			char*		GetEnd ( int i )				{ int b=mRef[i]; return (b==BUNDEF) ? 0 : mBuf[b].mCpu + (mBuf[b].mNum-1)*mBuf[b].mStride; }		
 			int			GetNumElem ( int i )			{ int b=mRef[i]; return (b==BUNDEF) ? 0 : mBuf[b].mNum; }
+			int			GetNumPadded ( int i )			{ int b=mRef[i]; return (b==BUNDEF) ? 0 : (int) mBuf[b].getNumPadded(); }	// padded mode: count for SIMD loops
 			char*		GetBufData ( int i  )			{ int b=mRef[i]; return (b==BUNDEF) ? 0 : mBuf[b].mCpu; }		
 			DataPtr*	GetBuffer ( int i )				{ int b=mRef[i]; return (b==BUNDEF) ? 0 : &mBuf[b]; }		
 			int			GetMaxElem ( int i )			{ int b=mRef[i]; return (b==BUNDEF) ? 0 : mBuf[b].mMax; }
@@ -141,18 +226,19 @@
 			int			getUsage(int i)	 { int b=mRef[i]; return (b==BUNDEF) ? DT_NONE : mBuf[b].mUseType; }
 
 			// Element access
-			void		SetElem	     ( int i, int n, void* val )		{ int b=mRef[i]; if (b==BUNDEF) return; memcpy ( mBuf[b].mCpu + n*mBuf[b].mStride, val, mBuf[b].mStride); }
-			void		SetElemFloat ( int i, int n, float val )		{ int b=mRef[i]; if (b==BUNDEF) return; * ((float*) mBuf[b].mCpu+n) = val; }
-			void		SetElemInt   ( int i, int n, int val )			{ int b=mRef[i]; if (b==BUNDEF) return; * ((int*) mBuf[b].mCpu+n) = val; }
-			void		SetElemUInt  ( int i, int n, int val )			{ int b=mRef[i]; if (b==BUNDEF) return; * ((uint*) mBuf[b].mCpu+n) = val; }
-			void		SetElemChar  ( int i, int n, uchar val )		{ int b=mRef[i]; if (b==BUNDEF) return; * ((uchar*) mBuf[b].mCpu+n) = val; }
-			void		SetElemXLong ( int i, int n, xlong val )		{ int b=mRef[i]; if (b==BUNDEF) return; * ((xlong*) mBuf[b].mCpu+n) = val; }
-			void		SetElemClr   ( int i, int n, CLRVAL val )		{ int b=mRef[i]; if (b==BUNDEF) return; * ((CLRVAL*) mBuf[b].mCpu+n) = val; }
-			void		SetElemVec2  ( int i, int n, Vec2F& val )	{ int b=mRef[i]; if (b==BUNDEF) return; * ((Vec2F*) mBuf[b].mCpu+n) = val; }
-			void		SetElemVec3  ( int i, int n, Vec3F& val )	{ int b=mRef[i]; if (b==BUNDEF) return; * ((Vec3F*) mBuf[b].mCpu+n) = val; }
-			void		SetElemVec4  ( int i, int n, Vec4F& val )	{ int b=mRef[i]; if (b==BUNDEF) return; * ((Vec4F*) mBuf[b].mCpu+n) = val; }
-			void		SetElemM4    ( int i, int n, Matrix4F& val )	{ int b=mRef[i]; if (b==BUNDEF) return; * ((Matrix4F*) mBuf[b].mCpu+n) = val; }				
+			void		SetElem	     ( int i, int n, void* val )		{ int b=mRef[i]; if (b==BUNDEF) return; memcpy ( mBuf[b].mCpu + n*mBuf[b].mStride, val, mBuf[b].mStride); mBuf[b].MarkDirty(n); }
+			void		SetElemFloat ( int i, int n, float val )		{ int b=mRef[i]; if (b==BUNDEF) return; * ((float*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }
+			void		SetElemInt   ( int i, int n, int val )			{ int b=mRef[i]; if (b==BUNDEF) return; * ((int*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }
+			void		SetElemUInt  ( int i, int n, int val )			{ int b=mRef[i]; if (b==BUNDEF) return; * ((uint*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }
+			void		SetElemChar  ( int i, int n, uchar val )		{ int b=mRef[i]; if (b==BUNDEF) return; * ((uchar*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }
+			void		SetElemXLong ( int i, int n, xlong val )		{ int b=mRef[i]; if (b==BUNDEF) return; * ((xlong*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }
+			void		SetElemClr   ( int i, int n, CLRVAL val )		{ int b=mRef[i]; if (b==BUNDEF) return; * ((CLRVAL*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }
+			void		SetElemVec2  ( int i, int n, Vec2F& val )	{ int b=mRef[i]; if (b==BUNDEF) return; * ((Vec2F*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }
+			void		SetElemVec3  ( int i, int n, Vec3F& val )	{ int b=mRef[i]; if (b==BUNDEF) return; * ((Vec3F*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }
+			void		SetElemVec4  ( int i, int n, Vec4F& val )	{ int b=mRef[i]; if (b==BUNDEF) return; * ((Vec4F*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }
+			void		SetElemM4    ( int i, int n, Matrix4F& val )	{ int b=mRef[i]; if (b==BUNDEF) return; * ((Matrix4F*) mBuf[b].mCpu+n) = val; mBuf[b].MarkDirty(n); }				
 			void		SetElemStr   ( int i, int n, std::string val );
+			void		SetElemStr   ( int i, int n, const char* str, uint len )	{ int b=mRef[i]; if (b==BUNDEF) return; * ((strref*) mBuf[b].mCpu+n) = AddStr ( str, len ); mBuf[b].MarkDirty(n); }
 		
 			// old API interface
 			float		GetElemFloat ( int i, int n )					{ int b=mRef[i]; if (b==BUNDEF) return 0; return * ((float*) mBuf[b].mCpu+n); }
@@ -167,6 +253,7 @@
 			Vec4F*	GetElemVec4  ( int i, int n )					{ int b=mRef[i]; if (b==BUNDEF) return 0;  return ((Vec4F*) mBuf[b].mCpu+n); }
 			Matrix4F*	GetElemM4    ( int i, int n )					{ int b=mRef[i]; if (b==BUNDEF) return 0;  return ((Matrix4F*) mBuf[b].mCpu+n); }
 			std::string GetElemStr   ( int i, int n );
+			strview		GetElemStrView ( int i, int n )		{ int b=mRef[i]; strref r = { 0, 0 }; if (b!=BUNDEF) r = * ((strref*) mBuf[b].mCpu+n); return GetStrView ( r ); }		// no allocation
 
 			// new API interface
 			char*			bufC(int i, int n=0)	{ int b=mRef[i];	return (b==BUNDEF) ? 0 : ((char*) mBuf[b].mCpu+n); }
@@ -198,27 +285,47 @@
 			BaseObject*	GetElemObj   ( int b, int n )					{ if (b==BUF_UNDEF) return 0x0; return * ((BaseObject**) mBuf[b].data+n); }
 	#endif
 		
+			//----- Element handles
+			// Stable references to elements added with AddElem(). A handle stays
+			// valid while DelElemSwap / DelElems move its element, and goes stale
+			// (GetElemIndex returns -1) once the element is deleted.
+			void			UseHandles ( bool on );
+			ehandle			GetHandle ( int n )			{ return (bHandles && n >= 0 && n < (int) mElemHandle.size()) ? ( (ehandle) mHandleGen[ mElemHandle[n] ] << 32 ) | (ehandle) mElemHandle[n] : 0; }
+			int				GetElemIndex ( ehandle h )	{ uint s = (uint) h; return (s < mHandleGen.size() && mHandleGen[s] == (uint) (h >> 32)) ? mHandleElem[s] : -1; }
+
 			//----- Heap functions
 			void			ClearHeap ();
 			void			ClearRefs ( hList* list );
-			void			AddHeap ( int max );
+			// Blocks come in power-of-two size classes, each with its own free
+			// list, so alloc and free are O(1). Freed blocks are reused but not
+			// merged; HeapCompact repacks the lists held in the given buffers.
+			void			AddHeap ( hpos max );
 			void			CopyHeap ( DataX& src );
 			void			ResetHeap ();
-			hval			AddRef ( hval r, hList* list, hval delta  );
-			hpos			HeapAlloc ( ushort size, ushort& ret );
-			hpos			HeapExpand ( ushort size, ushort& ret  );
-			void			HeapAddFree ( hpos pos, int size );
+			hpos			AddRef ( hval r, hList* list, hval delta  );		// returns list position, -1 if the heap cannot grow (list unchanged)
+			hpos			HeapAlloc ( uint size, uint& ret );				// -1 on failure
+			hpos			HeapExpand ( uint size, uint& ret  );
+			void			HeapAddFree ( hpos pos, uint size );
+			hpos			HeapCompact ( const std::vector<int>& list_bufs );	// buffers of hList. returns entries reclaimed
+			static int		HeapClass ( uint size );
 
 			// Heap queries		
 			hval*			GetHeap ( hpos& num, hpos& max, hpos& free );		
+			hval*			GetHeap ( HeapStats& stats );
 			hval*			GetHeap ()	{ return mHeap; }
-			int				GetHeapSize ();
-			int				GetHeapNum ()	{ return mHeapNum; }
-			int				GetHeapMax ()	{ return mHeapMax; }
-			int				GetHeapFree ()	{ return mHeapFree; }
+			xlong			GetHeapSize ();
+			hpos			GetHeapNum ()	{ return mHeapNum; }
+			hpos			GetHeapMax ()	{ return mHeapMax; }
+			hpos			GetHeapFree ()	{ return mHeapFree; }		// free entries
 
 		private:										// internal functions
 			int		AddElemDirect(int b);				// low-level add. no user-level indirection
+			void	SyncHandles ( int num );			// match handles to element count
+			void	MoveHandle ( int from, int to );	// element moved, releases handle of 'to'
+			void	HeapRelease ();						// free heap memory, or drop a mapped view
+			bool	StrReserve ( uint64_t bytes );		// arena capacity
+			int		StrSlot ( const char* str, uint len );	// intern table slot holding str, or empty slot for it
+			void	StrRehash ( uint size );
 
 		public:
 		
@@ -241,8 +348,25 @@
 
 			hpos					mHeapNum;			// data buffer heap
 			hpos					mHeapMax;
-			hpos					mHeapFree;
+			hpos					mHeapFree;			// free entries
+			hpos					mHeapList[ HEAP_CLASSES ];	// free list heads, -1 = empty
 			hval*					mHeap;		
+			bool					bHeapView;			// mHeap is in the mapped file
+
+			char*					mFileMap;			// mapped snapshot, see LoadMapped
+			uint64_t				mFileMapSize;
+			void*					mFileHandle;		// Windows file mapping
+
+			bool					bDeterministic;		// fixed chunks for parallel ops
+			bool					bHandles;			// element handles
+			std::vector<int>		mElemHandle;		// element -> slot
+			std::vector<int>		mHandleElem;		// slot -> element, -1 = free
+			std::vector<uint>		mHandleGen;			// slot -> generation
+			std::vector<int>		mHandleFree;		// free slots
+
+			DataPtr					mStrArena;			// string bytes, mNum = bytes used
+			std::vector<strref>		mStrTable;			// intern table, open addressing. len 0 = empty
+			uint					mStrCount;			// distinct strings
 		};
 
 	#endif
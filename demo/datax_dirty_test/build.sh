@@ -0,0 +1,5 @@
+
+cmake CMakeLists.txt -B../../../build/datax_dirty_test
+make -C../../../build/datax_dirty_test
+
+
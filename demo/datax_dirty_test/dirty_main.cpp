@@ -0,0 +1,102 @@
+
+// DataX dirty range test
+//
+// Fills a tracked DataX, syncs it to a second DataX with EncodeDirty and
+// ApplyDirty, then makes scattered writes, a block of writes, an append and
+// a swap delete and syncs again. Checks that both sides hold the same
+// elements, that the delta is smaller than the buffers, that the header is
+// little-endian, and that a truncated delta or a stride mismatch is rejected.
+// Exits non-zero on any failure.
+//
+// Usage:
+//   datax_dirty_test [-n elements]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+
+#include "datax.h"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static bool same ( DataX& a, DataX& b )
+{
+	if ( a.GetNumElem ( 0 ) != b.GetNumElem ( 0 ) || a.GetNumElem ( 1 ) != b.GetNumElem ( 1 ) ) return false;
+	for ( int n = 0; n < a.GetNumElem ( 0 ); n++ ) {
+		Vec3F* p = a.GetElemVec3 ( 0, n );
+		Vec3F* q = b.GetElemVec3 ( 0, n );
+		if ( p->x != q->x || p->y != q->y || p->z != q->z || a.GetElemInt ( 1, n ) != b.GetElemInt ( 1, n ) ) return false;
+	}
+	return true;
+}
+
+static bool check ( const char* label, bool ok )
+{
+	printf ( "%-28s %s\n", label, ok ? "ok" : "FAIL" );
+	return ok;
+}
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 10000 );
+	bool ok = true;
+
+	DataX a, b;
+	a.AddBuffer ( 0, "pos", sizeof ( Vec3F ), num + 1 );
+	a.AddBuffer ( 1, "id", sizeof ( int ), num + 1 );
+	a.SetNum ( num );
+	for ( int n = 0; n < num; n++ ) {
+		Vec3F v ( (float) n, 0, 1 );
+		a.SetElemVec3 ( 0, n, v );
+		a.SetElemInt ( 1, n, n );
+	}
+	b.MatchAllBuffers ( &a );
+	a.SetTrackingAll ( true );
+
+	// Full sync
+	std::vector<char> msg;
+	a.EncodeDirty ( msg );
+	uint32_t records = (uchar) msg[0] | ( (uchar) msg[1] << 8 ) | ( (uchar) msg[2] << 16 ) | ( (uint32_t) (uchar) msg[3] << 24 );
+	ok &= check ( "header little-endian", records == 2 );
+	ok &= check ( "full sync", b.ApplyDirty ( msg.data (), msg.size () ) && same ( a, b ) );
+	ok &= check ( "ranges cleared", a.GetBuffer ( 0 )->getNumDirty () == 0 && a.GetBuffer ( 1 )->getNumDirty () == 0 );
+	size_t full = msg.size ();
+
+	// Scattered and block writes, an append and a swap delete
+	for ( int k = 0; k < 20; k++ ) {
+		Vec3F v ( -1, (float) k, 2 );
+		a.SetElemVec3 ( 0, ( k * 997 ) % num, v );
+		a.MarkDirty ( 0, ( k * 997 ) % num );
+	}
+	for ( int n = 100; n < 200 && n < num; n++ ) a.SetElemInt ( 1, n, -n );
+	a.MarkDirty ( 1, 100, 100 );
+	int i = a.AddElem ();
+	Vec3F z ( 7, 7, 7 );
+	a.SetElemVec3 ( 0, i, z );
+	a.SetElemInt ( 1, i, 77 );
+	a.DelElemSwap ( 5 );
+
+	msg.clear ();
+	a.EncodeDirty ( msg );
+	printf ( "full %zu bytes, delta %zu bytes\n", full, msg.size () );
+	ok &= check ( "delta smaller than full", msg.size () < full / 4 );
+	ok &= check ( "truncated delta rejected", !b.ApplyDirty ( msg.data (), msg.size () - 3 ) );
+	ok &= check ( "delta sync", b.ApplyDirty ( msg.data (), msg.size () ) && same ( a, b ) );
+
+	// Stride mismatch
+	DataX c;
+	c.AddBuffer ( 0, "pos", sizeof ( Vec4F ), num + 1 );
+	c.AddBuffer ( 1, "id", sizeof ( int ), num + 1 );
+	ok &= check ( "stride mismatch rejected", !c.ApplyDirty ( msg.data (), msg.size () ) );
+
+	printf ( "%s\n", ok ? "PASS" : "FAIL" );
+	return ok ? 0 : 1;
+}
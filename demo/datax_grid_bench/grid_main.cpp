@@ -0,0 +1,163 @@
+
+// Spatial grid benchmark
+//
+// Counts neighbours within a radius of every point in a random point set,
+// brute force over all pairs and through a SpatialGrid, and checks the
+// totals match. Checks k-nearest queries, unbounded and within a radius,
+// against a brute force sort at points of the set and at random points,
+// some outside its bounds. Then times grid Build, a Rebuild after a few
+// points move, a Rebuild after all of them move, and k-nearest queries.
+//
+// Usage:
+//   datax_grid_bench [-n points] [-b brute force points] [-t threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "spatial_grid.h"
+#include "task_pool.h"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static double now_msec ()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count () / 1000.0;
+}
+
+static void make_points ( DataX& dat, int num, float extent, std::mt19937& rnd )
+{
+	std::uniform_real_distribution<float> u ( 0, extent );
+	dat.DeleteAllBuffers ();
+	dat.AddBuffer ( 0, "pos", sizeof ( Vec3F ), num );
+	dat.SetNum ( num );
+	for ( int n = 0; n < num; n++ ) dat.bufF3 ( 0 )[n].Set ( u ( rnd ), u ( rnd ), u ( rnd ) );
+}
+
+static uint64_t pairs_brute ( DataX& dat, float r )
+{
+	Vec3F* pos = dat.bufF3 ( 0 );
+	int num = dat.GetNumElem ( 0 );
+	uint64_t cnt = 0;
+	for ( int i = 0; i < num; i++ ) {
+		for ( int j = 0; j < num; j++ ) {
+			float dx = pos[j].x - pos[i].x, dy = pos[j].y - pos[i].y, dz = pos[j].z - pos[i].z;
+			if ( dx*dx + dy*dy + dz*dz <= r*r ) cnt++;
+		}
+	}
+	return cnt;
+}
+
+static uint64_t pairs_grid ( DataX& dat, SpatialGrid& grid, float r )
+{
+	Vec3F* pos = dat.bufF3 ( 0 );
+	int num = dat.GetNumElem ( 0 );
+	uint64_t cnt = 0;
+	for ( int i = 0; i < num; i++ ) grid.ForEachInRadius ( pos[i], r, [&cnt] ( int e, float d2 ) { cnt++; } );
+	return cnt;
+}
+
+// k nearest by sorting every point. Same distance and tie order as the grid: (dist_sq, index)
+static void nearest_brute ( DataX& dat, Vec3F p, int k, float maxr, std::vector<int>& out )
+{
+	Vec3F* pos = dat.bufF3 ( 0 );
+	int num = dat.GetNumElem ( 0 );
+	float r2 = ( maxr < 0 ) ? 3.4e38f : maxr * maxr;
+	std::vector< std::pair<float, int> > all;
+	for ( int j = 0; j < num; j++ ) {
+		float dx = pos[j].x - p.x, dy = pos[j].y - p.y, dz = pos[j].z - p.z;
+		float d2 = dx*dx + dy*dy + dz*dz;
+		if ( d2 <= r2 ) all.push_back ( std::make_pair ( d2, j ) );
+	}
+	int cnt = ( (int) all.size () < k ) ? (int) all.size () : k;
+	std::partial_sort ( all.begin (), all.begin () + cnt, all.end () );
+	out.clear ();
+	for ( int i = 0; i < cnt; i++ ) out.push_back ( all[i].second );
+}
+
+// Grid and brute force agree on every query. Returns the number of mismatches.
+static int check_nearest ( DataX& dat, SpatialGrid& grid, int queries, int k, float maxr, float extent, std::mt19937& rnd )
+{
+	std::uniform_real_distribution<float> u ( -0.2f * extent, 1.2f * extent );
+	Vec3F* pos = dat.bufF3 ( 0 );
+	int num = dat.GetNumElem ( 0 );
+	std::vector<int> a, b;
+	int bad = 0;
+	for ( int q = 0; q < queries; q++ ) {
+		Vec3F p = ( q % 2 ) ? Vec3F ( u ( rnd ), u ( rnd ), u ( rnd ) ) : pos[ ( q * 7919 ) % num ];
+		grid.QueryNearest ( p, k, a, maxr );
+		nearest_brute ( dat, p, k, maxr, b );
+		if ( a != b ) bad++;
+	}
+	return bad;
+}
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 1000000 );
+	int brute = get_arg ( argc, argv, "-b", 20000 );
+	int threads = get_arg ( argc, argv, "-t", 0 );
+	TaskPool::Get ().Start ( threads );
+
+	// Same density for both sets: about 8 points per unit cube
+	std::mt19937 rnd ( 11 );
+	float r = 0.5f;
+	DataX dat;
+	SpatialGrid grid;
+	make_points ( dat, brute, cbrtf ( brute / 8.0f ), rnd );
+	double t0 = now_msec ();
+	uint64_t cb = pairs_brute ( dat, r );
+	double t1 = now_msec ();
+	grid.Build ( &dat, 0, r );
+	uint64_t cg = pairs_grid ( dat, grid, r );
+	double t2 = now_msec ();
+	bool ok = ( cb == cg );
+	printf ( "%d points, radius pairs: brute force %9.1f ms, grid %7.1f ms %s\n", brute, t1 - t0, t2 - t1, ok ? "" : "(COUNT MISMATCH)" );
+	int bad_knn = check_nearest ( dat, grid, 1000, 16, -1, cbrtf ( brute / 8.0f ), rnd );
+	int bad_knr = check_nearest ( dat, grid, 1000, 16, r, cbrtf ( brute / 8.0f ), rnd );
+	ok &= ( bad_knn == 0 && bad_knr == 0 );
+	printf ( "%d points, 16-nearest vs brute force: %d of 1000 differ, within radius: %d of 1000 differ\n", brute, bad_knn, bad_knr );
+
+	make_points ( dat, num, cbrtf ( num / 8.0f ), rnd );
+	Vec3F* pos = dat.bufF3 ( 0 );
+	t0 = now_msec ();
+	grid.Build ( &dat, 0, r );
+	t1 = now_msec ();
+	cg = pairs_grid ( dat, grid, r );
+	t2 = now_msec ();
+	printf ( "%d points, build %7.1f ms, radius pairs %7.1f ms (%.1f per point)\n", num, t1 - t0, t2 - t1, (double) cg / num );
+
+	std::uniform_real_distribution<float> jitter ( -0.3f, 0.3f );
+	for ( int n = 0; n < num; n += 100 ) pos[n] += Vec3F ( jitter ( rnd ), jitter ( rnd ), jitter ( rnd ) );
+	t0 = now_msec ();
+	int moved = grid.Rebuild ();
+	t1 = now_msec ();
+	printf ( "rebuild, 1%% of points jittered: %7.1f ms (%d changed cell)\n", t1 - t0, moved );
+	for ( int n = 0; n < num; n++ ) pos[n] += Vec3F ( jitter ( rnd ), jitter ( rnd ), jitter ( rnd ) );
+	t0 = now_msec ();
+	moved = grid.Rebuild ();
+	t1 = now_msec ();
+	printf ( "rebuild, all points jittered:   %7.1f ms (%d changed cell)\n", t1 - t0, moved );
+
+	std::vector<int> out;
+	int queries = 100000;
+	uint64_t found = 0;
+	t0 = now_msec ();
+	for ( int q = 0; q < queries; q++ ) found += grid.QueryNearest ( pos[ ( q * 7919 ) % num ], 16, out );
+	t1 = now_msec ();
+	printf ( "16-nearest: %.2f us per query (%.1f found)\n", ( t1 - t0 ) * 1000.0 / queries, (double) found / queries );
+
+	dat.DeleteAllBuffers ();
+	printf ( "%s\n", ok ? "PASS" : "FAIL" );
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,5 @@
+
+cmake CMakeLists.txt -B../../../build/datax_grow_bench
+make -C../../../build/datax_grow_bench
+
+
@@ -0,0 +1,3 @@
+
+rm -rf ../../../build/datax_grow_bench/*
+
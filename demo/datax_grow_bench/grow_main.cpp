@@ -0,0 +1,93 @@
+
+// DataX growth benchmark
+//
+// Grows one Vec4F buffer element by element with DataX::AddElem, as a
+// particle system does, until it holds the requested size. Runs with large
+// buffer mapping disabled (malloc + copy + free on every expand), then with
+// the default mapped growth, then with huge pages. Each run is a separate
+// process so peak resident memory is reported per mode.
+//
+// Usage:
+//   datax_grow_bench [-m megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "datax.h"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static double now_msec ()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count () / 1000.0;
+}
+
+static void run ( const char* label, uint64_t large_min, bool huge, uint64_t num )
+{
+	DataPtr::SetLargeAlloc ( large_min, huge );
+
+	DataX dat;
+	dat.AddBuffer ( 0, "pos", sizeof ( Vec4F ), 16 );
+
+	DataPtr* buf = dat.GetBuffer ( 0 );
+	double t0 = now_msec ();
+	double worst = 0;
+	int expands = 0;
+	for ( uint64_t n = 0; n < num; n++ ) {
+		int i;
+		if ( buf->mNum >= buf->mMax ) {
+			double t = now_msec ();						// this AddElem expands
+			i = dat.AddElem ( 0 );
+			t = now_msec () - t;
+			if ( t > worst ) worst = t;
+			expands++;
+		} else {
+			i = dat.AddElem ( 0 );
+		}
+		Vec4F v ( (float) n, 0, 0, 1 );
+		dat.SetElemVec4 ( 0, i, v );
+	}
+	double total = now_msec () - t0;
+
+	bool ok = ( dat.GetElemVec4 ( 0, 0 )->x == 0 && dat.GetElemVec4 ( 0, (int) num - 1 )->x == (float) ( num - 1 ) );
+	rusage ru;
+	getrusage ( RUSAGE_SELF, &ru );
+	printf ( "%-10s total %8.1f ms, %d expands, worst %7.1f ms, peak rss %6ld MB %s\n", label, total, expands, worst, ru.ru_maxrss / 1024, ok ? "" : "(DATA MISMATCH)" );
+	dat.DeleteAllBuffers ();
+}
+
+int main ( int argc, char* argv [] )
+{
+	int mb = get_arg ( argc, argv, "-m", 1024 );
+	uint64_t num = ( (uint64_t) mb << 20 ) / sizeof ( Vec4F );
+	printf ( "growing to %d MB (%llu elements)\n", mb, (unsigned long long) num );
+	fflush ( stdout );
+
+	for ( int mode = 0; mode < 3; mode++ ) {
+		pid_t pid = fork ();
+		if ( pid == 0 ) {
+			switch ( mode ) {
+			case 0:	run ( "malloc", 0, false, num );					break;
+			case 1:	run ( "mapped", DT_LARGE_MIN, false, num );			break;
+			case 2:	run ( "mapped+thp", DT_LARGE_MIN, true, num );		break;
+			}
+			fflush ( stdout );
+			_exit ( 0 );
+		}
+		int status = 0;
+		waitpid ( pid, &status, 0 );
+	}
+	return 0;
+}
@@ -0,0 +1,95 @@
+
+// DataX heap benchmark
+//
+// Gives each of n vertices an empty reference list, then adds 6n references
+// to randomly chosen lists, as building face lists for a mesh does. Lists
+// grow through the heap size classes, leaving freed blocks behind. Reports
+// the AddRef time, the heap statistics, and the time and result of
+// HeapCompact. Checks every list against the references added to it.
+//
+// Usage:
+//   datax_heap_bench [-n vertices] [-r refs per vertex]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "datax.h"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static double now_msec ()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count () / 1000.0;
+}
+
+static void print_stats ( const char* label, DataX& dat )
+{
+	HeapStats st;
+	dat.GetHeap ( st );
+	printf ( "%-8s num %10lld  max %10lld  free %10lld  blocks %8lld  largest %8lld  frag %.2f\n", label,
+		(long long) st.num, (long long) st.max, (long long) st.free, (long long) st.freeBlocks, (long long) st.largestFree, st.frag );
+}
+
+// Every list holds the references added to it, in order
+static bool check_lists ( DataX& dat, int num, const std::vector<int>& target )
+{
+	std::vector<uint> at ( num, 0 );
+	for ( size_t k = 0; k < target.size (); k++ ) {
+		hList* l = (hList*) dat.GetElem ( 0, target[k] );
+		uint j = at[ target[k] ]++;
+		if ( j >= l->cnt || dat.GetHeap ()[ l->pos + j ] != (hval) k ) return false;
+	}
+	for ( int v = 0; v < num; v++ ) {
+		if ( ( (hList*) dat.GetElem ( 0, v ) )->cnt != at[v] ) return false;
+	}
+	return true;
+}
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 100000 );
+	int per = get_arg ( argc, argv, "-r", 6 );
+
+	DataX dat;
+	dat.AddBuffer ( 0, "flist", sizeof ( hList ), num );
+	dat.AddHeap ( 64 );
+	for ( int v = 0; v < num; v++ ) dat.ClearRefs ( (hList*) dat.GetElem ( 0, dat.AddElem ( 0 ) ) );
+
+	std::mt19937 rnd ( 3 );
+	std::vector<int> target ( (size_t) num * per );
+	for ( size_t k = 0; k < target.size (); k++ ) target[k] = rnd () % num;
+
+	double t0 = now_msec ();
+	for ( size_t k = 0; k < target.size (); k++ ) {
+		if ( dat.AddRef ( (hval) k, (hList*) dat.GetElem ( 0, target[k] ), 0 ) == -1 ) {
+			printf ( "AddRef failed at %zu\n", k );
+			return 1;
+		}
+	}
+	double t_add = now_msec () - t0;
+	printf ( "%d lists, %zu AddRef calls: %.1f ms\n", num, target.size (), t_add );
+	print_stats ( "built", dat );
+	bool ok = check_lists ( dat, num, target );
+
+	std::vector<int> bufs ( 1, 0 );
+	t0 = now_msec ();
+	hpos reclaimed = dat.HeapCompact ( bufs );
+	double t_compact = now_msec () - t0;
+	printf ( "HeapCompact: %.1f ms, reclaimed %lld entries\n", t_compact, (long long) reclaimed );
+	print_stats ( "compact", dat );
+	ok &= check_lists ( dat, num, target );
+
+	printf ( "%s\n", ok ? "lists ok" : "LIST MISMATCH" );
+	dat.ClearHeap ();
+	return ok ? 0 : 1;
+}
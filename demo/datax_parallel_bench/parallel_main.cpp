@@ -0,0 +1,107 @@
+
+// DataX parallel benchmark
+//
+// Times common per-element passes over a Vec3F buffer, single threaded and
+// through the shared TaskPool: a transform (ForEachRange), bounds and sum
+// (ReduceF3) and a buffer fill. Also checks that deterministic reductions
+// give the same sum for 1 thread and for all threads.
+//
+// Usage:
+//   datax_parallel_bench [-n elements] [-t threads] [-r repeats]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "datax.h"
+#include "task_pool.h"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static double now_msec ()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count () / 1000.0;
+}
+
+static void transform_serial ( Vec3F* v, uint64_t begin, uint64_t end )
+{
+	for ( uint64_t n = begin; n < end; n++ ) {
+		v[n] = v[n] * Vec3F ( 0.5f, 0.5f, 0.5f ) + Vec3F ( 1, 2, 3 );
+	}
+}
+
+static void bounds_serial ( Vec3F* v, uint64_t num, Vec3F& bmin, Vec3F& bmax, Vec3F& sum )
+{
+	double sx = 0, sy = 0, sz = 0;
+	bmin = v[0]; bmax = v[0];
+	for ( uint64_t n = 0; n < num; n++ ) {
+		if ( v[n].x < bmin.x ) bmin.x = v[n].x;
+		if ( v[n].y < bmin.y ) bmin.y = v[n].y;
+		if ( v[n].z < bmin.z ) bmin.z = v[n].z;
+		if ( v[n].x > bmax.x ) bmax.x = v[n].x;
+		if ( v[n].y > bmax.y ) bmax.y = v[n].y;
+		if ( v[n].z > bmax.z ) bmax.z = v[n].z;
+		sx += v[n].x; sy += v[n].y; sz += v[n].z;
+	}
+	sum.Set ( (float) sx, (float) sy, (float) sz );
+}
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 16000000 );
+	int threads = get_arg ( argc, argv, "-t", 0 );
+	int reps = get_arg ( argc, argv, "-r", 10 );
+
+	TaskPool& pool = TaskPool::Get ();
+	pool.Start ( threads );
+	printf ( "%d elements (%d MB), %d threads\n", num, (int) ( (uint64_t) num * sizeof ( Vec3F ) >> 20 ), pool.getNumThreads () );
+
+	DataX dat;
+	dat.AddBuffer ( 0, "pos", sizeof ( Vec3F ), num );
+	dat.SetNum ( num );
+	Vec3F* v = dat.bufF3 ( 0 );
+	for ( int n = 0; n < num; n++ ) v[n].Set ( (float) ( n % 1000 ), (float) ( n % 777 ), (float) ( n % 33 ) );
+
+	Vec3F bmin, bmax, sum;
+	double t0 = now_msec ();
+	for ( int r = 0; r < reps; r++ ) transform_serial ( v, 0, num );
+	double t1 = now_msec ();
+	for ( int r = 0; r < reps; r++ ) dat.ForEachRange ( 0, [v] ( uint64_t begin, uint64_t end ) { transform_serial ( v, begin, end ); } );
+	double t2 = now_msec ();
+	for ( int r = 0; r < reps; r++ ) bounds_serial ( v, num, bmin, bmax, sum );
+	double t3 = now_msec ();
+	for ( int r = 0; r < reps; r++ ) dat.ReduceF3 ( 0, bmin, bmax, sum );
+	double t4 = now_msec ();
+	for ( int r = 0; r < reps; r++ ) memset ( v, r, (uint64_t) num * sizeof ( Vec3F ) );
+	double t5 = now_msec ();
+	for ( int r = 0; r < reps; r++ ) dat.FillBuffer ( 0, (uchar) r );
+	double t6 = now_msec ();
+
+	printf ( "transform, serial:      %8.2f ms\n", ( t1 - t0 ) / reps );
+	printf ( "transform, ForEachRange:%8.2f ms\n", ( t2 - t1 ) / reps );
+	printf ( "bounds, serial:         %8.2f ms\n", ( t3 - t2 ) / reps );
+	printf ( "bounds, ReduceF3:       %8.2f ms\n", ( t4 - t3 ) / reps );
+	printf ( "fill, memset:           %8.2f ms\n", ( t5 - t4 ) / reps );
+	printf ( "fill, FillBuffer:       %8.2f ms\n", ( t6 - t5 ) / reps );
+
+	// Deterministic sums match across thread counts
+	for ( int n = 0; n < num; n++ ) v[n].Set ( 1.0f / ( n + 1 ), (float) n * 1e-3f, 0.1f );
+	Vec3F sum1, sumN;
+	dat.SetDeterministic ( true );
+	pool.Start ( 1 );
+	dat.ReduceF3 ( 0, bmin, bmax, sum1 );
+	pool.Start ( threads );
+	dat.ReduceF3 ( 0, bmin, bmax, sumN );
+	bool same = ( sum1.x == sumN.x && sum1.y == sumN.y && sum1.z == sumN.z );
+	printf ( "deterministic sum, 1 vs %d threads: %s\n", pool.getNumThreads (), same ? "identical" : "DIFFERENT" );
+
+	dat.DeleteAllBuffers ();
+	return same ? 0 : 1;
+}
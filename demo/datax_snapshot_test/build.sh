@@ -0,0 +1,5 @@
+
+cmake CMakeLists.txt -B../../../build/datax_snapshot_test
+make -C../../../build/datax_snapshot_test
+
+
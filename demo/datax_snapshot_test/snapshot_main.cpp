@@ -0,0 +1,162 @@
+
+// DataX snapshot test
+//
+// Saves a DataX with plain buffers, reference lists on the heap (with free
+// blocks) and a string buffer, loads it back mapped and checks every value.
+// Then damages copies of the file - truncated, bad magic, an out of range
+// free list head, a bad heap free count, a non power of two alignment and
+// buffer sizes that wrap - and checks that LoadMapped rejects each one.
+// Exits non-zero on any failure.
+//
+// Usage:
+//   datax_snapshot_test [-n elements] [-f file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "datax.h"
+
+// File layout, as written by DataX::SaveMapped (datax.cpp)
+struct FileHeader {
+	uint32_t	magic, version, endian, numBuf;
+	uint64_t	fileSize;
+	uint64_t	heapOffset;
+	int64_t		heapNum, heapFree;
+	int64_t		heapList[ HEAP_CLASSES ];
+	uint64_t	strOffset, strBytes;
+	uint64_t	strTableOffset, strTableNum, strCount;
+};
+struct FileBuf {
+	char		name[ 64 ];
+	int32_t		refID, stride, align, pad;
+	uint64_t	num, bytes, offset;
+	uint8_t		useType, useFlags, reserved[2];
+	int32_t		rx, ry, rz;
+};
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static const char* get_str ( int argc, char** argv, const char* arg, const char* value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return argv[i+1];
+	}
+	return value;
+}
+
+static bool read_file ( std::string fname, std::vector<char>& dat )
+{
+	FILE* fp = fopen ( fname.c_str (), "rb" );
+	if ( fp == 0x0 ) return false;
+	fseek ( fp, 0, SEEK_END );
+	dat.resize ( ftell ( fp ) );
+	fseek ( fp, 0, SEEK_SET );
+	bool ok = fread ( dat.data (), 1, dat.size (), fp ) == dat.size ();
+	fclose ( fp );
+	return ok;
+}
+
+static bool write_file ( std::string fname, const std::vector<char>& dat, size_t len )
+{
+	FILE* fp = fopen ( fname.c_str (), "wb" );
+	if ( fp == 0x0 ) return false;
+	bool ok = fwrite ( dat.data (), 1, len, fp ) == len;
+	fclose ( fp );
+	return ok;
+}
+
+// Write a damaged copy and check that it does not load
+static bool expect_reject ( const char* label, std::string fname, std::vector<char> dat, size_t len, void (*damage) ( FileHeader*, FileBuf* ) )
+{
+	if ( damage != 0x0 ) damage ( (FileHeader*) dat.data (), (FileBuf*) ( dat.data () + sizeof ( FileHeader ) ) );
+	if ( !write_file ( fname, dat, len ) ) { printf ( "%-28s cannot write %s\n", label, fname.c_str () ); return false; }
+	DataX d;
+	bool loaded = d.LoadMapped ( fname );
+	d.CloseMapped ( false );
+	printf ( "%-28s %s\n", label, loaded ? "LOADED (FAIL)" : "rejected" );
+	return !loaded;
+}
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 10000 );
+	std::string fname = get_str ( argc, argv, "-f", "snapshot_test.dxm" );
+	std::string bad = fname + ".bad";
+	int lists = ( num < 1000 ) ? num : 1000;
+	bool ok = true;
+
+	// Save
+	{
+		DataX d;
+		d.AddBuffer ( 0, "pos", sizeof ( Vec3F ), num );
+		d.AddBuffer ( 1, "id", sizeof ( int ), num, DT_CPU, 64, true );
+		d.AddBuffer ( 2, "refs", sizeof ( hList ), lists );
+		d.AddStrBuffer ( 3, "tag", num );
+		d.AddHeap ( 64 );
+		for ( int n = 0; n < num; n++ ) {
+			Vec3F v ( (float) n, (float) 2*n, 3 );
+			int i = d.AddElem ( 0 );
+			d.SetElemVec3 ( 0, i, v );
+			i = d.AddElem ( 1 );
+			d.SetElemInt ( 1, i, n );
+			i = d.AddElem ( 3 );
+			d.SetElemStr ( 3, i, ( n % 3 ) ? "even" : "third" );
+		}
+		for ( int n = 0; n < lists; n++ ) d.ClearRefs ( (hList*) d.GetElem ( 2, d.AddElem ( 2 ) ) );
+		for ( int k = 0; k < 20 * lists; k++ ) d.AddRef ( k, (hList*) d.GetElem ( 2, k % lists ), 0 );		// lists grow, leaving free blocks
+		if ( !d.SaveMapped ( fname ) ) { printf ( "cannot save %s\n", fname.c_str () ); return 1; }
+		printf ( "saved %d elements, %d lists, heap %lld, free %lld\n", num, lists, (long long) d.GetHeapNum (), (long long) d.GetHeapFree () );
+		d.ClearHeap ();
+	}
+
+	// Load and check
+	{
+		DataX d;
+		if ( !d.LoadMapped ( fname ) ) { printf ( "cannot load %s\n", fname.c_str () ); return 1; }
+		bool same = d.GetNumElem ( 0 ) == num && d.GetNumElem ( 1 ) == num && d.GetNumElem ( 2 ) == lists && d.GetNumElem ( 3 ) == num;
+		for ( int n = 0; same && n < num; n++ ) {
+			same = d.GetElemVec3 ( 0, n )->y == (float) 2*n && d.GetElemInt ( 1, n ) == n
+				&& d.GetElemStr ( 3, n ) == ( ( n % 3 ) ? "even" : "third" );
+		}
+		for ( int v = 0; same && v < lists; v++ ) {
+			hList* l = (hList*) d.GetElem ( 2, v );
+			same = ( l->cnt == 20 );
+			for ( uint j = 0; same && j < l->cnt; j++ ) same = ( d.GetHeap ()[ l->pos + j ] == v + lists * (int) j );
+		}
+		for ( int k = 0; k < lists; k++ ) d.AddRef ( -1, (hList*) d.GetElem ( 2, k ), 0 );		// reuses free blocks from the file
+		same = same && ( (hList*) d.GetElem ( 2, 0 ) )->cnt == 21;
+		printf ( "%-28s %s\n", "round trip", same ? "ok" : "MISMATCH" );
+		ok &= same;
+		d.CloseMapped ();
+		d.ClearHeap ();
+	}
+
+	// Damaged files
+	std::vector<char> dat;
+	if ( !read_file ( fname, dat ) ) { printf ( "cannot read %s\n", fname.c_str () ); return 1; }
+	ok &= expect_reject ( "truncated header", bad, dat, sizeof ( FileHeader ) / 2, 0x0 );
+	ok &= expect_reject ( "truncated data", bad, dat, dat.size () / 2, 0x0 );
+	ok &= expect_reject ( "bad magic", bad, dat, dat.size (), [] ( FileHeader* h, FileBuf* ) { h->magic ^= 1; } );
+	ok &= expect_reject ( "free list head past heap", bad, dat, dat.size (), [] ( FileHeader* h, FileBuf* ) { h->heapList[0] = h->heapNum; } );
+	ok &= expect_reject ( "free list head negative", bad, dat, dat.size (), [] ( FileHeader* h, FileBuf* ) { h->heapList[1] = -100; } );
+	ok &= expect_reject ( "heap free count", bad, dat, dat.size (), [] ( FileHeader* h, FileBuf* ) { h->heapFree = h->heapNum + 1; } );
+	ok &= expect_reject ( "alignment not power of two", bad, dat, dat.size (), [] ( FileHeader*, FileBuf* b ) { b[1].align = 48; } );
+	ok &= expect_reject ( "alignment too large", bad, dat, dat.size (), [] ( FileHeader*, FileBuf* b ) { b[1].align = 1 << 20; } );
+	ok &= expect_reject ( "buffer bytes wrap", bad, dat, dat.size (), [] ( FileHeader*, FileBuf* b ) { b[0].bytes = ~0ULL - b[0].offset + 2; } );
+	ok &= expect_reject ( "element count wraps", bad, dat, dat.size (), [] ( FileHeader*, FileBuf* b ) { b[0].num = ( 1ULL << 62 ) + 1; } );
+
+	remove ( bad.c_str () );
+	remove ( fname.c_str () );
+	printf ( "%s\n", ok ? "PASS" : "FAIL" );
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+
+// DataX sort benchmark
+//
+// Sorts random 32-bit and 64-bit keys with DataX::RadixSort and with
+// std::stable_sort on an index array, and checks both give the same order.
+// Then builds a random particle set (position, velocity, id), reorders it by
+// Morton code, and reports the mean distance between particles that are
+// adjacent in memory before and after the sort.
+//
+// Usage:
+//   datax_sort_bench [-n elements] [-t threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "datax.h"
+#include "task_pool.h"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static double now_msec ()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count () / 1000.0;
+}
+
+template<typename K> static bool time_sort ( const char* label, std::vector<K>& keys )
+{
+	uint32_t num = (uint32_t) keys.size ();
+	std::vector<uint32_t> perm, ref ( num );
+
+	double t0 = now_msec ();
+	DataX::RadixSort ( keys.data (), num, perm );
+	double t1 = now_msec ();
+	for ( uint32_t n = 0; n < num; n++ ) ref[n] = n;
+	std::stable_sort ( ref.begin (), ref.end (), [&keys] ( uint32_t a, uint32_t b ) { return keys[a] < keys[b]; } );
+	double t2 = now_msec ();
+
+	bool same = ( perm == ref );
+	printf ( "%s keys: RadixSort %8.2f ms, std::stable_sort %8.2f ms %s\n", label, t1 - t0, t2 - t1, same ? "" : "(ORDER MISMATCH)" );
+	return same;
+}
+
+// Mean distance between each particle and the next one in memory
+static float neighbour_dist ( DataX& dat )
+{
+	Vec3F* pos = dat.bufF3 ( 0 );
+	int num = dat.GetNumElem ( 0 );
+	double sum = 0;
+	for ( int n = 0; n < num - 1; n++ ) sum += ( pos[n + 1] - pos[n] ).Length ();
+	return (float) ( sum / ( num - 1 ) );
+}
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 4000000 );
+	int threads = get_arg ( argc, argv, "-t", 0 );
+
+	TaskPool& pool = TaskPool::Get ();
+	pool.Start ( threads );
+	printf ( "%d elements, %d threads\n", num, pool.getNumThreads () );
+
+	std::mt19937_64 rnd ( 7 );
+	std::vector<uint32_t> k32 ( num );
+	std::vector<uint64_t> k64 ( num );
+	for ( int n = 0; n < num; n++ ) { k64[n] = rnd (); k32[n] = (uint32_t) ( k64[n] >> 20 ); }
+	bool ok = time_sort ( "32-bit", k32 );
+	ok &= time_sort ( "64-bit", k64 );
+
+	// Particles in random order
+	DataX dat;
+	dat.AddBuffer ( 0, "pos", sizeof ( Vec3F ), num );
+	dat.AddBuffer ( 1, "vel", sizeof ( Vec3F ), num );
+	dat.AddBuffer ( 2, "id", sizeof ( int ), num );
+	dat.SetNum ( num );
+	std::uniform_real_distribution<float> u ( 0, 100 );
+	for ( int n = 0; n < num; n++ ) {
+		dat.bufF3 ( 0 )[n].Set ( u ( rnd ), u ( rnd ), u ( rnd ) );
+		dat.bufF3 ( 1 )[n].Set ( (float) n, 0, 0 );
+		dat.bufI ( 2 )[n] = n;
+	}
+	float before = neighbour_dist ( dat );
+	double t0 = now_msec ();
+	dat.SortByMorton ( 0 );
+	double t_sort = now_msec () - t0;
+	float after = neighbour_dist ( dat );
+
+	for ( int n = 0; n < num; n++ ) {						// gathers kept buffers together
+		if ( dat.bufF3 ( 1 )[n].x != (float) dat.bufI ( 2 )[n] ) { ok = false; break; }
+	}
+	printf ( "SortByMorton (3 buffers): %8.2f ms\n", t_sort );
+	printf ( "neighbour distance, random: %8.3f\n", before );
+	printf ( "neighbour distance, morton: %8.3f\n", after );
+
+	dat.DeleteAllBuffers ();
+	return ok ? 0 : 1;
+}
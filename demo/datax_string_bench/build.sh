@@ -0,0 +1,5 @@
+
+cmake CMakeLists.txt -B../../../build/datax_string_bench
+make -C../../../build/datax_string_bench
+
+
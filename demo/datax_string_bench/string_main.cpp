@@ -0,0 +1,90 @@
+
+// DataX string arena benchmark
+//
+// Gives every element a string attribute drawn from a small set of names,
+// as material or group tags on mesh elements are. Stores them as a
+// std::vector<std::string> and as a DataX string buffer, then times setting
+// them, reading them by value (GetElemStr) and as views (GetElemStrView),
+// and counting elements equal to one tag by comparing refs.
+//
+// Usage:
+//   datax_string_bench [-n elements] [-u distinct strings]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "datax.h"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static double now_msec ()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count () / 1000.0;
+}
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 4000000 );
+	int uniq = get_arg ( argc, argv, "-u", 1000 );
+
+	std::vector<std::string> names ( uniq );
+	for ( int u = 0; u < uniq; u++ ) names[u] = "material_group_" + std::to_string ( u );
+
+	// std::string per element
+	double t0 = now_msec ();
+	std::vector<std::string> vec ( num );
+	for ( int n = 0; n < num; n++ ) vec[n] = names[ n % uniq ];
+	double t1 = now_msec ();
+	uint64_t len_vec = 0;
+	for ( int n = 0; n < num; n++ ) { std::string s = vec[n]; len_vec += s.size (); }
+	double t2 = now_msec ();
+	uint64_t bytes_vec = (uint64_t) num * sizeof ( std::string );
+	for ( int n = 0; n < num; n++ ) if ( vec[n].capacity () > 15 ) bytes_vec += vec[n].capacity () + 1;	// past small string storage
+
+	// DataX arena
+	DataX dat;
+	dat.AddStrBuffer ( 0, "tag", num );
+	dat.SetNum ( num );
+	double t3 = now_msec ();
+	for ( int n = 0; n < num; n++ ) dat.SetElemStr ( 0, n, names[ n % uniq ].c_str (), (uint) names[ n % uniq ].size () );
+	double t4 = now_msec ();
+	uint64_t len_str = 0;
+	for ( int n = 0; n < num; n++ ) len_str += dat.GetElemStr ( 0, n ).size ();
+	double t5 = now_msec ();
+	uint64_t len_view = 0;
+	for ( int n = 0; n < num; n++ ) len_view += dat.GetElemStrView ( 0, n ).len;
+	double t6 = now_msec ();
+	uint64_t bytes_arena = (uint64_t) num * sizeof ( strref ) + dat.GetStrArenaSize ();
+
+	// Equality against one tag: string compares vs interned refs
+	const std::string& tag = names[ uniq / 2 ];
+	int cnt_vec = 0, cnt_ref = 0;
+	double t7 = now_msec ();
+	for ( int n = 0; n < num; n++ ) if ( vec[n] == tag ) cnt_vec++;
+	double t8 = now_msec ();
+	strref r;
+	dat.FindStr ( tag.c_str (), (uint) tag.size (), r );
+	strref* refs = (strref*) dat.GetBufData ( 0 );
+	for ( int n = 0; n < num; n++ ) if ( refs[n].off == r.off && refs[n].len == r.len ) cnt_ref++;
+	double t9 = now_msec ();
+
+	bool ok = ( len_vec == len_str && len_str == len_view && cnt_vec == cnt_ref );
+	printf ( "%d elements, %d distinct strings %s\n", num, uniq, ok ? "" : "(MISMATCH)" );
+	printf ( "set,  std::string:     %8.1f ms    set, SetElemStr:     %8.1f ms\n", t1 - t0, t4 - t3 );
+	printf ( "read, std::string copy:%8.1f ms    read, GetElemStr:    %8.1f ms    read, GetElemStrView: %6.1f ms\n", t2 - t1, t5 - t4, t6 - t5 );
+	printf ( "equal, std::string:    %8.1f ms    equal, strref:       %8.1f ms\n", t8 - t7, t9 - t8 );
+	printf ( "memory, std::string:   %8.1f MB    memory, arena:       %8.1f MB (%u strings)\n", bytes_vec / 1048576.0, bytes_arena / 1048576.0, dat.GetStrCount () );
+
+	dat.DeleteAllBuffers ();
+	return ok ? 0 : 1;
+}
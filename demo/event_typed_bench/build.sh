@@ -0,0 +1,5 @@
+
+cmake CMakeLists.txt -B../../../build/event_typed_bench
+make -C../../../build/event_typed_bench
+
+
@@ -0,0 +1,3 @@
+
+rm -rf ../../../build/event_typed_bench/*
+
@@ -0,0 +1,156 @@
+
+// Typed event benchmark
+//
+// Builds and reads back events holding a few fixed-size records, first with
+// per-field calls (attachInt, attachFloat, ..) then with attachAll / getAll
+// on a struct declared with EVENT_SCHEMA. Both produce identical payloads,
+// which is checked before timing.
+//
+// Usage:
+//   event_typed_bench [-n events] [-r records per event]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "event_system.h"
+
+struct Sample {
+	int			id;
+	float		x, y, z;
+	double		t;
+	xlong		seq;
+	Vec4F		color;
+	uchar		flags;
+
+	EVENT_SCHEMA ( id, x, y, z, t, seq, color, flags )
+};
+
+#define MAX_REC		4
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static double now_nsec ()
+{
+	return (double) std::chrono::duration_cast<std::chrono::nanoseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count ();
+}
+
+static void build_fields ( Event& e, Sample* s, int num )
+{
+	new_event ( e, 120, 'app ', 'bnch', 0, 0 );
+	e.startWrite ();
+	for ( int r = 0; r < num; r++ ) {
+		e.attachInt ( s[r].id );
+		e.attachFloat ( s[r].x );
+		e.attachFloat ( s[r].y );
+		e.attachFloat ( s[r].z );
+		e.attachDouble ( s[r].t );
+		e.attachInt64 ( s[r].seq );
+		e.attachVec4 ( s[r].color );
+		e.attachUChar ( s[r].flags );
+	}
+}
+
+static void build_typed ( Event& e, Sample* s, int num )
+{
+	new_event ( e, 120, 'app ', 'bnch', 0, 0 );
+	e.startWrite ();
+	if ( num == MAX_REC ) {
+		e.attachAll ( s[0], s[1], s[2], s[3] );			// one reserve for all records
+	} else {
+		for ( int r = 0; r < num; r++ ) e.attachAll ( s[r] );
+	}
+}
+
+static xlong read_fields ( Event& e, int num )
+{
+	xlong sum = 0;
+	e.startRead ();
+	for ( int r = 0; r < num; r++ ) {
+		Sample s;
+		s.id = e.getInt ();
+		s.x = e.getFloat ();
+		s.y = e.getFloat ();
+		s.z = e.getFloat ();
+		s.t = e.getDouble ();
+		s.seq = e.getInt64 ();
+		s.color = e.getVec4 ();
+		s.flags = e.getUChar ();
+		sum += s.id + s.seq + s.flags;
+	}
+	return sum;
+}
+
+static xlong read_typed ( Event& e, int num )
+{
+	xlong sum = 0;
+	e.startRead ();
+	Sample s[ MAX_REC ];
+	if ( num == MAX_REC ) {
+		e.getAll ( s[0], s[1], s[2], s[3] );
+	} else {
+		for ( int r = 0; r < num; r++ ) e.getAll ( s[r] );
+	}
+	for ( int r = 0; r < num; r++ ) sum += s[r].id + s[r].seq + s[r].flags;
+	return sum;
+}
+
+int main ( int argc, char* argv [] )
+{
+	int num_events = get_arg ( argc, argv, "-n", 1000000 );
+	int num_rec = get_arg ( argc, argv, "-r", MAX_REC );
+	if ( num_rec < 1 || num_rec > MAX_REC ) num_rec = MAX_REC;
+
+	Sample s[ MAX_REC ];
+	for ( int r = 0; r < MAX_REC; r++ ) {
+		s[r].id = r;
+		s[r].x = r * 1.0f;	s[r].y = r * 2.0f;	s[r].z = r * 3.0f;
+		s[r].t = r * 0.5;
+		s[r].seq = 1000 + r;
+		s[r].color.Set ( 1, 0, 0, 1 );
+		s[r].flags = (uchar) r;
+	}
+	printf ( "record: %d bytes (sizeof %d), %d records per event\n", Event::getSizeAll<Sample> (), (int) sizeof ( Sample ), num_rec );
+
+	// Same payload either way
+	Event a, b;
+	build_fields ( a, s, num_rec );
+	build_typed ( b, s, num_rec );
+	if ( a.getDataLength () != b.getDataLength () || memcmp ( a.getData (), b.getData (), a.getDataLength () ) != 0 ) {
+		printf ( "ERROR: payloads differ (%d vs %d bytes)\n", a.getDataLength (), b.getDataLength () );
+		return 1;
+	}
+
+	xlong check = 0;
+	double t0 = now_nsec ();
+	for ( int n = 0; n < num_events; n++ ) {
+		Event e;
+		build_fields ( e, s, num_rec );
+		check += e.getDataLength ();
+	}
+	double t1 = now_nsec ();
+	for ( int n = 0; n < num_events; n++ ) {
+		Event e;
+		build_typed ( e, s, num_rec );
+		check += e.getDataLength ();
+	}
+	double t2 = now_nsec ();
+	for ( int n = 0; n < num_events; n++ ) check += read_fields ( a, num_rec );
+	double t3 = now_nsec ();
+	for ( int n = 0; n < num_events; n++ ) check += read_typed ( b, num_rec );
+	double t4 = now_nsec ();
+
+	printf ( "build, per-field:  %7.1f ns/event\n", ( t1 - t0 ) / num_events );
+	printf ( "build, attachAll:  %7.1f ns/event\n", ( t2 - t1 ) / num_events );
+	printf ( "read,  per-field:  %7.1f ns/event\n", ( t3 - t2 ) / num_events );
+	printf ( "read,  getAll:     %7.1f ns/event\n", ( t4 - t3 ) / num_events );
+	printf ( "(check %llu)\n", check );
+	return 0;
+}
@@ -0,0 +1,5 @@
+
+cmake CMakeLists.txt -B../../../build/net_busy_poll
+make -C../../../build/net_busy_poll
+
+
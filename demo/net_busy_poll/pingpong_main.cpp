@@ -0,0 +1,151 @@
+
+// Ping-pong latency benchmark
+//
+// A client sends a small event, the server echoes it, and the client
+// records the round trip. Runs the default select mode, then busy-poll
+// mode (netSetBusyPoll), and prints the round-trip distribution of each.
+// Server and client run in separate processes; in busy-poll mode they are
+// pinned to cpu 0 and cpu 1 when available. Busy polling needs a core per spinning side.
+//
+// Usage:
+//   net_busy_poll [-n pings busy] [-d pings default] [-p port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "network_system.h"
+
+static bool g_pin = false;			// pin server and client to separate cpus
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static xlong now_nsec ()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count ();
+}
+
+class PingServer : public NetworkSystem {
+public:
+	static int OnEvent ( Event& e, void* this_ptr )
+	{
+		PingServer* self = (PingServer*) this_ptr;
+		if ( e.getName () == 'cPng' ) {
+			e.startRead ();
+			Event r;
+			self->netMakeEvent ( r, 'sPng', 0 );
+			r.setTarget ( 'app ' );
+			r.attachInt64 ( e.getInt64 () );
+			self->netSend ( r, e.getSrcSock () );
+		}
+		return 0;
+	}
+};
+
+class PingClient : public NetworkSystem {
+public:
+	PingClient () : connected ( false ), replies ( 0 ) {}
+	static int OnEvent ( Event& e, void* this_ptr )
+	{
+		PingClient* self = (PingClient*) this_ptr;
+		switch ( e.getName () ) {
+		case 'sOkT':	self->connected = true;	break;
+		case 'sPng':	self->replies++;		break;
+		}
+		return 0;
+	}
+	bool connected;
+	int replies;
+};
+
+static void run_client ( bool busy, int port, int pings )
+{
+	PingClient cli;
+	cli.netInitialize ();
+	cli.netSetSecurityLevel ( NET_SECURITY_PLAIN_TCP );
+	cli.netSetReconnectInterval ( 100 );
+	cli.netSetUserCallback ( &PingClient::OnEvent );
+	if ( busy ) cli.netSetBusyPoll ( true, g_pin ? 1 : -1 );
+	cli.netClientStart ( port + 1 );
+	int sock = cli.netClientConnectToServer ( "127.0.0.1", port, false );
+
+	xlong start = now_nsec ();
+	while ( !cli.connected && now_nsec () - start < 5000000000LL ) {
+		cli.netProcessQueue ();
+		if ( !busy ) std::this_thread::sleep_for ( std::chrono::milliseconds ( 1 ) );
+	}
+	if ( !cli.connected ) {
+		printf ( "  client could not connect\n" );
+		return;
+	}
+	std::vector<double> rtt;
+	for ( int n = 0; n < pings; n++ ) {
+		Event e;
+		cli.netMakeEvent ( e, 'cPng', 0 );
+		e.setTarget ( 'app ' );
+		e.attachInt64 ( n );
+		int expect = cli.replies + 1;
+		xlong t0 = now_nsec ();
+		cli.netSend ( e, sock );
+		while ( cli.replies < expect ) {
+			cli.netProcessQueue ();
+		}
+		rtt.push_back ( ( now_nsec () - t0 ) / 1000.0 );
+	}
+	std::sort ( rtt.begin (), rtt.end () );
+	int cnt = rtt.size ();
+	printf ( "  %d pings, round trip usec: min %.1f  p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", cnt,
+				rtt[0], rtt[ cnt/2 ], rtt[ (cnt*99)/100 ], rtt[ (cnt*999)/1000 ], rtt[ cnt-1 ] );
+}
+
+static void run_mode ( bool busy, int port, int pings )
+{
+	printf ( "%s mode:\n", busy ? "busy poll" : "default" );
+	fflush ( stdout );
+
+	PingServer srv;
+	srv.netInitialize ();
+	srv.netSetSecurityLevel ( NET_SECURITY_PLAIN_TCP );
+	srv.netSetUserCallback ( &PingServer::OnEvent );
+	if ( busy ) srv.netSetBusyPoll ( true, g_pin ? 0 : -1 );
+	srv.netServerStart ( port, NET_SECURITY_PLAIN_TCP );
+
+	pid_t pid = fork ();
+	if ( pid == 0 ) {
+		run_client ( busy, port, pings );
+		fflush ( stdout );
+		_exit ( 0 );							// skip server teardown in the child
+	}
+	int status = 0;
+	while ( waitpid ( pid, &status, WNOHANG ) == 0 ) {
+		srv.netProcessQueue ();
+	}
+}
+
+int main ( int argc, char* argv [] )
+{
+	int pings_busy = get_arg ( argc, argv, "-n", 20000 );
+	int pings_default = get_arg ( argc, argv, "-d", 20 );
+	int port = get_arg ( argc, argv, "-p", 16160 );
+
+	g_pin = ( std::thread::hardware_concurrency () >= 2 );
+	if ( !g_pin ) {
+		printf ( "Warning: fewer than 2 cpus. Busy poll results will not be representative.\n" );
+	}
+	run_mode ( false, port, pings_default );
+	run_mode ( true, port + 10, pings_busy );
+	return 0;
+}
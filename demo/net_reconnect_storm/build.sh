@@ -0,0 +1,5 @@
+
+cmake CMakeLists.txt -B../../../build/net_reconnect_storm
+make -C../../../build/net_reconnect_storm
+
+
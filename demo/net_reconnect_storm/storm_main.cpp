@@ -0,0 +1,143 @@
+
+// Reconnect storm benchmark
+//
+// Many clients connect to a freshly started server at the same instant,
+// as happens when a server restarts. The server is a NetworkSystem; the
+// clients are raw non-blocking sockets in a child process. Each client
+// waits for the server's first event (sOkT) and records the delay.
+//
+// Usage:
+//   net_reconnect_storm [-n clients] [-b accept budget] [-t client timeout ms] [-p port]
+//
+// Compare the default budget with -b 1 (one accept per tick).
+// Client count should stay below FD_SETSIZE, as the server uses select.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "network_system.h"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static double now_msec ()
+{
+	return TimeX::GetSystemNSec () / MSEC_SCALAR;
+}
+
+class StormServer : public NetworkSystem {
+public:
+	StormServer () : accepted ( 0 ) {}
+	static int OnEvent ( Event& e, void* this_ptr )
+	{
+		StormServer* self = (StormServer*) this_ptr;
+		if ( e.getName () == 'sOkT' ) self->accepted++;
+		return 0;
+	}
+	int accepted;
+};
+
+// Child process. Connect all clients at once and time the first event from the server.
+static void run_clients ( int num, int port, int timeout_ms )
+{
+	std::vector<pollfd> fds ( num );
+	std::vector<double> delay ( num, -1 );
+	sockaddr_in addr;
+	memset ( &addr, 0, sizeof ( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons ( port );
+	addr.sin_addr.s_addr = inet_addr ( "127.0.0.1" );
+
+	double t0 = now_msec ();
+	for ( int n = 0; n < num; n++ ) {
+		fds[n].fd = socket ( AF_INET, SOCK_STREAM, 0 );
+		fcntl ( fds[n].fd, F_SETFL, O_NONBLOCK );
+		connect ( fds[n].fd, (sockaddr*) &addr, sizeof ( addr ) );
+		fds[n].events = POLLIN;
+	}
+	int done = 0;
+	char buf[ 256 ];
+	while ( done < num && now_msec () - t0 < timeout_ms ) {
+		if ( poll ( &fds[0], num, 10 ) <= 0 ) continue;
+		for ( int n = 0; n < num; n++ ) {
+			if ( fds[n].fd >= 0 && ( fds[n].revents & (POLLIN | POLLHUP | POLLERR) ) ) {
+				if ( recv ( fds[n].fd, buf, sizeof ( buf ), 0 ) > 0 ) delay[n] = now_msec () - t0;
+				close ( fds[n].fd );
+				fds[n].fd = -1;					// poll ignores negative fds
+				done++;
+			}
+		}
+	}
+	double total = now_msec () - t0;
+
+	std::vector<double> ok;
+	for ( int n = 0; n < num; n++ ) {
+		if ( delay[n] >= 0 ) ok.push_back ( delay[n] );
+		if ( fds[n].fd >= 0 ) close ( fds[n].fd );
+	}
+	std::sort ( ok.begin (), ok.end () );
+	int timed_out = num - (int) ok.size ();
+	printf ( "clients: %d, connected: %d, timed out (>%d ms): %d\n", num, (int) ok.size (), timeout_ms, timed_out );
+	if ( ok.size () > 0 ) {
+		printf ( "first event delay: p50 %.1f ms, p99 %.1f ms, max %.1f ms\n", ok[ ok.size () / 2 ], ok[ (ok.size () * 99) / 100 ], ok.back () );
+	}
+	printf ( "total: %.1f ms\n", total );
+}
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 900 );
+	int budget = get_arg ( argc, argv, "-b", NET_ACCEPT_BUDGET );
+	int timeout_ms = get_arg ( argc, argv, "-t", 5000 );
+	int port = get_arg ( argc, argv, "-p", 16150 );
+
+	rlimit lim;
+	getrlimit ( RLIMIT_NOFILE, &lim );
+	lim.rlim_cur = lim.rlim_max;
+	setrlimit ( RLIMIT_NOFILE, &lim );
+
+	// Server
+	StormServer srv;
+	srv.netInitialize ();
+	srv.netSetSecurityLevel ( NET_SECURITY_PLAIN_TCP );
+	srv.netSetUserCallback ( &StormServer::OnEvent );
+	srv.netSetSelectInterval ( 1 );
+	srv.netSetAcceptBudget ( budget );
+	if ( !srv.netServerStart ( port, NET_SECURITY_PLAIN_TCP ) ) {
+		printf ( "Unable to start server on port %d\n", port );
+		return 1;
+	}
+	printf ( "accept budget: %d\n", budget );
+
+	// Clients
+	fflush ( stdout );
+	pid_t pid = fork ();
+	if ( pid == 0 ) {
+		run_clients ( num, port, timeout_ms );
+		fflush ( stdout );
+		_exit ( 0 );							// skip server teardown in the child
+	}
+	int status = 0;
+	while ( waitpid ( pid, &status, WNOHANG ) == 0 ) {
+		srv.netProcessQueue ();
+	}
+	printf ( "server accepted: %d\n", srv.accepted );
+	return 0;
+}
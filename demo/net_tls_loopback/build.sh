@@ -0,0 +1,5 @@
+
+cmake CMakeLists.txt -B../../../build/net_tls_loopback
+make -C../../../build/net_tls_loopback
+
+
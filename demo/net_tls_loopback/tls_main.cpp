@@ -0,0 +1,179 @@
+
+// TLS loopback test
+//
+// Creates a self-signed certificate, starts a TLS server and client in one
+// process over 127.0.0.1 and sends large events while the server is not
+// reading, so the socket buffer fills and SSL_write stops part way (partial
+// write or SSL_ERROR_WANT_WRITE). netSend refuses further events until the
+// residual is flushed, which counts as one resumption. Then both sides run
+// and the server checks that every event arrived intact and in order.
+// Exits non-zero if nothing had to be resumed or any event is lost or damaged.
+//
+// Usage:
+//   net_tls_loopback [-n events] [-s event bytes] [-p port] [-k use kTLS]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include "network_system.h"
+
+#define CERT_FILE	"tls_loopback_cert.pem"
+#define KEY_FILE	"tls_loopback_key.pem"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static bool has_arg ( int argc, char** argv, const char* arg )
+{
+	for ( int i = 1; i < argc; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return true;
+	}
+	return false;
+}
+
+// EC P-256 key and a one day self-signed certificate for CN=localhost
+static bool write_self_signed ( const char* cert_file, const char* key_file )
+{
+	EVP_PKEY* key = EVP_EC_gen ( "P-256" );
+	X509* x = X509_new ();
+	bool ok = ( key != 0x0 && x != 0x0 );
+	if ( ok ) {
+		X509_set_version ( x, 2 );
+		ASN1_INTEGER_set ( X509_get_serialNumber ( x ), 1 );
+		X509_gmtime_adj ( X509_getm_notBefore ( x ), 0 );
+		X509_gmtime_adj ( X509_getm_notAfter ( x ), 24 * 3600 );
+		X509_set_pubkey ( x, key );
+		X509_NAME* name = X509_get_subject_name ( x );
+		X509_NAME_add_entry_by_txt ( name, "CN", MBSTRING_ASC, (const unsigned char*) "localhost", -1, -1, 0 );
+		X509_set_issuer_name ( x, name );
+		ok = X509_sign ( x, key, EVP_sha256 () ) > 0;
+	}
+	FILE* fp;
+	if ( ok && ( fp = fopen ( cert_file, "wb" ) ) != 0x0 ) { ok = PEM_write_X509 ( fp, x ) == 1; fclose ( fp ); } else ok = false;
+	if ( ok && ( fp = fopen ( key_file, "wb" ) ) != 0x0 ) { ok = PEM_write_PrivateKey ( fp, key, 0x0, 0x0, 0, 0x0, 0x0 ) == 1; fclose ( fp ); } else ok = false;
+	X509_free ( x );
+	EVP_PKEY_free ( key );
+	return ok;
+}
+
+static char fill_byte ( int event, int i )		{ return (char) ( i * 31 + event ); }
+
+class TlsServer : public NetworkSystem {
+public:
+	TlsServer () : got ( 0 ), bad ( 0 ), size ( 0 ) {}
+	static int OnEvent ( Event& e, void* this_ptr )
+	{
+		TlsServer* self = (TlsServer*) this_ptr;
+		if ( e.getName () != 'cBig' ) return 0;
+		e.startRead ();
+		int k = e.getInt ();
+		const char* dat = e.getData () + sizeof(int);
+		bool ok = ( k == self->got + self->bad ) && ( e.getDataLength () - (int) sizeof(int) == self->size );
+		for ( int i = 0; ok && i < self->size; i++ ) ok = ( dat[i] == fill_byte ( k, i ) );
+		if ( ok ) self->got++; else self->bad++;
+		return 0;
+	}
+	int got, bad, size;
+};
+
+class TlsClient : public NetworkSystem {
+public:
+	TlsClient () : connected ( false ) {}
+	static int OnEvent ( Event& e, void* this_ptr )
+	{
+		if ( e.getName () == 'sOkT' ) ( (TlsClient*) this_ptr )->connected = true;
+		return 0;
+	}
+	bool connected;
+};
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 16 );
+	int size = get_arg ( argc, argv, "-s", 1 << 20 );
+	int port = get_arg ( argc, argv, "-p", 16170 );
+	bool ktls = has_arg ( argc, argv, "-k" );
+
+	if ( !write_self_signed ( CERT_FILE, KEY_FILE ) ) {
+		printf ( "cannot create a self-signed certificate\n" );
+		return 1;
+	}
+	TlsServer srv;
+	srv.size = size;
+	srv.netSetSecurityLevel ( NET_SECURITY_OPENSSL );
+	srv.netSetPathToPublicKey ( CERT_FILE );
+	srv.netSetPathToPrivateKey ( KEY_FILE );
+	srv.netSetKernelTLS ( ktls );
+	srv.netInitialize ();
+	srv.netSetUserCallback ( &TlsServer::OnEvent );
+	srv.netSetBusyPoll ( true, -1 );					// no 200 ms process interval, no cpu pinning
+	srv.netServerStart ( port, NET_SECURITY_OPENSSL );
+
+	TlsClient cli;
+	cli.netSetSecurityLevel ( NET_SECURITY_OPENSSL );
+	cli.netSetPathToPublicKey ( CERT_FILE );
+	cli.netSetKernelTLS ( ktls );
+	cli.netSetReconnectInterval ( 100 );
+	cli.netInitialize ();
+	cli.netSetUserCallback ( &TlsClient::OnEvent );
+	cli.netSetBusyPoll ( true, -1 );
+	cli.netClientStart ( port + 1 );
+	int sock = cli.netClientConnectToServer ( "127.0.0.1", port, false );
+
+	for ( int i = 0; i < 500 && !cli.connected; i++ ) {
+		srv.netProcessQueue ();
+		cli.netProcessQueue ();
+		std::this_thread::sleep_for ( std::chrono::milliseconds ( 10 ) );
+	}
+	if ( !cli.connected ) {
+		printf ( "TLS handshake did not complete\n" );
+		return 1;
+	}
+
+	// Send with the server stalled, then let both run until the sends drain
+	std::vector<char> buf ( size );
+	int sent = 0, resumed = 0, stalled = 0;
+	for ( ; sent < num; sent++ ) {
+		Event e;
+		cli.netMakeEvent ( e, 'cBig', 0 );
+		e.setTarget ( 'app ' );
+		e.attachInt ( sent );
+		for ( int i = 0; i < size; i++ ) buf[i] = fill_byte ( sent, i );
+		e.attachBuf ( buf.data (), size );
+		bool refused = false;
+		for ( int tries = 0; !cli.netSend ( e, sock ) && tries < 100000; tries++ ) {
+			refused = true;
+			if ( stalled < 50 ) stalled++;				// give the client time to hit a full socket buffer
+			else srv.netProcessQueue ();
+			cli.netProcessQueue ();
+			std::this_thread::sleep_for ( std::chrono::milliseconds ( 1 ) );
+		}
+		if ( refused ) resumed++;
+	}
+	for ( int i = 0; i < 20000 && srv.got + srv.bad < num; i++ ) {
+		srv.netProcessQueue ();
+		cli.netProcessQueue ();
+		std::this_thread::sleep_for ( std::chrono::milliseconds ( 1 ) );
+	}
+	remove ( CERT_FILE );
+	remove ( KEY_FILE );
+
+	printf ( "sent %d events of %d bytes%s, resumed after a partial write %d times\n", sent, size, ktls ? " (kTLS)" : "", resumed );
+	printf ( "received %d intact, %d damaged or out of order, %d missing\n", srv.got, srv.bad, num - srv.got - srv.bad );
+	bool ok = ( resumed > 0 && srv.got == num );
+	printf ( "%s\n", ok ? "PASS" : "FAIL" );
+	return ok ? 0 : 1;
+}
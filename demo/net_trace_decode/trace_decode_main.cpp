@@ -0,0 +1,35 @@
+
+// Offline decoder for binary network traces.
+//
+// Applications enable tracing with NetTrace::Enable(true) and write the
+// per-thread rings to disk with NetTrace::Save("net.trace").
+//
+// Usage:
+//   net_trace_decode <trace file>                      text to stdout
+//   net_trace_decode <trace file> -chrome out.json     Chrome trace JSON (chrome://tracing or ui.perfetto.dev)
+//   net_trace_decode <trace file> -text out.txt        text to file
+
+#include <stdio.h>
+#include <string.h>
+
+#include "net_trace.h"
+
+int main ( int argc, char **argv )
+{
+	if ( argc < 2 ) {
+		printf ( "usage: net_trace_decode <trace file> [-text|-chrome] [output file]\n" );
+		return 1;
+	}
+	int fmt = NTR_TEXT;
+	const char* out = 0;
+	for ( int a = 2; a < argc; a++ ) {
+		if ( strcmp ( argv[ a ], "-chrome" ) == 0 )		fmt = NTR_CHROME;
+		else if ( strcmp ( argv[ a ], "-text" ) == 0 )	fmt = NTR_TEXT;
+		else											out = argv[ a ];
+	}
+	if ( ! NetTrace::Decode ( argv[ 1 ], out, fmt ) ) {
+		printf ( "Unable to decode trace: %s\n", argv[ 1 ] );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,5 @@
+
+cmake CMakeLists.txt -B../../../build/net_unix_fd_passing
+make -C../../../build/net_unix_fd_passing
+
+
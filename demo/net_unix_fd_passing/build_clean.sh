@@ -0,0 +1,3 @@
+
+rm -rf ../../../build/net_unix_fd_passing/*
+
@@ -0,0 +1,144 @@
+
+// Unix domain descriptor passing test
+//
+// Starts a server and client in one process on a unix domain socket. The
+// client sends a burst of events before the server reads any, so several
+// land in one read. Every third event carries a memfd holding its number,
+// sent with netSendDescriptor. In its callback the server checks that
+// netRecvDescriptor returns the descriptor sent with that event, and -1 for
+// events sent without one. Exits non-zero if any event is missing, gets no
+// descriptor, or gets another event's descriptor.
+//
+// Linux only (memfd_create).
+//
+// Usage:
+//   net_unix_fd_passing [-n events] [-p path]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+#include "network_system.h"
+
+static int get_arg ( int argc, char** argv, const char* arg, int value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return atoi ( argv[i+1] );
+	}
+	return value;
+}
+
+static const char* get_str ( int argc, char** argv, const char* arg, const char* value )
+{
+	for ( int i = 1; i < argc - 1; i++ ) {
+		if ( strcmp ( argv[i], arg ) == 0 ) return argv[i+1];
+	}
+	return value;
+}
+
+static bool has_fd ( int k )		{ return k % 3 == 0; }
+
+class FdServer : public NetworkSystem {
+public:
+	FdServer () : got ( 0 ), ok ( 0 ), wrong ( 0 ) {}
+	static int OnEvent ( Event& e, void* this_ptr )
+	{
+		FdServer* self = (FdServer*) this_ptr;
+		if ( e.getName () != 'cFdT' ) return 0;
+		e.startRead ();
+		int k = e.getInt ();
+		int fd = self->netRecvDescriptor ( e.getSrcSock () );
+		bool good;
+		if ( has_fd ( k ) ) {
+			int v = -1;
+			good = ( fd >= 0 && pread ( fd, &v, sizeof ( v ), 0 ) == sizeof ( v ) && v == k );
+		} else {
+			good = ( fd < 0 );
+		}
+		if ( fd >= 0 ) close ( fd );
+		self->got++;
+		if ( good ) self->ok++; else self->wrong++;
+		return 0;
+	}
+	int got, ok, wrong;
+};
+
+class FdClient : public NetworkSystem {
+public:
+	FdClient () : connected ( false ) {}
+	static int OnEvent ( Event& e, void* this_ptr )
+	{
+		if ( e.getName () == 'sOkT' ) ( (FdClient*) this_ptr )->connected = true;
+		return 0;
+	}
+	bool connected;
+};
+
+int main ( int argc, char* argv [] )
+{
+	int num = get_arg ( argc, argv, "-n", 60 );
+	const char* path = get_str ( argc, argv, "-p", "@libmin_fd_passing" );
+
+	FdServer srv;
+	srv.netInitialize ();
+	srv.netSetUserCallback ( &FdServer::OnEvent );
+	srv.netSetBusyPoll ( true, -1 );					// no 200 ms process interval, no cpu pinning
+	if ( !srv.netServerStart ( path ) ) {
+		printf ( "cannot listen on %s\n", path );
+		return 1;
+	}
+	FdClient cli;
+	cli.netInitialize ();
+	cli.netSetUserCallback ( &FdClient::OnEvent );
+	cli.netSetBusyPoll ( true, -1 );
+	cli.netClientStart ( 0 );
+	int sock = cli.netClientConnectToServer ( path, 0, false );
+
+	for ( int i = 0; i < 500 && !cli.connected; i++ ) {
+		srv.netProcessQueue ();
+		cli.netProcessQueue ();
+		std::this_thread::sleep_for ( std::chrono::milliseconds ( 2 ) );
+	}
+	if ( !cli.connected ) {
+		printf ( "client did not connect\n" );
+		return 1;
+	}
+
+	// Burst, server not reading. Sender keeps its descriptors open until the end.
+	std::vector<int> sent_fds;
+	int sent = 0;
+	for ( int k = 0; k < num; k++ ) {
+		Event e;
+		cli.netMakeEvent ( e, 'cFdT', 0 );
+		e.setTarget ( 'app ' );
+		e.attachInt ( k );
+		bool done;
+		if ( has_fd ( k ) ) {
+			int fd = memfd_create ( "fd_passing", MFD_CLOEXEC );
+			if ( fd < 0 || write ( fd, &k, sizeof ( k ) ) != sizeof ( k ) ) { printf ( "memfd_create failed\n" ); return 1; }
+			sent_fds.push_back ( fd );
+			done = cli.netSendDescriptor ( e, fd, sock );
+		} else {
+			done = cli.netSend ( e, sock );
+		}
+		if ( !done ) { printf ( "send %d refused\n", k ); break; }
+		sent++;
+	}
+	for ( int i = 0; i < 2000 && srv.got < sent; i++ ) {
+		srv.netProcessQueue ();
+		cli.netProcessQueue ();
+		std::this_thread::sleep_for ( std::chrono::milliseconds ( 1 ) );
+	}
+	for ( size_t n = 0; n < sent_fds.size (); n++ ) close ( sent_fds[n] );
+
+	printf ( "sent %d events, %d with a descriptor\n", sent, (int) sent_fds.size () );
+	printf ( "received %d, %d with the right descriptor, %d wrong, %d missing\n", srv.got, srv.ok, srv.wrong, num - srv.got );
+	bool ok = ( sent == num && srv.ok == num );
+	printf ( "%s\n", ok ? "PASS" : "FAIL" );
+	return ok ? 0 : 1;
+}
@@ -47,6 +47,7 @@
 
 	#define DT_USHORT3	8		//  48-bit, 3 chan @ 16-bit
 	#define DT_UINT64		9		//  64-bit, 1 chan @ 64-bit
+	#define DT_STRREF		10		//  64-bit, offset + length in the DataX string arena
 	#define DT_FLOAT3		12		//  96-bit, 3 chan @ 32-bit (float)
 	#define DT_FLOAT4		16	    // 128-bit, 4 chan @ 32-bit (float)
 
@@ -58,6 +59,33 @@
 	#define DT_GLTEX		16	
 	#define DT_GLVBO		32
 
+	// Large cpu buffers
+	// At or above the threshold, cpu memory is mapped directly (mmap on Linux,
+	// reserve-and-commit VirtualAlloc on Windows) and grows in place, or by moving
+	// page mappings, instead of malloc + copy + free. Set threshold 0 to disable.
+	// Transparent huge pages are opt-in (Linux), as they raise memory use per buffer.
+	#define DT_LARGE_MIN		( 64ULL << 20 )		// default threshold, bytes
+	#define DT_LARGE_RESERVE	( 1ULL << 30 )		// minimum address space reserved (Windows)
+	#define DT_HUGE_PAGE		( 2ULL << 20 )
+
+	// Alignment
+	// Cpu buffers start on an mAlign byte boundary (cache line by default).
+	// In padded mode the allocation also covers getNumPadded() elements, the
+	// count rounded up so count*stride is a multiple of mAlign, letting SIMD
+	// loops run whole vectors with no scalar tail. Padding elements are zero
+	// when allocated, but their contents are otherwise unspecified.
+	#define DT_ALIGN			64
+
+	// Dirty ranges
+	// With tracking on, writes through SetElem/AddElem/MarkDirty record element
+	// ranges in a small sorted interval set. Touching or overlapping ranges are
+	// joined, and past DT_DIRTY_MAX the two closest are merged. Commit then moves
+	// only dirty bytes and clears the set. CopyTo copies everything unless asked
+	// for dirty_only, which is only correct for a consumer that has seen every
+	// earlier change (Commit does not wait for it). Tracking starts with
+	// everything dirty. Writes through raw pointers must call MarkDirty.
+	#define DT_DIRTY_MAX		16
+
 	HELPAPI int getTypeSize(uchar dtype);
 
 	class HELPAPI DataPtr {
@@ -72,30 +100,47 @@
 
 		
 		// Buffer operations
-		void			Resize ( int stride, uint64_t cnt, char* dat=0x0, uchar dest_flags=DT_CPU );
+		void			Resize ( int stride, uint64_t cnt, char* dat=0x0, uchar dest_flags=DT_CPU, int align=DT_ALIGN, bool pad=false );
 		int				Append ( int stride, uint64_t cnt, char* dat=0x0, uchar dest_flags=DT_CPU );
 		void			UseMax ()	{ mNum = mMax; }
 		void			SetUsage ( uchar dt, uchar flags=DT_MISC, int rx=-1, int ry=-1, int rz=-1 );		// special usage (2D,3D,GLtex,GLvbo,etc.)
 		void			UpdateUsage ( uchar flags );		
-		void			ReallocateCPU ( uint64_t oldsz, uint64_t newsz );
+		bool			ReallocateCPU ( uint64_t oldsz, uint64_t newsz );		// false if out of memory, buffer unchanged
+		bool			ReallocateMapped ( uint64_t oldsz, uint64_t newsz );
+		void			FreeCPU ();
+		void			SetAlign ( int align, bool pad=false );		// power of two. takes effect on next allocation
+		static void		SetLargeAlloc ( uint64_t min_bytes, bool huge_pages = false )	{ mLargeMin = min_bytes; mHugePages = huge_pages; }
 		void			FillBuffer ( uchar v );
-		void			CopyTo ( DataPtr* dest, uchar dest_flags );
+		void			CopyTo ( DataPtr* dest, uchar dest_flags, bool dirty_only=false );
 		void			Commit ();		
 		void			Retrieve ();	
 		bool			Map();
 		bool			Unmap();
 		void			Clear ();
 
+		// Dirty ranges
+		void			SetTracking ( bool on );
+		bool			isTracking ()		{ return bTrack; }
+		void			MarkDirty ( uint64_t first, uint64_t cnt=1 )	{ if ( bTrack && cnt > 0 ) AddDirty ( first, first+cnt ); }
+		void			MarkAllDirty ()		{ mNumDirty = 0; if ( bTrack ) AddDirty ( 0, mMax ); }
+		void			ClearDirty ()		{ mNumDirty = 0; }
+		int				getNumDirty ()		{ return mNumDirty; }
+		bool			getDirty ( int k, uint64_t& first, uint64_t& last );		// element range [first,last), clamped to mNum
+		uint64_t		getDirtyBytes ();
+		void			AddDirty ( uint64_t first, uint64_t end );
+
 		// Data access
 		int				getUsage ()		{ return mUseType; }				
-		uint64_t		getDataSz ( int cnt, int stride )	{ return (uint64_t) cnt * stride; }
+		uint64_t		getDataSz ( uint64_t cnt, int stride )	{ return (uint64_t) cnt * stride; }
 		int				getNum()	{ return mNum; }
 		int				getMax()	{ return mMax; }
+		int				getPadStep ();								// elements per aligned block
+		uint64_t		getNumPadded ()	{ int s = getPadStep(); return (mNum + s-1) / s * s; }
 		char*			getData()	{ return mCpu; }
 		#ifdef USE_CUDA
 			CUdeviceptr		getGPU()	{ return mGpu; }		
 		#endif
-		void			SetElem(uint64_t n,  void* dat)	{ memcpy ( mCpu+n*mStride, dat, mStride); }
+		void			SetElem(uint64_t n,  void* dat)	{ memcpy ( mCpu+n*mStride, dat, mStride); MarkDirty ( n ); }
 		char*			getPtr(uint64_t n)		{ return mCpu + n*mStride; }		
 
 		// Multi-dimensional Get/Set
@@ -103,7 +148,7 @@
 									return mCpu + ((z*mUseRY + y)*mUseRX + x) * mStride; }
 
 		// Helper functions		
-		void			SetElemInt(uint64_t n, int val)	{ * (int*) (mCpu+n*mStride) = val; }
+		void			SetElemInt(uint64_t n, int val)	{ * (int*) (mCpu+n*mStride) = val; MarkDirty ( n ); }
 		int				getElemInt(uint64_t n)			{ return * (int*) (mCpu+n*mStride); }
 
 	public:
@@ -114,6 +159,15 @@
 		bool			bCpu=false, bGpu=false;
 		char*			mCpu=NULL;
 		
+		uint64_t		mMapSize=0, mMapReserve=0;		// mapped cpu bytes, 0 = malloc. See SetLargeAlloc
+		int				mAlign=DT_ALIGN;				// cpu alignment, bytes
+		bool			bView=false;					// mCpu is a view of a file mapping owned elsewhere. see DataX::LoadMapped
+		bool			bTrack=false;					// dirty range tracking
+		int				mNumDirty=0;
+		uint64_t		mDirty[ DT_DIRTY_MAX ][2];		// sorted element ranges [first,end)
+		uint64_t		mCommitNum=0;					// mNum at last commit
+		bool			bPad=false;						// allocate padded count
+
 		int				mGLID=-1;						// OpenGL
 
 		#ifdef USE_CUDA
@@ -133,6 +187,8 @@
 		#endif
 
 		static int		mFBO;
+		static uint64_t	mLargeMin;
+		static bool		mHugePages;
 	};
 
 #endif
@@ -23,6 +23,9 @@
 	#include "vec.h"
 	#include "timex.h"
 	#include <string>
+	#include <string.h>
+	#include <type_traits>
+	#include <utility>
 
 	// #define DEBUG_EVENT_MEM
 
@@ -45,6 +48,105 @@
 	HELPAPI std::string	nameToStr ( eventStr_t name );
 	HELPAPI eventStr_t	strToName (	std::string str );
 
+	// Wire format
+	// Every attach/get type has a fixed width on the wire, little-endian:
+	//   bool, uchar 1   short, ushort 2   int, uint, ulong, float 4   xlong, double 8
+	//   Vec4F 16   str, mem: int length + bytes   header: EVENT_HEADER_SIZE
+	// unsigned long is 32-bit on the wire whatever its size on the host.
+	// Little-endian hosts copy values directly; big-endian hosts swap bytes.
+	#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+		#define EVENT_BIG_ENDIAN
+	#endif
+	#define EVENT_HEADER_SIZE	24
+
+	// Compact header, negotiated per connection (NetworkSystem::netSetCompactHeader):
+	//   uchar flags, uvarint payload length, name 4, [target 4], [time stamp 8]
+	// Target is sent when not 'app ', time stamp when not zero. Upper flag
+	// bits belong to the network layer. At most EVENT_COMPACT_MAX bytes, so it
+	// is written into the header space reserved before the payload.
+	#define EVENT_CH_TARGET		0x01
+	#define EVENT_CH_TIME		0x02
+	#define EVENT_COMPACT_MAX	22
+
+	template<typename T> inline void wirePut ( char* p, T v )
+	{
+		#ifdef EVENT_BIG_ENDIAN
+			const char* b = (const char*) &v;
+			for ( int i = 0; i < (int) sizeof(T); i++ ) p[i] = b[ sizeof(T)-1-i ];
+		#else
+			memcpy ( p, &v, sizeof(T) );
+		#endif
+	}
+	template<typename T> inline T wireGet ( const char* p )
+	{
+		T v;
+		#ifdef EVENT_BIG_ENDIAN
+			char* b = (char*) &v;
+			for ( int i = 0; i < (int) sizeof(T); i++ ) b[i] = p[ sizeof(T)-1-i ];
+		#else
+			memcpy ( &v, p, sizeof(T) );
+		#endif
+		return v;
+	}
+
+	// Typed fields, for Event::attachAll / getAll
+	// EventField<T>::size is the payload size of T, known at compile time.
+	// Arithmetic types and Vec4F are laid out as attachInt, attachFloat, etc.
+	// write them; use fixed-width types, as long differs between hosts.
+	// Structs declared with EVENT_SCHEMA are written member by member.
+	template<typename T, typename Enable = void> struct EventField;
+
+	template<typename... T> struct EventSize;
+	template<> struct EventSize<> { enum { value = 0 }; };
+	template<typename T, typename... R> struct EventSize<T, R...> { enum { value = EventField<T>::size + EventSize<R...>::value }; };
+
+	template<typename T> struct EventField<T, typename std::enable_if<std::is_arithmetic<T>::value>::type> {
+		enum { size = sizeof(T) };
+		static inline char* put ( char* p, const T& v )	{ wirePut<T> ( p, v ); return p + sizeof(T); }
+		static inline char* get ( char* p, T& v )		{ v = wireGet<T> ( p ); return p + sizeof(T); }
+	};
+	template<> struct EventField<Vec4F> {
+		enum { size = 4*sizeof(float) };
+		static inline char* put ( char* p, const Vec4F& v )	{ wirePut ( p, v.x ); wirePut ( p+4, v.y ); wirePut ( p+8, v.z ); wirePut ( p+12, v.w ); return p + size; }
+		static inline char* get ( char* p, Vec4F& v )		{ v.x = wireGet<float> ( p ); v.y = wireGet<float> ( p+4 ); v.z = wireGet<float> ( p+8 ); v.w = wireGet<float> ( p+12 ); return p + size; }
+	};
+
+	struct EventSizeProbe {
+		template<typename... T> std::integral_constant<int, EventSize<T...>::value> operator() ( const T&... ) const { return {}; }
+	};
+	struct EventPutter {
+		char* p;
+		template<typename... T> char* operator() ( const T&... v )	{ int x[] = { 0, ( p = EventField<T>::put ( p, v ), 0 )... }; (void) x; return p; }
+	};
+	struct EventGetter {
+		char* p;
+		template<typename... T> char* operator() ( T&... v )		{ int x[] = { 0, ( p = EventField<T>::get ( p, v ), 0 )... }; (void) x; return p; }
+	};
+
+	// Schema for a user struct. List the members to send, in order, inside the struct:
+	//   struct Particle { Vec4F pos; float mass; int id;  EVENT_SCHEMA ( pos, mass, id ) };
+	#define EVENT_SCHEMA(...)	\
+		template<typename F> auto eventFields ( F f )		{ return f ( __VA_ARGS__ ); }	\
+		template<typename F> auto eventFields ( F f ) const	{ return f ( __VA_ARGS__ ); }
+
+	template<typename T> struct EventField<T, typename std::enable_if<std::is_class<T>::value>::type> {
+		enum { size = decltype ( std::declval<const T&>().eventFields ( EventSizeProbe () ) )::value };
+		static inline char* put ( char* p, const T& v )	{ return v.eventFields ( EventPutter { p } ); }
+		static inline char* get ( char* p, T& v )		{ return v.eventFields ( EventGetter { p } ); }
+	};
+
+	// Array view into an event payload, from Event::getArrayView.
+	// Valid while the event holds its data. count = 0 if absent or malformed.
+	#define EVENT_ARRAY_ALIGN	8			// array data starts on this boundary within the payload
+	#define EVENT_ARRAY_MAX		(1 << 30)	// largest payload attachArray grows an event to, keeps int lengths valid
+
+	template<typename T> struct EventArray {
+		T*			data;
+		int			count;
+		T&			operator[] ( int i )	{ return data[i]; }
+		bool		empty () const			{ return count == 0; }
+	};
+
 	// Event
 	struct HELPAPI CACHE_ALIGNED Event {
 	public:		
@@ -89,7 +191,9 @@
 		void				expand ( int s );
 		char*				serialize ();
 		void				deserialize ( char* buf, int len );		
-		void				rescope ( char* scope )		{ memcpy ( mScope, scope, 4 ); mScope[4]='\0'; }
+		char*				serializeCompact ( int& len, uchar flags = 0 );
+		void				deserializeCompact ( char* buf, int hdr_len, int data_len );
+		void				rescope ( const char* scope )		{ memcpy ( mScope, scope, 4 ); mScope[4]='\0'; }
 		//int				getEventLenOffs ()			{ return int((char*) &mDataLen - (char*) &mTarget); }
 		char*				getData ()					{ return mData; }
 		char*				getPos()					{ return mPos; }
@@ -113,6 +217,7 @@
 		inline void			setSrcSock ( netSock s )	{ mSrcSock = s; }
 		inline netIP		getSrcIP ()					{ return mSrcIP; }
 		inline netSock		getSrcSock ()				{ return mSrcSock; }
+		inline uint32_t		getCallID ()				{ return mCallID; }		// RPC correlation id, 0 = not a call
 
 		// Data Attach/Retrieve
 		void				attachBool		(bool b);
@@ -135,6 +240,88 @@
 		void				attachFromFile  (FILE* fp, int len );
 		bool				attachFile	( std::string fullpath );
 
+		// Typed attach/get. Size is computed at compile time, so attachAll
+		// reserves once and writes every field without further checks.
+		// getAll returns false, reading nothing, if the payload is too short.
+		template<typename... T> static int getSizeAll ()		{ return EventSize<T...>::value; }
+		template<typename... T> void attachAll ( const T&... v )
+		{
+			const int len = EventSize<T...>::value;
+			if ( mDataLen + len > mMax ) expand ( imax ( mMax*2, mDataLen + len ) );
+			EventPutter w = { mPos };
+			mPos = w ( v... );
+			mDataLen += len;
+		}
+		template<typename... T> bool getAll ( T&... v )
+		{
+			if ( mPos + EventSize<T...>::value > mData + mDataLen ) { readError (); return false; }
+			EventGetter r = { mPos };
+			mPos = r ( v... );
+			return true;
+		}
+
+		// Bulk arrays. Wire layout: int count, zero pad to EVENT_ARRAY_ALIGN, count elements.
+		// Payloads are allocated 8-byte aligned (see new_event_data), so the view
+		// points straight into mData with the alignment of T. Raw buffers, such as
+		// DataX buffers or ImageX pixels, go through as attachArray ( (uchar*) buf, bytes ).
+		// Elements are copied as host bytes, which are the wire order on little-endian hosts.
+		// A negative count, or one that would grow the payload past EVENT_ARRAY_MAX, attaches nothing.
+		template<typename T> void attachArray ( const T* src, int count )
+		{
+			static_assert ( std::is_trivially_copyable<T>::value, "attachArray needs trivially copyable elements" );
+			static_assert ( alignof(T) <= EVENT_ARRAY_ALIGN, "attachArray element alignment exceeds EVENT_ARRAY_ALIGN" );
+			int off = int ( mPos - mData ) + (int) sizeof(int);
+			int pad = -off & (EVENT_ARRAY_ALIGN-1);
+			uint64_t total = (uint64_t) mDataLen + sizeof(int) + pad + (uint64_t) count * sizeof(T);
+			if ( count < 0 || total > EVENT_ARRAY_MAX ) {
+				dbgprintf ( "ERROR: attachArray of %d elements exceeds the event max.\n", count );
+				return;
+			}
+			int bytes = count * (int) sizeof(T);
+			int len = (int) sizeof(int) + pad + bytes;
+			if ( mDataLen + len > mMax ) expand ( imax ( imin ( mMax*2, EVENT_ARRAY_MAX ), mDataLen + len ) );
+			wirePut ( mPos, count );
+			memset ( mPos + sizeof(int), 0, pad );
+			if ( bytes > 0 ) memcpy ( mPos + sizeof(int) + pad, src, bytes );
+			mPos += len;
+			mDataLen += len;
+		}
+		template<typename T> EventArray<T> getArrayView ()
+		{
+			EventArray<T> v = { 0, 0 };
+			char* end = mData + mDataLen;
+			if ( mPos + sizeof(int) > end ) { readError (); return v; }
+			int count = wireGet<int> ( mPos );
+			int off = int ( mPos - mData ) + (int) sizeof(int);
+			char* p = mData + off + ( -off & (EVENT_ARRAY_ALIGN-1) );
+			if ( count < 0 || p > end || (size_t) ( end - p ) / sizeof(T) < (size_t) count ) { readError (); return v; }
+			v.data = (T*) p;
+			v.count = count;
+			mPos = p + (size_t) count * sizeof(T);
+			return v;
+		}
+
+		template<typename W> inline void attachWire ( W v )
+		{
+			if ( mDataLen + (int) sizeof(W) > mMax ) expand ( imax ( mMax*2, mDataLen + (int) sizeof(W) ) );
+			wirePut<W> ( mPos, v );
+			mPos += sizeof(W);
+			mDataLen += sizeof(W);
+		}
+		template<typename W> inline W getWire ()
+		{
+			if ( mPos + sizeof(W) > mData + mDataLen ) { readError (); return 0; }
+			W v = wireGet<W> ( mPos );
+			mPos += sizeof(W);
+			return v;
+		}
+
+		// Getters check the read position against the payload end. A read past
+		// the end returns 0 (or empty), sets the read error, and moves the read
+		// position to the end so later reads fail too. startRead clears the error.
+		bool				isReadError ()				{ return bReadErr; }
+		void				readError ()				{ bReadErr = true; mPos = mData + mDataLen; }
+
 		bool				getBool ();
 		int					getInt ();
 		signed short		getShort ();
@@ -153,9 +340,28 @@
 		void				getBufAtPos (int pos, char* buf, int len );		
 		int					getFile ( std::string fullpath );
 
-		// Serialized header length. Must match platform size of member vars
-		static int		staticSerializedHeaderSize()	{ return 2*sizeof(int) + 2*sizeof(eventStr_t) + sizeof(timeStamp_t); }
+		// Compact numeric encodings
+		// - varint: LEB128, 7 bits per byte; signed values are zigzag mapped first (-64..63 take 1 byte)
+		// - delta array: uvarint count, then zigzag varint differences from the previous value (first from 0)
+		// - quantized: value clamped to [vmin,vmax] (NaN to vmin) and scaled to bits (clamped to 1..32), stored
+		//   in 1, 2 or 4 bytes. Needs vmax > vmin; otherwise values encode as 0 and decode as vmin.
+		// Array getters return the count, or 0 with a read error if malformed or more than max.
+		void				attachVarint	( int64_t v );
+		void				attachUVarint	( uint64_t v );
+		void				attachDeltaArray ( const int* v, int count );
+		void				attachQuantized	( float v, float vmin, float vmax, int bits );
+		void				attachQuantizedArray ( const float* v, int count, float vmin, float vmax, int bits );
+		int64_t				getVarint ();
+		uint64_t			getUVarint ();
+		int					getDeltaArray ( int* out, int max );
+		float				getQuantized ( float vmin, float vmax, int bits );
+		int					getQuantizedArray ( float* out, int max, float vmin, float vmax, int bits );
+
+		// Serialized header length. Fixed on the wire; the member layout is checked in event.cpp
+		static int		staticSerializedHeaderSize()	{ return EVENT_HEADER_SIZE; }
 		static int		staticOffsetLenInfo()			{ return 0; }   // <-- assumes mDataLen is first
+		static int		staticOffsetCIDInfo()			{ return sizeof(int) + 2*sizeof(eventStr_t); }	// mCID slot, carries checksum on the wire
+		static int		staticCompactHeader ( const char* buf, int avail, int& data_len );	// header length, 0 = incomplete, -1 = malformed
 
 		// **** NOTE ***
 		// !! ORDER OF MEMBERS IS IMPORTANT HERE !!
@@ -177,10 +383,12 @@
 		ushort				mSrcSock;			// Source Socket			(max: 65535)
 		netIP					mSrcIP;				// Source IP
 		sysID_t				mTargetID;		// Target ID
+		uint32_t			mCallID;			// RPC call id (0 = none)
 		int						mMax;					// Data max
 		EventPool*		mOwner;				// Memory pool owner
 		bool					bOwn;					// Owner info
 		bool					bDestroy;			// Destroy
+		bool					bReadErr;			// Read past end of payload
 		char					mScope[5];		// Scope info
 		char*					mPos;					// Data pos
 	};
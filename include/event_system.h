@@ -27,6 +27,8 @@
 	#include <map>
 	#include <set>
 	#include <queue>
+	#include <atomic>
+	#include <mutex>
 
 	#include "event.h"
 
@@ -77,6 +79,47 @@
 		FILE*						mTraceFile;
 	};
 
+	// Shared immutable event
+	// A reference-counted handle to one event, so a payload can be handed to
+	// several threads or sockets without copying. Counting is atomic. The event
+	// is read-only while shared: each reader takes its own cursor with getReader,
+	// and getWritable copies the payload first if another handle still holds it.
+	// Pooled payloads move to the heap once when shared, as pools are not thread-safe.
+	#define SHARED_EVENT_TRAILER	8		// room kept after the payload for netSend trailers (call id, CRC)
+
+	struct SharedEventBlock {
+		std::atomic<int>	refs;
+		std::mutex			sendLock;		// netSend writes the wire header in front of the payload
+		Event				event;
+	};
+
+	class HELPAPI SharedEvent {
+	public:
+		SharedEvent ()									: mBlock ( 0 ) {}
+		explicit SharedEvent ( Event& e );				// acquires e
+		SharedEvent ( const SharedEvent& src );
+		SharedEvent ( SharedEvent&& src )				: mBlock ( src.mBlock ) { src.mBlock = 0; }
+		SharedEvent& operator= ( const SharedEvent& src );
+		SharedEvent& operator= ( SharedEvent&& src );
+		~SharedEvent ()									{ reset (); }
+
+		void			reset ();
+		bool			isEmpty () const				{ return mBlock == 0; }
+		int				getRefs () const				{ return mBlock ? mBlock->refs.load () : 0; }
+		eventStr_t		getName () const				{ return mBlock->event.mName; }
+		eventStr_t		getTarget () const				{ return mBlock->event.mTarget; }
+		const char*		getData () const				{ return mBlock->event.mData; }
+		int				getDataLength () const			{ return mBlock->event.mDataLen; }
+
+		void			getReader ( Event& e ) const;	// e views the payload with its own cursor. Do not attach to it.
+		Event&			getWritable ();					// sole event, copied first if shared (copy-on-write)
+
+		SharedEventBlock*	getBlock ()					{ return mBlock; }
+
+	private:
+		SharedEventBlock*	mBlock;
+	};
+
 
   #ifdef BUILD_EVENT_POOLING
 	//------------ Event Pooling [optional]
@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------------------
+// Copyright 2007-2022 (c) Quanta Sciences, Rama Hoetzlein, ramakarl.com
+//
+//
+// * Derivative works may append the above copyright notice but should not remove or modify earlier notices.
+//
+// MIT License:
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+// associated documentation files (the "Software"), to deal in the Software without restriction, including without
+// limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+// OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef DEF_NET_METRICS_H
+	#define DEF_NET_METRICS_H
+
+	#ifdef BUILD_METRICS
+
+	#include "common_defs.h"
+	#include "network_system.h"
+	#include "timex.h"
+	#include <atomic>
+	#include <string>
+	#include <thread>
+
+	// Metrics Endpoint
+	// An HTTP server on a background thread (httplib) serving:
+	//   /metrics        Prometheus text
+	//   /metrics.json   JSON
+	//   /health         200 while snapshots are fresh, 503 when stale
+	// The application calls Publish from its event loop. Publish copies the
+	// counters into one of three snapshot slots, each guarded by a sequence
+	// number. Scrapes read the latest slot and retry if it changed during
+	// the copy, so neither side ever waits on the other.
+
+	#define METRICS_MAX_NET		4
+	#define METRICS_MAX_POOL	4
+	#define METRICS_POOL_BINS	16
+	#define METRICS_NAME_LEN	32
+
+	struct MetricsSnapshot {
+		xlong		publishes;						// publish count
+		xlong		time;							// publish time, msec steady clock
+		int			numNet, numPool, numPerf;
+		char		netName[ METRICS_MAX_NET ][ METRICS_NAME_LEN ];
+		NetStats	net[ METRICS_MAX_NET ];
+		char		poolName[ METRICS_MAX_POOL ][ METRICS_NAME_LEN ];
+		int			poolBins[ METRICS_MAX_POOL ];
+		int			poolWidth[ METRICS_MAX_POOL ][ METRICS_POOL_BINS ];
+		int			poolAlloc[ METRICS_MAX_POOL ][ METRICS_POOL_BINS ];
+		int			eventAlloc, eventFree;			// unpooled event data allocations
+		PerfStat	perf[ PERF_STAT_MAX ];
+	};
+
+	class HELPAPI NetMetrics {
+	public:
+		NetMetrics ();
+		~NetMetrics ();
+
+		// Sources. Add before Start.
+		void	addNetwork ( NetworkSystem* net, const char* name );
+		void	addPool ( EventPool* pool, const char* name );
+
+		int		Start ( int port, const char* host = "127.0.0.1" );	// returns bound port (port 0 = any), or 0
+		void	Stop ();
+		bool	isRunning ()						{ return mServer != 0; }
+
+		// Event loop side. Cheap when called more often than the interval.
+		void	Publish ( bool force = false );
+		void	setPublishInterval ( int msec )		{ mPublishMs = msec; }
+		void	setStaleLimit ( int msec )			{ mStaleMs = msec; }
+
+		// Scrape side. Safe from any thread.
+		bool	getSnapshot ( MetricsSnapshot& out );
+		std::string	getPrometheus ();
+		std::string	getJSON ();
+		std::string	getHealth ( int& status );
+
+	private:
+		struct Slot {
+			std::atomic<uint32_t>	seq;			// odd while being written
+			MetricsSnapshot			snap;
+		};
+		Slot				mSlot[ 3 ];
+		std::atomic<int>	mLatest;				// slot of last complete publish, -1 = none
+		std::atomic<xlong>	mPublishTime;
+		xlong				mPublishes;
+		xlong				mLastPublish;
+		int					mPublishMs;
+		int					mStaleMs;
+
+		int					mNumNet, mNumPool;
+		NetworkSystem*		mNet[ METRICS_MAX_NET ];
+		EventPool*			mPool[ METRICS_MAX_POOL ];
+		char				mNetName[ METRICS_MAX_NET ][ METRICS_NAME_LEN ];
+		char				mPoolName[ METRICS_MAX_POOL ][ METRICS_NAME_LEN ];
+
+		void*				mServer;				// httplib::Server
+		std::thread			mThread;
+	};
+
+	#endif
+
+#endif
@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------
+// Copyright 2007-2022 (c) Quanta Sciences, Rama Hoetzlein, ramakarl.com
+//
+//
+// * Derivative works may append the above copyright notice but should not remove or modify earlier notices.
+//
+// MIT License:
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+// associated documentation files (the "Software"), to deal in the Software without restriction, including without
+// limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+// OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef DEF_NET_TRACE_H
+	#define DEF_NET_TRACE_H
+
+	#include "common_defs.h"
+	#include <stdint.h>
+	#include <atomic>
+
+	// Binary Trace
+	// Each thread records into its own fixed-size ring of small records.
+	// Recording is a timestamp and a few stores; no strings are built.
+	// Records are formatted later by NetTrace::Decode, usually offline
+	// from a file written by NetTrace::Save, so tracing may be left on.
+
+	#define NTR_RING_SIZE		16384			// records per thread, power of two
+
+	// Trace codes
+	#define NTR_RECV			1				// bytes received from socket
+	#define NTR_RX_PARTIAL		2				// partial event stored in recv buffer
+	#define NTR_RX_EVENT		3				// complete event deserialized and queued
+	#define NTR_RX_DROP			4				// event dropped, integrity check failed
+	#define NTR_RECV_ERROR		5				// recv error on socket
+	#define NTR_TX_EVENT		6				// event sent in full
+	#define NTR_TX_PARTIAL		7				// event partially sent, remainder queued
+	#define NTR_TX_RESIDUAL		8				// queued bytes sent
+	#define NTR_TX_FAIL			9				// event not sent
+	#define NTR_USER			100				// first code available to applications
+
+	// Decode formats
+	#define NTR_TEXT			0				// one line per record
+	#define NTR_CHROME			1				// Chrome trace event JSON (chrome://tracing, Perfetto)
+
+	struct NetTraceRec {					// 24 bytes
+		uint64_t	time;					// nanoseconds, steady clock
+		uint32_t	name;					// event name (eventStr_t)
+		int32_t		sock;					// socket index
+		int32_t		len;					// length in bytes
+		uint16_t	code;					// NTR_ code
+		uint16_t	tid;					// thread ring number
+	};
+
+	class HELPAPI NetTrace {
+	public:
+		static void		Enable ( bool on )		{ m_enabled.store ( on, std::memory_order_relaxed ); }
+		static bool		isEnabled ()			{ return m_enabled.load ( std::memory_order_relaxed ); }
+		static void		Record ( int code, uint32_t name, int sock, int len );
+		static void		Clear ();								// drop recorded entries; safe while threads record
+		static int		Save ( const char* fname );			// write all rings, returns number of records or -1. skips entries being overwritten
+		static bool		Decode ( const char* fname_in, const char* fname_out, int fmt = NTR_TEXT );
+		static const char* getCodeName ( int code );
+
+	private:
+		static std::atomic<bool>	m_enabled;		// read by every NET_TRACE, from any thread
+	};
+
+	// Record only when enabled. Arguments are not evaluated otherwise.
+	#define NET_TRACE(code, name, sock, len)	{ if ( NetTrace::isEnabled() ) NetTrace::Record ( code, name, sock, len ); }
+
+#endif
@@ -31,11 +31,14 @@
 		#include <fcntl.h>
 		#include <errno.h>
 		#include <sys/ioctl.h>
+		#include <sys/un.h>
+		#include <stddef.h>
 		#define CX_SOCKET		int
 		#define CX_SOCKLEN		socklen_t		
 		#define CX_SOCKOPT		int		
 		#define CX_SOCK_ERROR		-1		
 		#define CX_INVALID_SOCK		-1
+		#define CX_UNIX_SOCK					// unix domain sockets available
 
   #elif __linux__
     #include <sys/socket.h>			// Non-windows Platforms (Linux, Cygwin)
@@ -48,11 +51,14 @@
 		#include <fcntl.h>
 		#include <errno.h>
 		#include <sys/ioctl.h>
+		#include <sys/un.h>
+		#include <stddef.h>
 		#define CX_SOCKET		int
 		#define CX_SOCKLEN		socklen_t		
 		#define CX_SOCKOPT		int		
 		#define CX_SOCK_ERROR		-1		// check: result < SOCK_ERROR
 		#define CX_INVALID_SOCK		-1
+		#define CX_UNIX_SOCK					// unix domain sockets available
   #endif
 
 	#ifdef BUILD_OPENSSL
@@ -70,6 +76,7 @@
 	
 	#define NET_TCP						0 // modes
 	#define NET_UDP						1	
+	#define NET_UNIX					2	// unix domain socket (local IPC, stream)
 	
 	#define NET_SECURITY_UNDEF			0 // security types
 	#define NET_SECURITY_FAIL				1 
@@ -92,6 +99,8 @@
 	
 
 	// Network Address Abstraction
+	// - inet addresses use ip & port
+	// - unix domain addresses use a filesystem path, or '@name' for the linux abstract namespace
 	struct HELPAPI NetAddr {
 	public:
     		NetAddr ( int t, std::string n, netIP i, int p ) { name = n; type = t; setAddress(AF_INET, i, p);}
@@ -101,6 +110,7 @@
 		{
 			ip = i;
 			port = p;
+			family = inet;
 			// addr struct
 			addr.sin_family = inet;
 			addr.sin_port = htons(p);
@@ -114,22 +124,90 @@
 			memset( addr.sin_zero, 0, sizeof(addr.sin_zero ));
 		}
 
+		bool setPath ( std::string p )
+		{
+			path = p;
+			ip = 0;
+			port = 0;
+#ifdef CX_UNIX_SOCK
+			family = AF_UNIX;
+			memset ( &addrLocal, 0, sizeof(addrLocal) );
+			addrLocal.sun_family = AF_UNIX;
+			if ( p.length() >= sizeof(addrLocal.sun_path) ) return false;
+			memcpy ( addrLocal.sun_path, p.c_str(), p.length() );
+			if ( isAbstract() ) addrLocal.sun_path[0] = '\0';		// abstract namespace, leading null
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		bool isLocal ()				{ return family != AF_INET; }
+		bool isAbstract ()			{ return !path.empty() && path[0] == '@'; }
+		sockaddr* getSockAddr ()	{ return (sockaddr*) &addr; }
+		CX_SOCKLEN getSockAddrLen ()
+		{
+#ifdef CX_UNIX_SOCK
+			if ( isLocal() ) {
+				// abstract names are not null terminated, so length must be exact
+				if ( isAbstract() ) return (CX_SOCKLEN) ( offsetof(sockaddr_un, sun_path) + path.length() );
+				return (CX_SOCKLEN) sizeof(addrLocal);
+			}
+#endif
+			return (CX_SOCKLEN) sizeof(addr);
+		}
+
 		std::string		name;
 		char			type;			// type (any, broadcast, search, connect)
 		int			sock;
 		int			port;
 		netIP			ip;
-		sockaddr_in		addr;
+		std::string		path;			// unix domain path (local only)
+		int			family;			// AF_INET or AF_UNIX
+		union {
+			sockaddr_in		addr;
+			#ifdef CX_UNIX_SOCK
+				sockaddr_un		addrLocal;
+			#endif
+		};
+	};
+
+	// Token bucket, in bytes. Refills at rate up to burst. Rate 0 is unlimited.
+	// Tokens may go negative, so an event larger than the burst still passes, then waits.
+	struct HELPAPI NetBucket {
+		NetBucket ()			{ rate = burst = tokens = 0; last = 0; }
+		void	set ( float r, float b, sjtime now )	{ rate = r; burst = b; tokens = b; last = now; }
+		void	refill ( sjtime now ) {
+			if ( rate > 0 ) {
+				tokens += rate * float( now - last ) / 1.0e9f;
+				if ( tokens > burst ) tokens = burst;
+			}
+			last = now;
+		}
+		bool	limited ()		{ return rate > 0 && tokens <= 0; }
+		void	take ( int n )	{ if ( rate > 0 ) tokens -= n; }
+
+		float			rate;					// bytes per second
+		float			burst;					// max tokens
+		float			tokens;
+		sjtime			last;					// last refill, nanoseconds
+	};
+
+	// Descriptors that arrived with one read (unix domain). The kernel ends a read
+	// after the data that carried them, so they belong to the event holding byte to-1.
+	struct NetFdGroup {
+		xlong				from, to;				// stream offsets of the read
+		std::vector<int>	fds;
 	};
 
 	// Network Socket Abstraction
 	struct HELPAPI NetSock {
-		NetSock()	{txBuf=0;txPtr=0;rxBuf=0;rxPtr=0;pktBuf=0;pktPtr=0;}
+		NetSock()	{txBuf=0;txPtr=0;rxBuf=0;rxPtr=0;pktBuf=0;pktPtr=0;txFd=-1;rxStreamPos=0;rxEventPos=0;}
 	
 		std::string 		srvAddr;
 		int 			srvPort;	
 		char			side;			// side (client, server)
-		char			mode;			// mode (TCP, UDP)		
+		char			mode;			// mode (TCP, UDP, UNIX)		
 		char			state;			// stat (off, connected)
 		timeval			timeout;		
 		NetAddr			src;			// source socket (ip, port, name, sockID)		
@@ -157,17 +235,44 @@
 
 		// Incoming packets & event
 		int			eventLen;
+		int			eventHdr;				// header length of current event
 		Event*			event;					// deserialized event	
 		char*			pktBuf;					// current packet
 		char*			pktPtr;					// packet offset
 		int			pktLen;
 		int			pktMax;
 		int			pktCounter;		
+
+		// Integrity check
+		bool			crc;					// CRC32C on outgoing events (negotiated)
+		xlong			crcErrors;				// incoming events failing CRC
+
+		// Compact headers. Each side switches after sending 'cCmp' / 'sCmp'
+		bool			compactTx;
+		bool			compactRx;
+
+		// Rate limiting and fairness
+		NetBucket		rxBucket;				// inbound bytes
+		NetBucket		txBucket;				// outbound bytes
+		int			rxEventsTick;			// events received this tick
+		int			txEventsTick;			// events sent this tick
+		xlong			rxBytes, txBytes;		// totals
+		xlong			rxEvents, txEvents;
+		xlong			rxLimited;				// receives stopped by budget
+		xlong			txLimited;				// sends refused by budget
+
+		// Descriptor passing (unix domain only)
+		int			txFd;					// descriptor to attach to next send, -1 = none
+		std::vector<NetFdGroup>	rxFds;				// descriptors received, not yet matched to an event
+		xlong			rxStreamPos;			// bytes read from the stream
+		xlong			rxEventPos;				// stream offset of the next event to frame
 		
 		#ifdef BUILD_OPENSSL
 			SSL_CTX 	*ctx;			// MP: Need to read up on these before commenting; Same cross-platform ? Tentative: Yes
 			SSL 			*ssl;			// MP:
 			BIO 			*bio;			// MP:
+			int			sslWantTx;		// SSL_ERROR_WANT_READ/WRITE blocking the queued write, 0 = none
+			int			sslWantRx;		// SSL_ERROR_WANT_READ/WRITE blocking the last read, 0 = none
 		#endif	
 	};
 
@@ -22,6 +22,9 @@
 // - C++ class model allows for multiple client/server objects
 // - C++ class model with no inheritence (for simplicity)
 // - Cross-platform and tested on Windows, Linux and Android
+// - Unix domain sockets for local IPC, with descriptor passing (Linux/Android)
+// - Optional CRC32C integrity check on events, negotiated per connection
+// - Pipelined request/response calls (netCall/netReply) with timeouts and latency stats
 // 
 //----------------------------------------------------------------------------------------------------------------------
 // -> HEADER <-
@@ -33,6 +36,7 @@
 #include "common_defs.h"
 #include "network_socket.h"
 #include "event_system.h"
+#include "net_trace.h"
 #include "time.h"
 
 #ifdef __ANDROID__
@@ -42,6 +46,7 @@
 
 #include <cstdio>
 #include <map>
+#include <queue>
 
 #define NET_NOT_CONNECTED		11002
 #define NET_DISCONNECTED		107
@@ -62,6 +67,9 @@
 #define CONN_TCP		1
 
 #define NET_BUFSIZE			1500		// Typical UDP max packet size
+#define NET_SOCK_BATCH		64			// socket buffers preallocated at a time
+#define NET_ACCEPT_BUDGET	512			// max connections accepted per listen socket per tick
+#define NET_MAX_EVENT		(64 << 20)	// largest event accepted from the wire, bytes incl. header
 
 #define PRINT_VERBOSE 0
 #define PRINT_VERBOSE_HS 1
@@ -69,6 +77,18 @@
 #define PRINT_ERROR_HS 3
 #define PRINT_FLOW 4
 
+#define NET_CRC_FLAG		0x40000000	// set in serialized event length when header carries a CRC32C
+#define NET_CALL_FLAG		0x20000000	// set in serialized event length when payload ends with a call id
+#define NET_LEN_FLAGS		(NET_CRC_FLAG | NET_CALL_FLAG)
+#define NET_CH_CRC			0x40		// compact header flag: CRC32C trails the event
+#define NET_CH_CALL			0x20		// compact header flag: payload ends with a call id
+
+#define NET_CALL_REPLY		0x80000000	// call id bit marking a reply
+#define NET_CALL_OK			0			// call status, passed to funcCallHandler
+#define NET_CALL_TIMEOUT	1
+#define NET_CALL_CLOSED		2
+#define NET_CALL_HIST		32			// latency histogram buckets, log2 of usec
+
 // -- NOTES --
 // IP               = 20 bytes
 // UDP = IP + 8     = 28 bytes
@@ -77,8 +97,40 @@
 // TCP + Event      = 72 bytes (over TCP)
 
 typedef int (*funcEventHandler) ( Event& e, void* this_ptr  );
+typedef void (*funcCallHandler) ( Event& reply, int status, void* this_ptr, void* user );
 typedef std::string str;
 
+// Per-method (event name) call statistics
+struct HELPAPI NetCallStats {
+	NetCallStats ()		{ memset ( this, 0, sizeof(NetCallStats) ); }
+	xlong		getPercentileUsec ( float pct );		// upper bound of bucket holding percentile
+
+	xlong		calls, replies, timeouts, closed;
+	xlong		sumUsec, maxUsec;
+	xlong		hist[ NET_CALL_HIST ];				// bucket b: latency in [2^b, 2^(b+1)) usec
+};
+
+// Counters for monitoring, filled by netGetStats.
+// Byte and event totals include sockets already closed.
+#define NET_STATS_CALLS		16
+
+struct HELPAPI NetStats {
+	NetStats ()		{ memset ( this, 0, sizeof(NetStats) ); }
+
+	int			sockets, connected;				// socket slots in use, connected sockets
+	int			queued, callsPending;			// events awaiting netProcessQueue, calls in flight
+	xlong		rxBytes, txBytes, rxEvents, txEvents;
+	xlong		rxLimited, txLimited;			// times a socket was skipped by rate limits
+	xlong		checksumErrors;
+	float		fairness;
+	int			numCalls;						// methods in call[], busiest first
+	struct {
+		eventStr_t	name;
+		xlong		calls, replies, timeouts, closed;
+		xlong		sumUsec, maxUsec, p50Usec, p99Usec;
+	} call[ NET_STATS_CALLS ];
+};
+
 class EventPool;
 
 class HELPAPI NetworkSystem {
@@ -97,6 +149,13 @@ public:
 	
 	// Miscellaneous config API
 	void netSetSelectInterval ( int time_ms ); 
+	void netSetChecksum ( bool enable )	{ m_checksum = enable; }	// offer/accept CRC32C at handshake
+	void netSetCompactHeader ( bool enable )	{ m_compactHdr = enable; }	// offer/accept compact event headers at handshake
+	void netSetAcceptBudget ( int n )	{ m_acceptBudget = (n < 1) ? 1 : n; }
+	void netSetBusyPoll ( bool enable, int cpu = -1, int busy_usec = 50 );	// spin for low latency, optionally pinned to a cpu
+	void netSetRateLimit ( int rx_bytes_sec, int tx_bytes_sec, int burst_bytes = 0 );		// all sockets, 0 = unlimited
+	void netSetRateLimit ( int rx_bytes_sec, int tx_bytes_sec, int burst_bytes, int sock_i );
+	void netSetEventBudget ( int rx_events, int tx_events )	{ m_rxEventBudget = rx_events; m_txEventBudget = tx_events; }	// per socket per tick, 0 = unlimited
 	
 	// Security config API
 	bool netSetReconnectInterval ( int time_ms ); 
@@ -108,9 +167,11 @@ public:
 	bool netSetPathToPrivateKey ( str path );
 	bool netSetPathToCertDir ( str path );
 	bool netSetPathToCertFile ( str path );
+	void netSetKernelTLS ( bool enable )	{ m_kernelTLS = enable; }	// kTLS offload, if OpenSSL & kernel support it
 	
 	// Server API
 	bool netServerStart ( netPort srv_port, int security = NET_SECURITY_UNDEF );
+	bool netServerStart ( str srv_path );			// unix domain socket. '/path' or '@abstract_name'
 	void netServerAcceptClient ( int sock_i );
 	void netServerCheckConnectionHandshakes ( );
 	void netServerProcessIO ( );
@@ -118,7 +179,7 @@ public:
 
 	// Client API
 	void netClientStart ( netPort srv_port, str srv_addr="127.0.0.1" );
-	int netClientConnectToServer ( str srv_name, netPort srv_port, bool block = false, int sock_i = -1 );
+	int netClientConnectToServer ( str srv_name, netPort srv_port, bool block = false, int sock_i = -1 );	// srv_name may be a unix path
 	void netClientCheckConnectionHandshakes ( );
 	void netClientProcessIO ( );
 	void netClientHandshake ( int sock_i );
@@ -139,12 +200,25 @@ public:
 	void netDeserializeEvents ( int sock_i );
 	void netMakeEvent ( Event& e, eventStr_t name, eventStr_t sys );	
 	bool netSend ( Event& e, int sock=-1 );
+	bool netSend ( SharedEvent& e, int sock=-1 );					// shared payload, not copied. Safe while other threads hold it.
 	bool netSendLiteral ( str str_lit, int sock_i );
-	void netQueueEvent ( Event& e ); // Place incoming event on recv queue
+	bool netSendDescriptor ( Event& e, int fd, int sock_i );		// send event with a file descriptor (unix domain only)
+	int netRecvDescriptor ( int sock_i );							// next descriptor passed with the event in the callback, or -1
+	Event* netQueueEvent ( Event& e ); // Place incoming event on recv queue
 	int netEventCallback ( Event& e ); // Processes network events (dispatch)
 	void netSetUserCallback ( funcEventHandler userfunc )	{ m_userEventCallback = userfunc; }
 	bool netIsConnectComplete ( int sock_i );
 	bool netCheckError ( int result, int sock_i );	
+
+	// Call API (request/response)
+	// - netCall sends e and returns its call id (0 on failure); many calls may be in flight per socket
+	// - func is called once, with the reply or on timeout/close, from netProcessQueue
+	// - receiver answers with netReply on the request event; replies a busy socket refuses are queued and sent in order
+	uint32_t netCall ( int sock_i, Event& e, funcCallHandler func, int timeout_ms, void* user = 0 );
+	bool netReply ( Event& request, Event& reply );
+	int netCallsPending ( )				{ return m_callsActive; }
+	NetCallStats* getCallStats ( eventStr_t name );
+	void netPrintCallStats ( );
 	
 	// Accessors
 	TimeX		getSysTime ( )				{ return TimeX::GetSystemNSec ( ); }
@@ -162,6 +236,10 @@ public:
 	int			getServerSock ( int i );	// client's socket on server
 	str 		getIPStr ( netIP ip );		// return IP as a string
 	netIP		getStrToIP ( str name );
+	xlong		getChecksumErrors ( int sock_i = -1 );	// CRC mismatches on socket, or total if -1
+	float		getFairness ( );				// Jain's index of bytes received over connected sockets, 1 = fair
+	void		netPrintRateStats ( );
+	void		netGetStats ( NetStats& st );	// copy counters, call from the thread running netProcessQueue
 
 protected:
 	str netPrintf ( int flag, const char* fmt, ... );
@@ -180,17 +258,25 @@ private: // Functions
 		void netServerAcceptSSL ( int sock_i );
 		void netClientSetupHandshakeSSL ( int sock_i ); 
 		void netClientConnectSSL ( int sock_i );		
+		void netSetupModeSSL ( int sock_i );
+		void netResumeSSL ( int sock_i, fd_set* sockReadSet, fd_set* sockWriteSet );
   #endif
 
 	// Abtract socket functions
-	int netAddSocket ( int side, int mode, int state, bool block, NetAddr src, NetAddr dest );
+	int netAddSocket ( int side, int mode, int state, bool block, NetAddr src, NetAddr dest, CX_SOCKET sock_h = 0 );
+	void netAllocSockBuffers ( int count );
+	void netReleaseSockBuffers ( NetSock& s );
 	int netFindSocket ( int side, int mode, int type );
 	int netFindSocket ( int side, int mode, int state, NetAddr dest );
 	int netFindOrCreateSocket(str srv_name, netPort srv_port, netIP srv_ip, bool block );
+	int netFindOrCreateLocalSocket ( str srv_path, bool block );
+	bool netIsLocalPath ( str name )	{ return !name.empty() && (name[0] == '/' || name[0] == '@'); }
 	int netFindOutgoingSocket ( bool bTcp );
 	int netManageHandshakeError ( int sock_i, std::string reason );
 	int netManageTransmitError ( int sock_i, std::string reason, int force = 0 );
 	int netDeleteSocket ( int sock_i, int force=0 );
+	void netSetBuckets ( int sock_i, int rx_bytes_sec, int tx_bytes_sec, int burst_bytes );
+	void netCountSend ( NetSock& s, int len );
 	netIP netResolveServerIP(str name, netPort port);	
 	void netReportError ( int result );
 	bool netFuncError (int ret );		// check if TCP/IP func return is valid
@@ -204,11 +290,14 @@ private: // Functions
 	int netSocketListen ( int sock_i );
 	int netSocketAccept ( int sock_i, CX_SOCKET& tcp_sock, netIP& cli_ip, netPort& cli_port );	
 	int netSocketRecv ( int sock_i, char* buf, int buflen ); 
+	int netSocketRecvLocal ( int sock_i, char* buf, int buflen ); 
+	int netSocketSend ( int sock_i, char* buf, int len );
 	void netSocketReuse(int sock_i );
 	bool netSocketIsConnected ( int sock_i );
 	bool netSocketIsSelected ( fd_set* sockSet, int sock_i );
 	int netSocketSelect ( fd_set* sockReadSet, fd_set* sockWriteSet );
 	void netSendResidualEvent ( int sock_i );
+	void netQueueResidual ( int sock_i, char* buf, int len );
 
 	// Short helpers, used to simplify the program elsewhere
 	void sleep_ms ( int time_ms );
@@ -228,6 +317,8 @@ private: // Functions
 	void CXSocketApiInit ( );
 	void CXSocketSetBlockMode ( CX_SOCKET sock, bool block = false );
 	void CXSocketMakeNoDelay ( CX_SOCKET sock );
+	void CXSocketBusyPoll ( CX_SOCKET sock, int usec );
+	bool CXThreadPinCPU ( int cpu );
 	unsigned long CXSocketReadBytes ( CX_SOCKET sock );
 	bool CXSocketIsValid ( CX_SOCKET sock);			// check if a socket is valid	
 	bool CXSocketBlockError ( );
@@ -238,6 +329,23 @@ private: // Functions
 	str CXGetIpStr ( netIP ip );
 
 	xlong ComputeChecksum (char* buf, int len);
+	uint32_t ComputeCRC32C ( uint32_t crc, const char* buf, int len );
+	void netStampChecksum ( char* buf, int len );
+	bool netVerifyChecksum ( int sock_i, char* buf, int len );
+	int netEventLength ( NetSock& s, char* buf, int avail );
+	eventStr_t netEventName ( NetSock& s, char* buf );
+	void netReceiveEvent ( int sock_i, char* buf );
+
+	// Pending calls
+	void netUnwrapCall ( Event& e, bool call );
+	void netCompleteCall ( Event& e );
+	void netFinishCall ( int slot, Event& e, int status );
+	void netCheckCallTimeouts ( );
+	void netCancelCalls ( int sock_i );
+	void netSendQueuedReplies ( );
+	void netTakeDescriptors ( NetSock& s, xlong at, xlong end, std::vector<int>& fds );
+	void netCloseDescriptors ( std::vector<int>& fds );
+	void netDropQueuedReplies ( int sock_i );
 	
 private: // State
 	
@@ -250,17 +358,66 @@ private: // State
 	TimeX m_lastClientConnectCheck;
 	TimeX m_lastNetProcess;
 	int m_processInterval;
+	int m_acceptBudget;
+	bool m_busyPoll;
+	bool m_busyPollPinned;
+	int m_busyPollCPU;
+	int m_busyPollUsec;
+	int m_rxRate, m_txRate, m_rateBurst;
+	int m_rxEventBudget, m_txEventBudget;
+	int m_rrStart;
 	std::vector< NetSock > m_socks;
+
+	// Socket slots and buffers
+	struct NetSockBufs {
+		char*			pktBuf;
+		int				pktMax;
+		char*			rxBuf;
+		int				rxMax;
+		char*			txBuf;
+		int				txMax;
+		Event*			event;
+	};
+	std::vector< int > m_sockFree;				// terminated slots, reused with their buffers
+	std::vector< NetSockBufs > m_sockSpare;		// preallocated buffers for new slots
 	
 	// Event related
 	EventPool* m_eventPool; 
 	EventQueue m_eventQueue;
+
+	// Call related
+	struct NetCall {
+		uint32_t		id;				// call id, 0 = free slot. slot = id & 0xFFFF
+		uint16_t		gen;			// slot generation, upper bits of id
+		int				sock;
+		eventStr_t		name;
+		funcCallHandler	func;
+		void*			user;
+		sjtime			start;
+		sjtime			deadline;
+	};
+	typedef std::pair< sjtime, uint32_t >	callDeadline_t;
+	std::vector< NetCall > m_calls;
+	std::vector< int > m_callsFree;
+	std::priority_queue< callDeadline_t, std::vector<callDeadline_t>, std::greater<callDeadline_t> > m_callDeadlines;
+	std::map< eventStr_t, NetCallStats > m_callStats;
+	int m_callsActive;
+	std::map< int, std::deque< Event* > > m_replyQueue;	// replies netSend refused, per socket, sent in order
+
+	// Descriptor passing
+	std::map< Event*, std::vector<int> > m_eventFds;	// descriptors passed with queued events
+	std::vector<int> m_dispatchFds;					// descriptors of the event in the user callback
+	int m_dispatchSock;
 	
 	// Debug and trace related
 	int	m_check;
 	int m_indentCount;
 	bool m_printVerbose;
 	bool m_printFlow;
+	bool m_checksum;
+	bool m_compactHdr;
+	xlong m_checksumErrors;
+	NetStats m_statsClosed;					// counters of terminated sockets
 	FILE* m_trace;
 	TimeX m_refTime;
 	
@@ -272,6 +429,7 @@ private: // State
 	str m_pathPrivateKey;
 	str m_pathCertDir;
 	str m_pathCertFile;
+	bool m_kernelTLS;
 };
 
 extern NetworkSystem* net;
@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------------
+// Copyright 2007-2022 (c) Quanta Sciences, Rama Hoetzlein, ramakarl.com
+//
+//
+// * Derivative works may append the above copyright notice but should not remove or modify earlier notices.
+//
+// MIT License:
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+// associated documentation files (the "Software"), to deal in the Software without restriction, including without
+// limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+// OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+
+#ifndef DEF_SPATIAL_GRID_H
+	#define DEF_SPATIAL_GRID_H
+
+	#include "datax.h"
+	#include <math.h>
+	#include <vector>
+
+	// Spatial Grid
+	// Uniform hash grid over a Vec3F buffer of a DataX, for radius and nearest
+	// neighbor queries. Cells are cubes of cell_size; cell (x,y,z) hashes into
+	// a power-of-two table. Build sorts element indices by cell with the
+	// parallel radix sort, then records each table entry's run as start/count.
+	// These live in buffers of getGrid() so they can be committed to the GPU.
+	// Rebuild re-bins after positions move, merging only the elements that
+	// changed cell when there are few of them. Queries are read-only and may
+	// run from several threads at once.
+
+	#define GRID_START		0		// int, table entries. first slot in GRID_INDEX
+	#define GRID_COUNT		1		// int, table entries. elements in that entry
+	#define GRID_INDEX		2		// int, elements sorted by cell (then element)
+	#define GRID_CELL		3		// uint, table entry of each element
+
+	#define GRID_TABLE_MAX	( 1 << 26 )
+	#define GRID_MERGE_FRAC	8		// Rebuild merges when under 1/8 of elements moved
+
+	class HELPAPI SpatialGrid {
+	public:
+		SpatialGrid ();
+
+		void		Build ( DataX* src, int posbuf, float cell_size, int table=0 );	// table=0: 2x elements, rounded to a power of two
+		int			Rebuild ();										// returns elements that changed cell
+		void		Clear ();
+
+		int			QueryRadius ( Vec3F p, float r, std::vector<int>& out );			// elements within r of p, unordered
+		int			QueryNearest ( Vec3F p, int k, std::vector<int>& out, float maxr=-1 );	// k nearest, closest first. maxr<0 = unbounded
+		template<typename F> void ForEachInRadius ( Vec3F p, float r, F fn );		// fn ( int elem, float dist_sq )
+
+		DataX&		getGrid ()			{ return mGrid; }
+		int			getNumElem ()		{ return mNum; }
+		int			getTableSize ()		{ return (int) mTableMask + 1; }
+		float		getCellSize ()		{ return mCellSize; }
+		uint		getHash ( int x, int y, int z )	{ return ( (uint) x * 73856093u ^ (uint) y * 19349663u ^ (uint) z * 83492791u ) & mTableMask; }
+		int			getCellCoord ( float v )		{ return (int) floorf ( v * mInvCell ); }
+
+	private:
+		void		Prepare ( int num );
+		void		ComputeCells ( uint* cells );					// parallel, also updates bounds
+		void		FillTable ();
+		template<typename F> void VisitCell ( int x, int y, int z, const Vec3F& p, float r2, F& fn );
+
+		DataX*		mSrc;
+		int			mPosBuf;
+		int			mNum;
+		float		mCellSize, mInvCell;
+		uint		mTableMask;
+		Vec3I		mLo, mHi;					// cell bounds of the elements
+		DataX		mGrid;
+		std::vector<uint>	mNewCell;			// Rebuild scratch
+	};
+
+	// Points in a table entry may come from other cells that hash to it, so
+	// each is checked against the cell being visited. This also keeps a point
+	// from being reported twice when two visited cells share an entry.
+	template<typename F> void SpatialGrid::VisitCell ( int x, int y, int z, const Vec3F& p, float r2, F& fn )
+	{
+		uint h = getHash ( x, y, z );
+		int cnt = mGrid.bufI ( GRID_COUNT )[h];
+		if ( cnt == 0 ) return;
+		const int* idx = mGrid.bufI ( GRID_INDEX ) + mGrid.bufI ( GRID_START )[h];
+		const Vec3F* pos = mSrc->bufF3 ( mPosBuf );
+		for (int j = 0; j < cnt; j++) {
+			const Vec3F& q = pos[ idx[j] ];
+			float dx = q.x - p.x, dy = q.y - p.y, dz = q.z - p.z;
+			float d2 = dx*dx + dy*dy + dz*dz;
+			if ( d2 > r2 ) continue;
+			if ( getCellCoord ( q.x ) != x || getCellCoord ( q.y ) != y || getCellCoord ( q.z ) != z ) continue;
+			fn ( idx[j], d2 );
+		}
+	}
+
+	template<typename F> void SpatialGrid::ForEachInRadius ( Vec3F p, float r, F fn )
+	{
+		if ( mNum == 0 || r < 0 ) return;
+		Vec3I c0 ( getCellCoord ( p.x - r ), getCellCoord ( p.y - r ), getCellCoord ( p.z - r ) );
+		Vec3I c1 ( getCellCoord ( p.x + r ), getCellCoord ( p.y + r ), getCellCoord ( p.z + r ) );
+		c0.Set ( imax ( c0.x, mLo.x ), imax ( c0.y, mLo.y ), imax ( c0.z, mLo.z ) );		// only cells holding elements
+		c1.Set ( imin ( c1.x, mHi.x ), imin ( c1.y, mHi.y ), imin ( c1.z, mHi.z ) );
+		float r2 = r*r;
+		for (int z = c0.z; z <= c1.z; z++)
+			for (int y = c0.y; y <= c1.y; y++)
+				for (int x = c0.x; x <= c1.x; x++)
+					VisitCell ( x, y, z, p, r2, fn );
+	}
+
+#endif
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------
+// Copyright 2007-2022 (c) Quanta Sciences, Rama Hoetzlein, ramakarl.com
+//
+//
+// * Derivative works may append the above copyright notice but should not remove or modify earlier notices.
+//
+// MIT License:
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+// associated documentation files (the "Software"), to deal in the Software without restriction, including without
+// limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+// OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef DEF_TASK_POOL_H
+	#define DEF_TASK_POOL_H
+
+	#include "common_defs.h"
+	#include <atomic>
+	#include <condition_variable>
+	#include <functional>
+	#include <mutex>
+	#include <thread>
+	#include <vector>
+
+	// Task Pool
+	// Persistent worker threads for data-parallel loops. Run splits [0,num)
+	// into fixed-size chunks which the workers and the calling thread claim
+	// until none are left, then returns. Chunk c always covers
+	// [c*grain, (c+1)*grain), so with a fixed grain the split, and any
+	// per-chunk partial results, do not depend on the number of threads.
+	// A Run issued from inside a chunk executes inline.
+
+	#define TASK_GRAIN			16384			// default fixed grain, elements
+	#define TASK_PAR_BYTES		( 1 << 20 )		// Memcpy/Memset below this stay on one thread
+
+	class HELPAPI TaskPool {
+	public:
+		typedef std::function< void ( int chunk, uint64_t begin, uint64_t end ) >	RangeFunc;
+
+		TaskPool ();
+		~TaskPool ();
+		static TaskPool&	Get ();										// shared pool, started on first use
+
+		void		Start ( int threads = 0 );							// total including caller. 0 = hardware threads
+		void		Stop ();
+		int			getNumThreads ()		{ return (int) mThreads.size() + 1; }
+
+		uint64_t	getGrain ( uint64_t num );							// grain giving a few chunks per thread
+		static uint64_t	getNumChunks ( uint64_t num, uint64_t grain )	{ return (num + grain-1) / grain; }
+		void		Run ( uint64_t num, uint64_t grain, const RangeFunc& fn );
+
+		static void	Memcpy ( void* dst, const void* src, uint64_t sz );
+		static void	Memset ( void* dst, int v, uint64_t sz );
+
+	private:
+		struct Job {
+			const RangeFunc*		fn;
+			uint64_t				num, grain, chunks;
+			std::atomic<uint64_t>	next;								// next unclaimed chunk
+			int						active;								// workers inside, guarded by mLock
+		};
+		void		Worker ();
+		static void	RunChunks ( Job* job );
+
+		std::vector<std::thread>	mThreads;
+		std::mutex					mLock;
+		std::mutex					mRunLock;							// one Run at a time
+		std::condition_variable		mWake, mDone;
+		Job*						mJob;
+		uint64_t					mGen;
+		bool						bStop;
+	};
+
+#endif
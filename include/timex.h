@@ -39,7 +39,20 @@
 	HELPAPI float PERF_STOP ();
 	HELPAPI void PERF_INIT ( int buildbits, bool cpu, bool gpu, bool cons, int lev, const char* fname );
 	HELPAPI void PERF_SET(bool cpu, int lev, bool gpu, char* fname);
-	HELPAPI void PERF_PRINTF ( char* format, ... );
+	HELPAPI void PERF_PRINTF ( const char* format, ... );
+
+	// Timing aggregates, per PERF_PUSH message
+	#define PERF_STAT_MAX		64
+	#define PERF_STAT_NAME		48
+	struct PerfStat {
+		char		name[ PERF_STAT_NAME ];
+		xlong		count;
+		double		totalMs;
+		float		maxMs;
+	};
+	HELPAPI void PERF_AGGREGATE ( bool on );					// accumulate PUSH/POP timings, with or without printing
+	HELPAPI void PERF_ACCUM ( const char* msg, float msec );
+	HELPAPI int  PERF_GET_STATS ( PerfStat* out, int max );	// copy aggregates, returns count
 
 	HELPAPI float strToDateF(std::string s, int mp = 0, int mc = 2, int dp = 3, int dc = 2, int yp = 6, int yc = 4);
 	HELPAPI void strFromDateF(float f, int& m, int& d, int& y);
@@ -19,6 +19,7 @@
 
 #include "common_defs.h"
 #include "dataptr.h"
+#include "task_pool.h"
 
 #ifdef USE_OPENGL
   #ifdef _WIN32
@@ -29,8 +30,38 @@
 #ifdef USE_CUDA
 	#include "common_cuda.h"
 #endif
+#ifdef _WIN32
+	#include <malloc.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
 
 int DataPtr::mFBO = -1;
+uint64_t DataPtr::mLargeMin = DT_LARGE_MIN;
+bool DataPtr::mHugePages = false;
+
+// Aligned cpu memory. Windows needs the matching free, so every
+// non-mapped DataPtr buffer goes through these two.
+static char* dt_alloc ( uint64_t sz, int align )
+{
+  #ifdef _WIN32
+    return (char*) _aligned_malloc ( sz, align );
+  #else
+    void* p = 0;
+    if ( align <= 16 ) return (char*) malloc ( sz );
+    if ( posix_memalign ( &p, align, sz ) != 0 ) return 0;
+    return (char*) p;
+  #endif
+}
+static void dt_free ( char* p )
+{
+  #ifdef _WIN32
+    _aligned_free ( p );
+  #else
+    free ( p );
+  #endif
+}
 
 int getTypeSize(uchar dtype)
 {
@@ -61,7 +92,7 @@ DataPtr::~DataPtr()
 
 void DataPtr::Clear ()
 {
-  if ( mCpu != 0x0 ) free (mCpu);          // free cpu memory
+  FreeCPU ();                             // free cpu memory
 
   #ifdef USE_OPENGL
     if ( mUseFlags & DT_GLTEX ) {
@@ -94,6 +125,7 @@ void DataPtr::Clear ()
   mCpu = 0;
   mGLID = -1;
   mNum = 0; mMax = 0; mSize = 0;
+  mNumDirty = 0; mCommitNum = 0;
 }
 
 
@@ -117,20 +149,138 @@ void DataPtr::UpdateUsage ( uchar flags )
   Commit ();                  // commit to new usage
 }
 
-void DataPtr::ReallocateCPU ( uint64_t oldsz, uint64_t newsz )
+void DataPtr::SetAlign ( int align, bool pad )
+{
+  if ( align < (int) sizeof(void*) ) align = sizeof(void*);
+  assert ( (align & (align-1)) == 0 );
+  mAlign = align;
+  bPad = pad;
+}
+
+int DataPtr::getPadStep ()
+{
+  if ( !bPad || mStride <= 0 ) return 1;
+  int a = mAlign, b = mStride;           // align / gcd(align, stride)
+  while ( b != 0 ) { int t = a % b; a = b; b = t; }
+  return mAlign / a;
+}
+
+// Returns false when out of memory. The old allocation is kept.
+bool DataPtr::ReallocateCPU ( uint64_t oldsz, uint64_t newsz )
 {
-  if ( oldsz == newsz ) return;
-  char* newdata = (char*) malloc ( newsz );
+  if ( oldsz == newsz ) return true;
+  if ( bPad && mStride > 0 ) {
+    uint64_t block = (uint64_t) getPadStep() * mStride;    // room for getNumPadded
+    newsz = ( newsz + block-1 ) / block * block;
+    if ( oldsz > newsz ) oldsz = newsz;
+  }
+  if ( mMapSize > 0 || ( mLargeMin > 0 && newsz >= mLargeMin ) ) {
+    if ( ReallocateMapped ( oldsz, newsz ) ) return true;   // page aligned, zero filled
+  }
+  char* newdata = dt_alloc ( newsz, mAlign );
+  if ( newdata == 0x0 ) {
+    dbgprintf ( "*** ERROR: DataPtr::ReallocateCPU out of memory (%llu bytes)\n", (unsigned long long) newsz );
+    return false;
+  }
   if ( mCpu != 0x0 ) {
-    memcpy ( newdata, mCpu, oldsz );
-    free ( mCpu );
+    memcpy ( newdata, mCpu, ( oldsz < newsz ) ? oldsz : newsz );
+    FreeCPU ();
   }
+  if ( bPad && newsz > oldsz ) memset ( newdata + oldsz, 0, newsz - oldsz );
   mCpu = newdata;
+  return true;
+}
+
+// Grow a mapped buffer in place. Returns false if mapping is unavailable,
+// and the caller falls back to malloc. Shrinking keeps the mapping.
+bool DataPtr::ReallocateMapped ( uint64_t oldsz, uint64_t newsz )
+{
+  if ( newsz <= mMapSize ) return true;
+
+  #if defined(__linux__)
+    uint64_t page = mHugePages ? DT_HUGE_PAGE : (uint64_t) sysconf ( _SC_PAGESIZE );
+    uint64_t sz = ( newsz + page - 1 ) & ~( page - 1 );
+    char* p;
+    if ( mMapSize > 0 ) {
+      // extends in place when the address range is free, otherwise moves the page tables. data is never copied.
+      p = (char*) mremap ( mCpu, mMapSize, sz, MREMAP_MAYMOVE );
+      if ( p == MAP_FAILED ) return false;
+    } else {
+      // huge pages need 2MB alignment. over-map and trim.
+      uint64_t extra = mHugePages ? DT_HUGE_PAGE : 0;
+      p = (char*) mmap ( 0, sz + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+      if ( p == MAP_FAILED ) return false;
+      if ( extra > 0 ) {
+        uint64_t head = ( DT_HUGE_PAGE - ( (uint64_t) p & ( DT_HUGE_PAGE - 1 ) ) ) & ( DT_HUGE_PAGE - 1 );
+        if ( head > 0 ) munmap ( p, head );
+        if ( extra - head > 0 ) munmap ( p + head + sz, extra - head );
+        p += head;
+      }
+      if ( mCpu != 0x0 ) {
+        memcpy ( p, mCpu, oldsz );            // crossing the threshold, copied once
+        FreeCPU ();
+      }
+    }
+    if ( mHugePages ) madvise ( p, sz, MADV_HUGEPAGE );
+    mCpu = p;
+    mMapSize = sz;
+    return true;
+
+  #elif defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo ( &si );
+    uint64_t page = si.dwPageSize;
+    uint64_t sz = ( newsz + page - 1 ) & ~( page - 1 );
+    if ( mMapSize > 0 && sz <= mMapReserve ) {
+      // commit more of the reserved range, in place
+      if ( VirtualAlloc ( mCpu + mMapSize, sz - mMapSize, MEM_COMMIT, PAGE_READWRITE ) == 0 ) return false;
+      mMapSize = sz;
+      return true;
+    }
+    uint64_t reserve = ( sz * 4 > DT_LARGE_RESERVE ) ? sz * 4 : DT_LARGE_RESERVE;
+    char* p = (char*) VirtualAlloc ( 0, reserve, MEM_RESERVE, PAGE_NOACCESS );
+    if ( p == 0 ) return false;
+    if ( VirtualAlloc ( p, sz, MEM_COMMIT, PAGE_READWRITE ) == 0 ) {
+      VirtualFree ( p, 0, MEM_RELEASE );
+      return false;
+    }
+    if ( mCpu != 0x0 ) {
+      memcpy ( p, mCpu, oldsz );              // threshold crossed, or reservation exhausted
+      FreeCPU ();
+    }
+    mCpu = p;
+    mMapSize = sz;
+    mMapReserve = reserve;
+    return true;
+
+  #else
+    return false;
+  #endif
+}
+
+void DataPtr::FreeCPU ()
+{
+  if ( mCpu == 0x0 ) return;
+  if ( bView ) {
+    // not ours to free
+  } else if ( mMapSize > 0 ) {
+    #if defined(_WIN32)
+      VirtualFree ( mCpu, 0, MEM_RELEASE );
+    #elif defined(__linux__)
+      munmap ( mCpu, mMapSize );
+    #endif
+  } else {
+    dt_free ( mCpu );
+  }
+  mCpu = 0;
+  bView = false;
+  mMapSize = mMapReserve = 0;
 }
 
-void DataPtr::Resize ( int stride, uint64_t cnt, char* dat, uchar dest_flags )
+void DataPtr::Resize ( int stride, uint64_t cnt, char* dat, uchar dest_flags, int align, bool pad )
 {
   Clear();
+  SetAlign ( align, pad );
   Append ( stride, cnt, dat, dest_flags );
 }
 
@@ -158,9 +308,14 @@ int DataPtr::Append ( int stride, uint64_t added_cnt, char* dat, uchar dest_flag
 
   // CPU allocation
   if ( (dest_flags & DT_CPU) && (added_size > 0) ) {
-    ReallocateCPU ( old_size, new_size );
+    if ( !ReallocateCPU ( old_size, new_size ) ) {
+      mMax -= added_cnt;                      // keep the old buffer and its size
+      mSize = old_size;
+      return ( mStride > 0 ) ? int ( mSize / mStride ) : 0;
+    }
     if ( dat != 0x0 && mCpu != 0 ) {
       memcpy ( mCpu + old_size, dat, added_size );
+      MarkDirty ( mMax - added_cnt, added_cnt );
     }
   }
   char* src = (dat!=0) ? dat : mCpu;
@@ -307,11 +462,28 @@ bool DataPtr::Unmap()
 void DataPtr::Commit ()
 {
   if (mCpu == 0) return;      // commit only makes sense if DT_CPU enabled
-  int sz = mNum * mStride;    // only copy in-use elements
+  uint64_t sz = mNum * mStride;    // only copy in-use elements
   if ( sz==0 ) return;  
+
+  // Byte ranges to upload. With tracking, only dirty ranges, unless the count changed
+  uint64_t off[ DT_DIRTY_MAX ], len[ DT_DIRTY_MAX ], first, last;
+  int num = 0;
+  if ( bTrack && mNum == mCommitNum ) {
+    for (int k=0; k < mNumDirty; k++) {
+      if ( !getDirty ( k, first, last ) ) continue;
+      off[num] = first * mStride; len[num] = (last - first) * mStride; num++;
+    }
+    if ( num == 0 ) { ClearDirty(); return; }   // nothing changed
+  } else {
+    off[0] = 0; len[0] = sz; num = 1;
+  }
+  bool whole = ( num == 1 && len[0] == sz );
+  (void) off; (void) whole;               // unused when built without OpenGL and CUDA
+  mCommitNum = mNum;
+  ClearDirty ();
   
   #ifdef USE_OPENGL
-    if ( mUseFlags & DT_GLTEX ) {            // CPU -> OpenGL Texture
+    if ( mUseFlags & DT_GLTEX ) {            // CPU -> OpenGL Texture, always whole
       glBindTexture ( GL_TEXTURE_2D, mGLID );
       switch (mUseType) {
       case DT_UCHAR:  glTexImage2D ( GL_TEXTURE_2D, 0, GL_R8,    mUseRX, mUseRY, 0, GL_RED,  GL_UNSIGNED_BYTE, mCpu );  break;
@@ -327,7 +499,8 @@ void DataPtr::Commit ()
         if (mUseFlags & DT_CUINTEROP) {
           // CUDA-GL Interop
           Map();
-          cuCheck(cuMemcpyHtoD(mGpu, mCpu, sz), "DataPtr::Commit", "cuMemcpyHtoD", "", false);          
+          for (int k=0; k < num; k++)
+            cuCheck(cuMemcpyHtoD(mGpu + off[k], mCpu + off[k], len[k]), "DataPtr::Commit", "cuMemcpyHtoD", "", false);          
           Unmap();
           return;
         }
@@ -336,12 +509,18 @@ void DataPtr::Commit ()
     if ( mUseFlags & DT_GLVBO ) {            // CPU -> OpenGL VBO
       // OpenGL VBO
       glBindBuffer ( GL_ARRAY_BUFFER, mGLID );
-      glBufferData ( GL_ARRAY_BUFFER, sz, mCpu, GL_STATIC_DRAW );
+      if ( whole ) {
+        glBufferData ( GL_ARRAY_BUFFER, sz, mCpu, GL_STATIC_DRAW );
+      } else {
+        for (int k=0; k < num; k++)
+          glBufferSubData ( GL_ARRAY_BUFFER, off[k], len[k], mCpu + off[k] );
+      }
       #ifdef USE_CUDA
         if (mUseFlags & DT_CUINTEROP) {
           // CUDA-GL Interop
           Map();
-          cuCheck(cuMemcpyHtoD(mGpu, mCpu, sz), "DataPtr::Commit", "cuMemcpyHtoD", "", false);
+          for (int k=0; k < num; k++)
+            cuCheck(cuMemcpyHtoD(mGpu + off[k], mCpu + off[k], len[k]), "DataPtr::Commit", "cuMemcpyHtoD", "", false);
           Unmap();
           return;
         }
@@ -350,16 +529,68 @@ void DataPtr::Commit ()
   #endif
   #ifdef USE_CUDA
     if ( mUseFlags & DT_CUMEM ) {          // CPU -> CUDA linear mem
-      cuCheck ( cuMemcpyHtoD ( mGpu, mCpu, sz), "DataPtr::Commit", "cuMemcpyHtoD", "", false );  // CUDA Linear memory
+      for (int k=0; k < num; k++)
+        cuCheck ( cuMemcpyHtoD ( mGpu + off[k], mCpu + off[k], len[k]), "DataPtr::Commit", "cuMemcpyHtoD", "", false );  // CUDA Linear memory
     }
   #endif
 }
 
+void DataPtr::SetTracking ( bool on )
+{
+  bTrack = on;
+  mCommitNum = 0;                         // next commit is whole
+  MarkAllDirty ();
+}
+
+// Insert [first,end) into the sorted set, joining any range it touches
+void DataPtr::AddDirty ( uint64_t first, uint64_t end )
+{
+  int k = 0;
+  while ( k < mNumDirty && mDirty[k][1] < first ) k++;          // ranges wholly before
+  int j = k;
+  while ( j < mNumDirty && mDirty[j][0] <= end ) {             // ranges touched
+    if ( mDirty[j][0] < first ) first = mDirty[j][0];
+    if ( mDirty[j][1] > end ) end = mDirty[j][1];
+    j++;
+  }
+  if ( j - k != 1 ) {                                           // shift the rest to leave one slot at k
+    memmove ( &mDirty[k+1], &mDirty[j], (mNumDirty - j) * sizeof(mDirty[0]) );
+    mNumDirty += 1 - (j - k);
+  }
+  mDirty[k][0] = first;
+  mDirty[k][1] = end;
+
+  if ( mNumDirty == DT_DIRTY_MAX ) {                            // full. merge the closest pair
+    int m = 0;
+    for (k=1; k < mNumDirty-1; k++)
+      if ( mDirty[k+1][0] - mDirty[k][1] < mDirty[m+1][0] - mDirty[m][1] ) m = k;
+    mDirty[m][1] = mDirty[m+1][1];
+    memmove ( &mDirty[m+1], &mDirty[m+2], (mNumDirty - m - 2) * sizeof(mDirty[0]) );
+    mNumDirty--;
+  }
+}
+
+bool DataPtr::getDirty ( int k, uint64_t& first, uint64_t& last )
+{
+  if ( k < 0 || k >= mNumDirty ) return false;
+  first = mDirty[k][0];
+  last = ( mDirty[k][1] < mNum ) ? mDirty[k][1] : mNum;
+  return first < last;
+}
+
+uint64_t DataPtr::getDirtyBytes ()
+{
+  uint64_t sum = 0, first, last;
+  for (int k=0; k < mNumDirty; k++)
+    if ( getDirty ( k, first, last ) ) sum += (last - first) * mStride;
+  return sum;
+}
+
 
 void DataPtr::Retrieve ()
 {
   if ( mCpu == 0 ) {
-    ReallocateCPU ( 0, mSize );        // ensure space exists on cpu
+    if ( !ReallocateCPU ( 0, mSize ) ) return;   // ensure space exists on cpu
   }
 
   #ifdef USE_OPENGL
@@ -422,14 +653,24 @@ void DataPtr::Retrieve ()
 }
 
 
-void DataPtr::CopyTo ( DataPtr* dest, uchar dest_flags )
+void DataPtr::CopyTo ( DataPtr* dest, uchar dest_flags, bool dirty_only )
 {
   if ( mSize != dest->mSize ) {
     dbgprintf ( "ERROR: CopyTo sizes don't match.\n" );
     exit(-11);
   }
   if ( (mUseFlags & DT_CPU) && (dest_flags & DT_CPU) ) {
-    memcpy ( dest->mCpu, mCpu, mSize );
+    if ( bTrack && dirty_only ) {
+      uint64_t first, last;                 // dirty elements only
+      for (int k=0; k < mNumDirty; k++) {
+        if ( !getDirty ( k, first, last ) ) continue;
+        TaskPool::Memcpy ( dest->mCpu + first*mStride, mCpu + first*mStride, (last-first)*mStride );
+        dest->MarkDirty ( first, last-first );
+      }
+    } else {
+      TaskPool::Memcpy ( dest->mCpu, mCpu, mSize );
+      dest->MarkAllDirty ();
+    }
   }
 
   if (dest_flags & DT_CUMEM) {
@@ -463,7 +704,8 @@ void DataPtr::CopyTo ( DataPtr* dest, uchar dest_flags )
 void DataPtr::FillBuffer ( uchar v )
 {
   if ( mUseFlags & DT_CPU ) {
-    memset ( mCpu, v, mSize );
+    TaskPool::Memset ( mCpu, v, mSize );
+    MarkAllDirty ();
   }
 
   #ifdef USE_OPENGL
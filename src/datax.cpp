@@ -18,24 +18,43 @@
 //
 #include "datax.h"
 #include "common_cuda.h"
-
+#include "task_pool.h"
+#include "event.h"					// wirePut, wireGet
+
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
 #include <stack>
+#include <algorithm>
+#include <functional>
 #include <assert.h>
 
 
 DataX::DataX () 
 {
 	mHeap = 0x0;
+	bHeapView = false;
 	mHeapNum = 0;
 	mHeapMax = 0;
 	mHeapFree = 0;
+	for (int c=0; c < HEAP_CLASSES; c++) mHeapList[c] = -1;
+	bDeterministic = false;
+	bHandles = false;
+	mStrCount = 0;
 	for (int n=0; n < REF_MAX; n++ ) mRef[n]=BUNDEF;
+	mFileMap = 0x0;
+	mFileMapSize = 0;
+	mFileHandle = 0x0;
 }
 	
 
 DataX::~DataX() 
 {
 	DeleteAllBuffers ();
+	CloseMapped ( false );
 }
 
 //--------------- Buffers
@@ -47,14 +66,17 @@ void DataX::DeleteAllBuffers ()
 	mBuf.clear ();
 	
 	for (int n = 0; n < REF_MAX; n++) mRef[n] = BUNDEF;		// clear all refs
+
+	SyncHandles ( 0 );
+	ClearStrings ();
 }
 
 void DataX::ClearHeap ()
 {
-	if ( mHeap != 0x0 ) free ( mHeap );
+	HeapRelease ();
 	mHeap = 0x0;
-	mHeapNum = 0;
 	mHeapMax = 0;	
+	ResetHeap ();
 }
 
 void DataX::FillBuffer ( int i, uchar v ) 
@@ -64,12 +86,12 @@ void DataX::FillBuffer ( int i, uchar v )
 }
 
 // AddBuffer 
-int DataX::AddBuffer ( int userid, std::string name, ushort stride, uint64_t maxcnt, uchar dest_flags )
+int DataX::AddBuffer ( int userid, std::string name, ushort stride, uint64_t maxcnt, uchar dest_flags, int align, bool pad )
 {
 	DataPtr buf;
 	buf.mRefID = userid;
 	buf.SetUsage ( DT_MISC, dest_flags, maxcnt,1,1 );
-	buf.Resize ( stride, maxcnt, 0x0, dest_flags );
+	buf.Resize ( stride, maxcnt, 0x0, dest_flags, align, pad );
 
 	// add to buffer list
 	int b = (int) mBuf.size();		
@@ -115,7 +137,7 @@ void DataX::ClearBuffer(int i)
 	
 	mBuf[b].Clear();								// clear buffer (free)
 	mBuf[b].SetUsage (usetype, useflags, rx,ry,rz );	// reset usage
-	mBuf[b].Resize(stride, 1, 0x0, useflags);		// resize
+	mBuf[b].Resize(stride, 1, 0x0, useflags, mBuf[b].mAlign, mBuf[b].bPad );		// resize
 }
 
 void DataX::SetBufferUsage	( int i, uchar dt, uchar use_flags, int rx, int ry, int rz  )
@@ -128,6 +150,7 @@ void DataX::SetNum ( int num )
 {
 	for (int b=0; b < mBuf.size(); b++) 
 		mBuf[b].mNum = num;		
+	SyncHandles ( num );
 }
 
 #ifdef USE_CUDA
@@ -176,7 +199,7 @@ void DataX::MatchAllBuffers ( DataX* src, uchar use_flags )
 	
 	for (int i=0; i < src->mBuf.size(); i++) {		
 		userid = src->mBuf[i].mRefID;
-		AddBuffer ( userid, "", src->mBuf[i].mStride, src->mBuf[i].mMax, (use_flags!=DT_MISC) ? use_flags : src->mBuf[i].mUseFlags );
+		AddBuffer ( userid, "", src->mBuf[i].mStride, src->mBuf[i].mMax, (use_flags!=DT_MISC) ? use_flags : src->mBuf[i].mUseFlags, src->mBuf[i].mAlign, src->mBuf[i].bPad );
 		SetBufferUsage ( userid, src->mBuf[i].mUseType );
 	}
 }
@@ -191,6 +214,778 @@ void DataX::CopyAllBuffers ( DataX* dest, uchar dest_flags )
 		}
 		CopyBuffer ( b, b, dest, dest_flags );
 	}
+	// string buffers refer to the arena
+	dest->ClearStrings ();
+	if ( mStrArena.mNum > 0 && dest->StrReserve ( mStrArena.mNum ) ) {
+		memcpy ( dest->mStrArena.mCpu, mStrArena.mCpu, mStrArena.mNum );
+		dest->mStrArena.mNum = mStrArena.mNum;
+		dest->mStrTable = mStrTable;
+		dest->mStrCount = mStrCount;
+	}
+}
+
+//--------------- Parallel operations
+
+void DataX::ForEachRange ( int i, const std::function<void ( uint64_t begin, uint64_t end )>& fn, int first, int last )
+{
+	int b = mRef[i];  if (b==BUNDEF) return;
+	if ( last < 0 ) last = (int) mBuf[b].mNum - 1;
+	if ( last < first ) return;
+	uint64_t num = (uint64_t) (last - first + 1);
+	TaskPool& pool = TaskPool::Get ();
+	pool.Run ( num, bDeterministic ? TASK_GRAIN : pool.getGrain ( num ), [&] ( int /*c*/, uint64_t begin, uint64_t end ) {
+		fn ( first + begin, first + end );
+	} );
+}
+
+void DataX::ReduceF ( int i, float& vmin, float& vmax, double& sum, int first, int last )
+{
+	vmin = 0; vmax = 0; sum = 0;
+	int b = mRef[i];  if (b==BUNDEF) return;
+	if ( last < 0 ) last = (int) mBuf[b].mNum - 1;
+	if ( last < first ) return;
+	uint64_t num = (uint64_t) (last - first + 1);
+	TaskPool& pool = TaskPool::Get ();
+	uint64_t grain = bDeterministic ? TASK_GRAIN : pool.getGrain ( num );
+
+	struct Part { float mn, mx; double sum; };
+	std::vector<Part> part ( TaskPool::getNumChunks ( num, grain ) );
+	float* dat = bufF ( i ) + first;
+	pool.Run ( num, grain, [&] ( int c, uint64_t begin, uint64_t end ) {
+		Part p;
+		p.mn = p.mx = dat[begin];
+		p.sum = 0;
+		for (uint64_t n = begin; n < end; n++) {
+			float v = dat[n];
+			if ( v < p.mn ) p.mn = v;
+			if ( v > p.mx ) p.mx = v;
+			p.sum += v;
+		}
+		part[c] = p;
+	} );
+	vmin = part[0].mn; vmax = part[0].mx;
+	for (size_t c = 0; c < part.size(); c++) {			// in chunk order
+		if ( part[c].mn < vmin ) vmin = part[c].mn;
+		if ( part[c].mx > vmax ) vmax = part[c].mx;
+		sum += part[c].sum;
+	}
+}
+
+void DataX::ReduceF3 ( int i, Vec3F& vmin, Vec3F& vmax, Vec3F& sum, int first, int last )
+{
+	vmin.Set(0,0,0); vmax.Set(0,0,0); sum.Set(0,0,0);
+	int b = mRef[i];  if (b==BUNDEF) return;
+	if ( last < 0 ) last = (int) mBuf[b].mNum - 1;
+	if ( last < first ) return;
+	uint64_t num = (uint64_t) (last - first + 1);
+	TaskPool& pool = TaskPool::Get ();
+	uint64_t grain = bDeterministic ? TASK_GRAIN : pool.getGrain ( num );
+
+	struct Part { Vec3F mn, mx; double sx, sy, sz; };
+	std::vector<Part> part ( TaskPool::getNumChunks ( num, grain ) );
+	Vec3F* dat = bufF3 ( i ) + first;
+	pool.Run ( num, grain, [&] ( int c, uint64_t begin, uint64_t end ) {
+		Part p;
+		p.mn = p.mx = dat[begin];
+		p.sx = p.sy = p.sz = 0;
+		for (uint64_t n = begin; n < end; n++) {
+			Vec3F& v = dat[n];
+			if ( v.x < p.mn.x ) p.mn.x = v.x;
+			if ( v.y < p.mn.y ) p.mn.y = v.y;
+			if ( v.z < p.mn.z ) p.mn.z = v.z;
+			if ( v.x > p.mx.x ) p.mx.x = v.x;
+			if ( v.y > p.mx.y ) p.mx.y = v.y;
+			if ( v.z > p.mx.z ) p.mx.z = v.z;
+			p.sx += v.x; p.sy += v.y; p.sz += v.z;
+		}
+		part[c] = p;
+	} );
+	double sx = 0, sy = 0, sz = 0;
+	vmin = part[0].mn; vmax = part[0].mx;
+	for (size_t c = 0; c < part.size(); c++) {			// in chunk order
+		Part& p = part[c];
+		if ( p.mn.x < vmin.x ) vmin.x = p.mn.x;
+		if ( p.mn.y < vmin.y ) vmin.y = p.mn.y;
+		if ( p.mn.z < vmin.z ) vmin.z = p.mn.z;
+		if ( p.mx.x > vmax.x ) vmax.x = p.mx.x;
+		if ( p.mx.y > vmax.y ) vmax.y = p.mx.y;
+		if ( p.mx.z > vmax.z ) vmax.z = p.mx.z;
+		sx += p.sx; sy += p.sy; sz += p.sz;
+	}
+	sum.Set ( (float) sx, (float) sy, (float) sz );
+}
+
+//--------------- Sorting
+
+#define DX_SORT_GRAIN		65536			// smallest chunk for sort passes
+
+template<typename K> static void dx_radix_sort ( const K* keys, uint64_t num, std::vector<uint32_t>& perm )
+{
+	if ( num > UINT32_MAX ) {
+		dbgprintf ( "ERROR: RadixSort. %llu keys, a permutation holds at most %u.\n", (unsigned long long) num, UINT32_MAX );
+		perm.clear ();
+		return;
+	}
+	perm.resize ( num );
+	if ( num == 0 ) return;
+	TaskPool& pool = TaskPool::Get ();
+	uint64_t grain = pool.getGrain ( num );
+	if ( grain < DX_SORT_GRAIN ) grain = DX_SORT_GRAIN;
+	uint64_t chunks = TaskPool::getNumChunks ( num, grain );
+
+	// Double buffered keys and indices. Each pass is stable, so the result does not depend on chunking
+	std::vector<K> kbuf ( keys, keys + num ), kbuf2 ( num );
+	std::vector<uint32_t> pbuf2 ( num );
+	std::vector<uint64_t> hist ( chunks * 256 );
+	K* ks = kbuf.data();		K* kd = kbuf2.data();
+	uint32_t* ps = perm.data();	uint32_t* pd = pbuf2.data();
+	for (uint64_t n = 0; n < num; n++) ps[n] = (uint32_t) n;
+
+	for (int shift = 0; shift < (int) sizeof(K)*8; shift += 8) {
+		pool.Run ( num, grain, [&] ( int c, uint64_t begin, uint64_t end ) {		// digit counts per chunk
+			uint64_t* h = &hist[ (uint64_t) c * 256 ];
+			memset ( h, 0, 256 * sizeof(uint64_t) );
+			for (uint64_t n = begin; n < end; n++) h[ (ks[n] >> shift) & 255 ]++;
+		} );
+		uint64_t total[256] = { 0 };
+		for (uint64_t c = 0; c < chunks; c++)
+			for (int d = 0; d < 256; d++) total[d] += hist[c*256 + d];
+		bool skip = false;
+		for (int d = 0; d < 256; d++) if ( total[d] == num ) skip = true;
+		if ( skip ) continue;											// all keys share this digit
+
+		uint64_t pos = 0;												// start of each (digit, chunk)
+		for (int d = 0; d < 256; d++)
+			for (uint64_t c = 0; c < chunks; c++) {
+				uint64_t cnt = hist[c*256 + d];
+				hist[c*256 + d] = pos;
+				pos += cnt;
+			}
+		pool.Run ( num, grain, [&] ( int c, uint64_t begin, uint64_t end ) {		// scatter
+			uint64_t* h = &hist[ (uint64_t) c * 256 ];
+			for (uint64_t n = begin; n < end; n++) {
+				uint64_t o = h[ (ks[n] >> shift) & 255 ]++;
+				kd[o] = ks[n];
+				pd[o] = ps[n];
+			}
+		} );
+		std::swap ( ks, kd );
+		std::swap ( ps, pd );
+	}
+	if ( ps != perm.data() ) memcpy ( perm.data(), ps, num * sizeof(uint32_t) );
+}
+
+void DataX::RadixSort ( const uint32_t* keys, uint64_t num, std::vector<uint32_t>& perm )	{ dx_radix_sort ( keys, num, perm ); }
+void DataX::RadixSort ( const uint64_t* keys, uint64_t num, std::vector<uint32_t>& perm )	{ dx_radix_sort ( keys, num, perm ); }
+
+template<typename T> static void dx_gather ( char* dst, const char* src, const uint32_t* perm, uint64_t begin, uint64_t end )
+{
+	for (uint64_t n = begin; n < end; n++) ((T*) dst)[n] = ((const T*) src)[ perm[n] ];
+}
+struct dx_elem12 { uint32_t v[3]; };
+struct dx_elem16 { uint64_t v[2]; };
+
+void DataX::ApplyPermutation ( const std::vector<uint32_t>& perm )
+{
+	if ( mBuf.size() == 0 ) return;
+	uint64_t num = mBuf[0].mNum;
+	if ( num > UINT32_MAX ) {
+		dbgprintf ( "ERROR: ApplyPermutation. Buffers have %llu elements, a permutation holds at most %u.\n", (unsigned long long) num, UINT32_MAX );
+		return;
+	}
+	if ( perm.size() != num ) {
+		dbgprintf ( "ERROR: ApplyPermutation. Permutation has %llu entries, buffers have %llu.\n", (unsigned long long) perm.size(), (unsigned long long) num );
+		return;
+	}
+	TaskPool& pool = TaskPool::Get ();
+	const uint32_t* p = perm.data();
+	std::vector<char> tmp;
+
+	for (size_t b = 0; b < mBuf.size(); b++) {
+		DataPtr& buf = mBuf[b];
+		if ( buf.mNum != num || buf.mCpu == 0x0 ) continue;			// not per-element data
+		int stride = buf.mStride;
+		tmp.resize ( num * stride );
+		char* dst = tmp.data();
+		const char* src = buf.mCpu;
+		pool.Run ( num, pool.getGrain ( num ), [&] ( int /*c*/, uint64_t begin, uint64_t end ) {
+			switch ( stride ) {
+			case 4:		dx_gather<uint32_t> ( dst, src, p, begin, end );	break;
+			case 8:		dx_gather<uint64_t> ( dst, src, p, begin, end );	break;
+			case 12:	dx_gather<dx_elem12> ( dst, src, p, begin, end );	break;
+			case 16:	dx_gather<dx_elem16> ( dst, src, p, begin, end );	break;
+			default:
+				for (uint64_t n = begin; n < end; n++) memcpy ( dst + n*stride, src + (uint64_t) p[n]*stride, stride );
+			}
+		} );
+		TaskPool::Memcpy ( buf.mCpu, dst, num * stride );
+		buf.MarkDirty ( 0, num );
+	}
+
+	if ( bHandles && mElemHandle.size() == num ) {					// handles follow their elements
+		std::vector<int> eh ( num );
+		for (uint64_t n = 0; n < num; n++) {
+			eh[n] = mElemHandle[ p[n] ];
+			mHandleElem[ eh[n] ] = (int) n;
+		}
+		mElemHandle.swap ( eh );
+	}
+}
+
+void DataX::SortByKeys ( const std::vector<uint32_t>& keys )
+{
+	std::vector<uint32_t> perm;
+	RadixSort ( keys.data(), keys.size(), perm );
+	ApplyPermutation ( perm );
+}
+
+void DataX::SortByKeys ( const std::vector<uint64_t>& keys )
+{
+	std::vector<uint32_t> perm;
+	RadixSort ( keys.data(), keys.size(), perm );
+	ApplyPermutation ( perm );
+}
+
+// Spread the low bits of v so there are two zero bits between each
+static inline uint32_t dx_spread10 ( uint32_t v )
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8))  & 0x0300F00F;
+	v = (v | (v << 4))  & 0x030C30C3;
+	v = (v | (v << 2))  & 0x09249249;
+	return v;
+}
+static inline uint64_t dx_spread21 ( uint64_t v )
+{
+	v &= 0x1fffff;
+	v = (v | (v << 32)) & 0x1f00000000ffffULL;
+	v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+	v = (v | (v << 8))  & 0x100f00f00f00f00fULL;
+	v = (v | (v << 4))  & 0x10c30c30c30c30c3ULL;
+	v = (v | (v << 2))  & 0x1249249249249249ULL;
+	return v;
+}
+static inline uint32_t dx_morton ( uint32_t x, uint32_t y, uint32_t z, uint32_t* )	{ return dx_spread10 ( x ) | ( dx_spread10 ( y ) << 1 ) | ( dx_spread10 ( z ) << 2 ); }
+static inline uint64_t dx_morton ( uint32_t x, uint32_t y, uint32_t z, uint64_t* )	{ return dx_spread21 ( x ) | ( dx_spread21 ( y ) << 1 ) | ( dx_spread21 ( z ) << 2 ); }
+
+template<typename K> static void dx_compute_morton ( DataX* dx, int posbuf, std::vector<K>& keys, int bits )
+{
+	int num = dx->GetNumElem ( posbuf );
+	keys.resize ( num );
+	if ( num == 0 ) return;
+	Vec3F bmin, bmax, sum;
+	dx->ReduceF3 ( posbuf, bmin, bmax, sum );
+	float cells = (float) ( (1 << bits) - 1 );
+	Vec3F scale;
+	scale.x = ( bmax.x > bmin.x ) ? cells / ( bmax.x - bmin.x ) : 0;
+	scale.y = ( bmax.y > bmin.y ) ? cells / ( bmax.y - bmin.y ) : 0;
+	scale.z = ( bmax.z > bmin.z ) ? cells / ( bmax.z - bmin.z ) : 0;
+	Vec3F* pos = dx->bufF3 ( posbuf );
+	K* k = keys.data();
+	dx->ForEachRange ( posbuf, [=] ( uint64_t begin, uint64_t end ) {
+		for (uint64_t n = begin; n < end; n++) {
+			uint32_t x = (uint32_t) ( ( pos[n].x - bmin.x ) * scale.x );
+			uint32_t y = (uint32_t) ( ( pos[n].y - bmin.y ) * scale.y );
+			uint32_t z = (uint32_t) ( ( pos[n].z - bmin.z ) * scale.z );
+			k[n] = dx_morton ( x, y, z, (K*) 0 );
+		}
+	} );
+}
+
+void DataX::ComputeMorton ( int posbuf, std::vector<uint32_t>& keys )	{ dx_compute_morton ( this, posbuf, keys, 10 ); }
+void DataX::ComputeMorton ( int posbuf, std::vector<uint64_t>& keys )	{ dx_compute_morton ( this, posbuf, keys, 21 ); }
+
+void DataX::SortByMorton ( int posbuf, bool wide )
+{
+	if ( wide ) {
+		std::vector<uint64_t> keys;
+		ComputeMorton ( posbuf, keys );
+		SortByKeys ( keys );
+	} else {
+		std::vector<uint32_t> keys;
+		ComputeMorton ( posbuf, keys );
+		SortByKeys ( keys );
+	}
+}
+
+//--------------- Dirty ranges
+//
+// Delta layout, little-endian fields as in the event wire format (wirePut/wireGet):
+//   uint32 records
+//   per record: uchar ref, uint32 stride, uint64 num, uint32 ranges,
+//               then per range: uint64 first, uint64 cnt, cnt*stride bytes
+// Element bytes are copied as stored, so both sides need the same element layout.
+
+static void dx_put ( std::vector<char>& out, const void* dat, uint64_t len )
+{
+	out.insert ( out.end(), (const char*) dat, (const char*) dat + len );
+}
+template<typename T> static void dx_put ( std::vector<char>& out, T v )
+{
+	size_t at = out.size();
+	out.resize ( at + sizeof(T) );
+	wirePut<T> ( &out[at], v );
+}
+
+template<typename T> static bool dx_get ( const char*& pos, const char* end, T& v )
+{
+	if ( end - pos < (int64_t) sizeof(T) ) return false;
+	v = wireGet<T> ( pos );
+	pos += sizeof(T);
+	return true;
+}
+
+uint64_t DataX::EncodeDirty ( std::vector<char>& out, bool clear )
+{
+	uint64_t start = out.size();
+	uint32_t records = 0;
+	dx_put ( out, records );								// patched below
+	for (size_t b=0; b < mBuf.size(); b++) {
+		DataPtr& buf = mBuf[b];
+		if ( !buf.bTrack ) continue;
+		uint64_t first, last;
+		uint32_t ranges = 0;
+		for (int k=0; k < buf.mNumDirty; k++)
+			if ( buf.getDirty ( k, first, last ) ) ranges++;
+		dx_put ( out, (uchar) buf.mRefID );
+		dx_put ( out, (uint32_t) buf.mStride );
+		dx_put ( out, (uint64_t) buf.mNum );				// count always sent, for deletes
+		dx_put ( out, ranges );
+		for (int k=0; k < buf.mNumDirty; k++) {
+			if ( !buf.getDirty ( k, first, last ) ) continue;
+			dx_put ( out, first );
+			dx_put ( out, last - first );
+			dx_put ( out, buf.mCpu + first * buf.mStride, (last - first) * buf.mStride );
+		}
+		if ( clear ) buf.ClearDirty ();
+		records++;
+	}
+	wirePut<uint32_t> ( &out[start], records );
+	return out.size() - start;
+}
+
+bool DataX::ApplyDirty ( const char* dat, uint64_t len )
+{
+	const char* pos = dat;
+	const char* end = dat + len;
+	uint32_t records;
+	if ( !dx_get ( pos, end, records ) ) return false;
+
+	for (uint32_t r=0; r < records; r++) {
+		uchar ref;
+		uint32_t stride, ranges;
+		uint64_t num, first, cnt;
+		if ( !dx_get ( pos, end, ref ) || !dx_get ( pos, end, stride ) || !dx_get ( pos, end, num ) || !dx_get ( pos, end, ranges ) ) return false;
+		int b = (ref < REF_MAX) ? mRef[ref] : BUNDEF;
+		if ( b == BUNDEF || (uint32_t) mBuf[b].mStride != stride || num > ELEM_MAX ) {
+			dbgprintf ( "ERROR: ApplyDirty buffer %d does not match.\n", (int) ref );
+			return false;
+		}
+		if ( num > mBuf[b].mMax ) ResizeBuffer ( ref, (int) num, true );
+		mBuf[b].mNum = num;
+		for (uint32_t k=0; k < ranges; k++) {
+			if ( !dx_get ( pos, end, first ) || !dx_get ( pos, end, cnt ) ) return false;
+			if ( first > num || cnt > num - first || (uint64_t) (end - pos) < cnt * stride ) return false;
+			memcpy ( mBuf[b].mCpu + first * stride, pos, cnt * stride );
+			mBuf[b].MarkDirty ( first, cnt );
+			pos += cnt * stride;
+		}
+	}
+	return true;
+}
+
+//--------------- String arena
+
+#define DX_STR_MAX			0xFFFFFFFFULL	// arena bytes addressable by strref
+#define DX_STR_TABLE_MIN	64
+
+static inline uint dx_strhash ( const char* str, uint len )
+{
+	uint h = 2166136261u;											// FNV-1a
+	for (uint i = 0; i < len; i++) { h ^= (uchar) str[i]; h *= 16777619u; }
+	return h;
+}
+
+int DataX::AddStrBuffer ( int ref, std::string name, uint64_t maxcnt )
+{
+	int b = AddBuffer ( ref, name, sizeof(strref), maxcnt );
+	SetBufferUsage ( ref, DT_STRREF );
+	return b;
+}
+
+void DataX::ClearStrings ()
+{
+	mStrArena.Clear ();
+	mStrTable.clear ();
+	mStrCount = 0;
+}
+
+bool DataX::StrReserve ( uint64_t bytes )
+{
+	DataPtr& a = mStrArena;
+	if ( bytes <= a.mMax ) return true;
+	if ( bytes > DX_STR_MAX ) {
+		dbgprintf ( "ERROR: String arena full (%llu bytes).\n", (unsigned long long) a.mNum );
+		return false;
+	}
+	uint64_t max = ( a.mMax < 4096 ) ? 4096 : a.mMax;
+	while ( max < bytes ) max *= 2;
+	if ( max > DX_STR_MAX ) max = DX_STR_MAX;
+	a.mStride = 1;
+	if ( !a.ReallocateCPU ( a.mNum, max ) ) return false;
+	a.mMax = max;
+	a.mSize = max;
+	return true;
+}
+
+int DataX::StrSlot ( const char* str, uint len )
+{
+	uint mask = (uint) mStrTable.size() - 1;
+	uint s = dx_strhash ( str, len ) & mask;
+	const char* arena = mStrArena.mCpu;
+	while ( mStrTable[s].len != 0 ) {
+		if ( mStrTable[s].len == len && memcmp ( arena + mStrTable[s].off, str, len ) == 0 ) return (int) s;
+		s = (s + 1) & mask;
+	}
+	return (int) s;
+}
+
+void DataX::StrRehash ( uint size )
+{
+	std::vector<strref> old;
+	old.swap ( mStrTable );
+	mStrTable.assign ( size, strref() );
+	for (strref& r : old) {
+		if ( r.len != 0 ) mStrTable[ StrSlot ( mStrArena.mCpu + r.off, r.len ) ] = r;
+	}
+}
+
+bool DataX::FindStr ( const char* str, uint len, strref& ref )
+{
+	ref.off = 0; ref.len = 0;
+	if ( len == 0 ) return true;
+	if ( mStrTable.size() == 0 ) return false;
+	ref = mStrTable[ StrSlot ( str, len ) ];
+	return ref.len != 0;
+}
+
+strref DataX::AddStr ( const char* str, uint len )
+{
+	strref r = { 0, 0 };
+	if ( len == 0 ) return r;
+	if ( ( mStrCount + 1 ) * 2 > mStrTable.size() )					// keep the table at most half full
+		StrRehash ( mStrTable.size() < DX_STR_TABLE_MIN ? DX_STR_TABLE_MIN : (uint) mStrTable.size() * 2 );
+	int s = StrSlot ( str, len );
+	if ( mStrTable[s].len != 0 ) return mStrTable[s];
+
+	DataPtr& a = mStrArena;
+	uint64_t at = a.mNum;
+	uint64_t inside = ( a.mCpu != 0x0 && str >= a.mCpu && str < a.mCpu + a.mNum ) ? (uint64_t) ( str - a.mCpu ) + 1 : 0;
+	if ( !StrReserve ( at + len ) ) return r;
+	if ( inside ) str = a.mCpu + inside - 1;						// str was in the arena, which may have moved
+	memcpy ( a.mCpu + at, str, len );
+	a.mNum += len;
+	a.MarkDirty ( at, len );
+
+	r.off = (uint) at;
+	r.len = len;
+	mStrTable[s] = r;
+	mStrCount++;
+	return r;
+}
+
+void DataX::SetElemStr ( int i, int n, std::string val )
+{
+	SetElemStr ( i, n, val.c_str(), (uint) val.size() );
+}
+
+std::string DataX::GetElemStr ( int i, int n )
+{
+	return GetElemStrView ( i, n ).toStr ();
+}
+
+//--------------- Mapped snapshots
+//
+// File layout, host byte order:
+//   DXFileHeader
+//   DXFileBuf x numBuf
+//   heap, string arena, intern table, then buffer sections, each at a DX_FILE_ALIGN offset
+
+#define DX_FILE_MAGIC		0x50414D58		// 'XMAP'
+#define DX_FILE_VERSION		2
+#define DX_FILE_ALIGN		4096
+#define DX_FILE_NAME		64
+
+struct DXFileHeader {
+	uint32_t	magic, version, endian, numBuf;
+	uint64_t	fileSize;
+	uint64_t	heapOffset;
+	int64_t		heapNum, heapFree;
+	int64_t		heapList[ HEAP_CLASSES ];
+	uint64_t	strOffset, strBytes;
+	uint64_t	strTableOffset, strTableNum, strCount;
+};
+struct DXFileBuf {
+	char		name[ DX_FILE_NAME ];
+	int32_t		refID, stride, align, pad;
+	uint64_t	num, bytes, offset;
+	uint8_t		useType, useFlags, reserved[2];
+	int32_t		rx, ry, rz;
+};
+
+static uint64_t dx_align ( uint64_t pos )	{ return (pos + DX_FILE_ALIGN-1) & ~((uint64_t) DX_FILE_ALIGN-1); }
+
+static bool dx_write_at ( FILE* fp, uint64_t& pos, uint64_t at, const void* dat, uint64_t len )
+{
+	static const char zero[ DX_FILE_ALIGN ] = { 0 };
+	while ( pos < at ) {										// pad to section start
+		uint64_t n = at - pos; if ( n > DX_FILE_ALIGN ) n = DX_FILE_ALIGN;
+		if ( fwrite ( zero, 1, n, fp ) != n ) return false;
+		pos += n;
+	}
+	while ( len > 0 ) {
+		uint64_t n = len; if ( n > DX_FILE_ALIGN ) n = DX_FILE_ALIGN;
+		if ( fwrite ( (dat != 0x0) ? dat : zero, 1, n, fp ) != n ) return false;
+		if ( dat != 0x0 ) dat = (const char*) dat + n;
+		pos += n; len -= n;
+	}
+	return true;
+}
+
+bool DataX::SaveMapped ( std::string fname )
+{
+	DXFileHeader hdr;
+	std::vector<DXFileBuf> bufs ( mBuf.size() );
+	memset ( &hdr, 0, sizeof(hdr) );
+	memset ( bufs.data(), 0, bufs.size() * sizeof(DXFileBuf) );
+
+	// Layout
+	uint64_t pos = sizeof(DXFileHeader) + bufs.size() * sizeof(DXFileBuf);
+	hdr.magic = DX_FILE_MAGIC;
+	hdr.version = DX_FILE_VERSION;
+	hdr.endian = 0x01020304;
+	hdr.numBuf = (uint32_t) mBuf.size();
+	hdr.heapNum = (mHeap != 0x0) ? mHeapNum : 0;
+	hdr.heapFree = mHeapFree;
+	for (int c=0; c < HEAP_CLASSES; c++) hdr.heapList[c] = mHeapList[c];
+	hdr.heapOffset = pos = dx_align ( pos );
+	pos += hdr.heapNum * sizeof(hval);
+	hdr.strBytes = mStrArena.mNum;
+	hdr.strOffset = pos = dx_align ( pos );
+	pos += hdr.strBytes;
+	hdr.strTableNum = mStrTable.size();
+	hdr.strCount = mStrCount;
+	hdr.strTableOffset = pos = dx_align ( pos );
+	pos += hdr.strTableNum * sizeof(strref);
+
+	for (size_t b=0; b < mBuf.size(); b++) {
+		DataPtr& buf = mBuf[b];
+		DXFileBuf& fb = bufs[b];
+		strncpy ( fb.name, mName[b].c_str(), DX_FILE_NAME-1 );
+		fb.refID = buf.mRefID;
+		fb.stride = buf.mStride;
+		fb.align = buf.mAlign;
+		fb.pad = buf.bPad;
+		fb.num = buf.mNum;
+		fb.bytes = buf.getNumPadded() * buf.mStride;		// padded buffers keep their padding
+		if ( fb.bytes > buf.mSize ) fb.bytes = buf.mSize;
+		fb.useType = buf.mUseType;
+		fb.useFlags = buf.mUseFlags;
+		fb.rx = buf.mUseRX; fb.ry = buf.mUseRY; fb.rz = buf.mUseRZ;
+		fb.offset = pos = dx_align ( pos );
+		pos += fb.bytes;
+	}
+	hdr.fileSize = dx_align ( pos );
+
+	// Write
+	FILE* fp = fopen ( fname.c_str(), "wb" );
+	if ( fp == 0x0 ) {
+		dbgprintf ( "ERROR: SaveMapped cannot open %s\n", fname.c_str() );
+		return false;
+	}
+	uint64_t at = 0;
+	bool ok = dx_write_at ( fp, at, 0, &hdr, sizeof(hdr) );
+	ok = ok && dx_write_at ( fp, at, at, bufs.data(), bufs.size() * sizeof(DXFileBuf) );
+	ok = ok && dx_write_at ( fp, at, hdr.heapOffset, mHeap, hdr.heapNum * sizeof(hval) );
+	ok = ok && dx_write_at ( fp, at, hdr.strOffset, mStrArena.mCpu, hdr.strBytes );
+	ok = ok && dx_write_at ( fp, at, hdr.strTableOffset, mStrTable.data(), hdr.strTableNum * sizeof(strref) );
+	for (size_t b=0; ok && b < mBuf.size(); b++)
+		ok = dx_write_at ( fp, at, bufs[b].offset, mBuf[b].mCpu, bufs[b].bytes );		// no cpu data writes zeros
+	ok = ok && dx_write_at ( fp, at, hdr.fileSize, 0x0, 0 );
+	if ( fclose ( fp ) != 0 ) ok = false;
+	if ( !ok ) dbgprintf ( "ERROR: SaveMapped failed writing %s\n", fname.c_str() );
+	return ok;
+}
+
+bool DataX::LoadMapped ( std::string fname, bool writable )
+{
+	DeleteAllBuffers ();
+	ClearHeap ();
+	CloseMapped ( false );
+
+	// Map the whole file
+	char* map = 0x0;
+	uint64_t size = 0;
+	#ifdef _WIN32
+		HANDLE fh = CreateFileA ( fname.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+		if ( fh == INVALID_HANDLE_VALUE ) {
+			dbgprintf ( "ERROR: LoadMapped cannot open %s\n", fname.c_str() );
+			return false;
+		}
+		LARGE_INTEGER li;
+		GetFileSizeEx ( fh, &li );
+		size = (uint64_t) li.QuadPart;
+		HANDLE mh = (size > 0) ? CreateFileMappingA ( fh, 0, PAGE_WRITECOPY, 0, 0, 0 ) : 0;
+		CloseHandle ( fh );												// mapping holds the file
+		if ( mh != 0 ) {
+			map = (char*) MapViewOfFile ( mh, writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0 );
+			if ( map == 0x0 ) CloseHandle ( mh );
+		}
+		if ( map == 0x0 ) {
+			dbgprintf ( "ERROR: LoadMapped cannot map %s\n", fname.c_str() );
+			return false;
+		}
+		mFileHandle = mh;
+	#else
+		int fd = open ( fname.c_str(), O_RDONLY );
+		if ( fd < 0 ) {
+			dbgprintf ( "ERROR: LoadMapped cannot open %s\n", fname.c_str() );
+			return false;
+		}
+		struct stat st;
+		if ( fstat ( fd, &st ) == 0 ) size = (uint64_t) st.st_size;
+		if ( size > 0 ) {
+			map = (char*) mmap ( 0, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0 );
+			if ( map == (char*) MAP_FAILED ) map = 0x0;
+		}
+		close ( fd );													// mapping holds the file
+		if ( map == 0x0 ) {
+			dbgprintf ( "ERROR: LoadMapped cannot map %s\n", fname.c_str() );
+			return false;
+		}
+	#endif
+	mFileMap = map;
+	mFileMapSize = size;
+
+	// Validate
+	DXFileHeader* hdr = (DXFileHeader*) map;
+	DXFileBuf* fb = (DXFileBuf*) (map + sizeof(DXFileHeader));
+	bool ok = size >= sizeof(DXFileHeader) && hdr->magic == DX_FILE_MAGIC && hdr->version == DX_FILE_VERSION && hdr->endian == 0x01020304;
+	ok = ok && hdr->numBuf <= REF_MAX && hdr->numBuf <= (size - sizeof(DXFileHeader)) / sizeof(DXFileBuf);
+	ok = ok && hdr->heapNum >= 0 && hdr->heapOffset <= size && (uint64_t) hdr->heapNum <= (size - hdr->heapOffset) / sizeof(hval);
+	ok = ok && hdr->heapFree >= 0 && hdr->heapFree <= hdr->heapNum;
+	for (int c=0; ok && c < HEAP_CLASSES; c++) {								// free list heads must hold a block of their class
+		int64_t h = hdr->heapList[c];
+		ok = h == -1 || ( h >= 0 && h <= hdr->heapNum - ((int64_t) HEAP_INIT << c) );
+	}
+	ok = ok && hdr->strOffset <= size && hdr->strBytes <= size - hdr->strOffset && hdr->strBytes <= DX_STR_MAX;
+	ok = ok && hdr->strTableOffset <= size && hdr->strTableNum <= (size - hdr->strTableOffset) / sizeof(strref) && ( hdr->strTableNum & (hdr->strTableNum - 1) ) == 0;
+	ok = ok && hdr->strCount <= hdr->strTableNum / 2;								// AddStr keeps the table at most half full
+	if ( ok && hdr->strBytes > 0 ) {												// each entry empty or inside the arena
+		strref* table = (strref*) (map + hdr->strTableOffset);
+		uint64_t used = 0;
+		for (uint64_t s=0; ok && s < hdr->strTableNum; s++) {
+			if ( table[s].len == 0 ) continue;
+			ok = table[s].off <= hdr->strBytes && table[s].len <= hdr->strBytes - table[s].off;
+			used++;
+		}
+		ok = ok && used == hdr->strCount;
+	}
+	for (uint32_t b=0; ok && b < hdr->numBuf; b++) {						// sizes are untrusted, compare without products or sums
+		ok = fb[b].offset <= size && fb[b].bytes <= size - fb[b].offset && fb[b].stride > 0 && fb[b].refID >= 0 && fb[b].refID < REF_MAX
+			&& fb[b].num <= fb[b].bytes / (uint64_t) fb[b].stride
+			&& fb[b].align >= 0 && fb[b].align <= DX_FILE_ALIGN && ( fb[b].align & (fb[b].align - 1) ) == 0;
+	}
+	if ( !ok ) {
+		dbgprintf ( "ERROR: LoadMapped %s is not a DataX snapshot, or is truncated\n", fname.c_str() );
+		CloseMapped ( false );
+		return false;
+	}
+
+	// Point buffers and heap into the file
+	for (uint32_t b=0; b < hdr->numBuf; b++) {
+		DataPtr buf;
+		buf.mRefID = (uchar) fb[b].refID;
+		buf.SetUsage ( fb[b].useType, DT_CPU, fb[b].rx, fb[b].ry, fb[b].rz );
+		buf.SetAlign ( fb[b].align, fb[b].pad != 0 );
+		buf.mStride = fb[b].stride;
+		buf.mNum = fb[b].num;
+		buf.mMax = fb[b].bytes / fb[b].stride;
+		buf.mSize = buf.mMax * buf.mStride;
+		buf.mCpu = (buf.mSize > 0) ? map + fb[b].offset : 0x0;
+		buf.bView = ( buf.mCpu != 0x0 );
+		buf.bCpu = true;
+
+		std::string name ( fb[b].name, strnlen ( fb[b].name, DX_FILE_NAME ) );
+		mRef[ fb[b].refID ] = (int) mBuf.size();
+		mBuf.push_back ( buf );
+		mName.push_back ( name );
+	}
+	if ( hdr->heapNum > 0 ) {
+		mHeap = (hval*) (map + hdr->heapOffset);
+		bHeapView = true;
+		mHeapNum = mHeapMax = hdr->heapNum;
+		mHeapFree = hdr->heapFree;
+		for (int c=0; c < HEAP_CLASSES; c++) mHeapList[c] = hdr->heapList[c];
+	}
+	if ( hdr->strBytes > 0 ) {											// arena stays in the file, table is copied
+		mStrArena.mStride = 1;
+		mStrArena.mNum = mStrArena.mMax = mStrArena.mSize = hdr->strBytes;
+		mStrArena.mCpu = map + hdr->strOffset;
+		mStrArena.bView = true;
+		strref* table = (strref*) (map + hdr->strTableOffset);
+		mStrTable.assign ( table, table + hdr->strTableNum );
+		mStrCount = (uint) hdr->strCount;
+	}
+	return true;
+}
+
+void DataX::CloseMapped ( bool keep )
+{
+	if ( mFileMap == 0x0 ) return;
+
+	// Move anything still in the file to its own memory, or drop it
+	std::vector<DataPtr*> views;
+	for (size_t b=0; b < mBuf.size(); b++) views.push_back ( &mBuf[b] );
+	views.push_back ( &mStrArena );
+	for (DataPtr* v : views) {
+		DataPtr& buf = *v;
+		if ( !buf.bView ) continue;
+		if ( keep ) {
+			char* view = buf.mCpu;
+			buf.mCpu = 0x0;
+			buf.bView = false;
+			if ( !buf.ReallocateCPU ( 0, buf.mSize ) ) { buf.Clear (); continue; }
+			memcpy ( buf.mCpu, view, buf.mSize );
+		} else {
+			buf.Clear ();
+		}
+	}
+	if ( mStrArena.mCpu == 0x0 ) {								// arena dropped, table refers to it
+		mStrTable.clear ();
+		mStrCount = 0;
+	}
+	if ( bHeapView ) {
+		if ( keep ) {
+			hval* heap = (hval*) malloc ( mHeapMax * sizeof(hval) );
+			memcpy ( heap, mHeap, mHeapNum * sizeof(hval) );
+			mHeap = heap;
+			bHeapView = false;
+		} else {
+			ClearHeap ();
+		}
+	}
+
+	#ifdef _WIN32
+		UnmapViewOfFile ( mFileMap );
+		CloseHandle ( (HANDLE) mFileHandle );
+	#else
+		munmap ( mFileMap, mFileMapSize );
+	#endif
+	mFileMap = 0x0;
+	mFileMapSize = 0;
+	mFileHandle = 0x0;
 }
 
 
@@ -245,6 +1040,9 @@ char* DataX::printElem ( int i, int n, char* buf )
 	case DT_FLOAT4: {
 		Vec4F v = *((Vec4F*) mBuf[b].mCpu + n);
 		sprintf ( buf, "%f,%f,%f,%f", v.x, v.y, v.z, v.w );	} break;	
+	case DT_STRREF: {
+		strview v = GetStrView ( *((strref*) mBuf[b].mCpu + n) );
+		sprintf ( buf, "%.*s", (int) ( v.len < 255 ? v.len : 255 ), v.str );	} break;
 	};
 	return buf;
 }
@@ -275,6 +1073,8 @@ int DataX::AddElemDirect (int b)
 {
 	if (mBuf[b].mNum >= mBuf[b].mMax)
 		mBuf[b].Append(mBuf[b].mStride, mBuf[b].mMax + 8);	// expand
+	if (mBuf[b].mNum >= mBuf[b].mMax) return -1;		// out of memory
+	mBuf[b].MarkDirty ( mBuf[b].mNum );
 	mBuf[b].mNum++;
 	return mBuf[b].mNum - 1;
 }
@@ -287,7 +1087,9 @@ int DataX::AddElem ( int i )
 	//--- this part identical to AddElemDirect
 	if ( mBuf[b].mNum >= mBuf[b].mMax ) 
 		mBuf[b].Append ( mBuf[b].mStride, mBuf[b].mMax + 8 );	// expand
+	if ( mBuf[b].mNum >= mBuf[b].mMax ) return -1;			// out of memory
 
+	mBuf[b].MarkDirty ( mBuf[b].mNum );
 	mBuf[b].mNum++;
 	return mBuf[b].mNum-1;
 }
@@ -299,7 +1101,8 @@ int DataX::MemcpyBuffer ( int i, uchar* dat, int len, int cnt )
 	assert ( len == mBuf[b].mStride * cnt );
 
 	mBuf[b].Clear();
-	mBuf[b].Append ( mBuf[b].mStride, cnt, (char*) dat );
+	mBuf[b].Append ( mBuf[b].mStride, cnt, (char*) dat );		// marks dirty
+	if ( mBuf[b].mMax < (uint64_t) cnt ) return -1;				// out of memory
 	mBuf[b].mNum = cnt;
 
 	return mBuf[b].mNum-1;
@@ -316,6 +1119,7 @@ int	DataX::AddElem()
 		j = AddElemDirect (b);
 		if (j != i) dbgprintf("ERROR: Buffer mismatch adding element.\n");
 	}
+	if ( bHandles ) SyncHandles ( i+1 );
 	return i;
 }
 
@@ -325,14 +1129,11 @@ void DataX::ResizeBuffer ( int i, int max_cnt, bool safe )
 
 	// Clear element buffer			
 	if ( mBuf[b].mMax < max_cnt) {
+		uint64_t used = mBuf[b].mNum * mBuf[b].mStride;
+		uint64_t size = (uint64_t) max_cnt * mBuf[b].mStride;
+		if ( !mBuf[b].ReallocateCPU ( safe ? used : 0, size ) ) return;		// keeps old buffer
 		mBuf[b].mMax = max_cnt;		
-		mBuf[b].mSize = mBuf[b].mMax*mBuf[b].mStride;
-		char* newdata = (char*)malloc(mBuf[b].mSize);
-		if (mBuf[b].mCpu != 0x0) {
-			if (safe) memcpy (newdata, mBuf[b].mCpu, mBuf[b].mNum * mBuf[b].mStride);
-			free(mBuf[b].mCpu);
-		}
-		mBuf[b].mCpu = newdata;
+		mBuf[b].mSize = size;
 	}
 }
 
@@ -341,6 +1142,7 @@ void DataX::EmptyAllBuffers()
 {
 	for (int b = 0; b < mBuf.size(); b++)
 		mBuf[b].mNum = 0;
+	SyncHandles ( 0 );
 }
 
 // copy buffer from one DataX into buffer in another DataX
@@ -352,9 +1154,9 @@ void DataX::CopyBuffer ( uchar bsrc, uchar bdest, DataX* dest, uchar dest_flags
 	mBuf[bsrc].CopyTo ( &dest->mBuf[bdest], dest_flags );		// copy to target
 }
 
-int DataX::GetHeapSize ()
+xlong DataX::GetHeapSize ()
 {
-	int sum = mHeapNum * sizeof(hval) ;
+	xlong sum = mHeapNum * sizeof(hval) ;
 	//for (int n=0; n < (int) mBuf.size(); n++)
 //		sum += mBuf[n].size;	
 	//sum += (int) mAttribute.size() * sizeof(GeomAttr);
@@ -368,12 +1170,13 @@ char* DataX::AddElem ( int i, int cnt )
 
 	int n = mBuf[b].mNum;
 	if ( n + cnt >= mBuf[b].mMax ) {	
+		uint64_t used = (uint64_t) n * mBuf[b].mStride;
+		uint64_t size = ( mBuf[b].mMax + cnt ) * mBuf[b].mStride;
+		if ( !mBuf[b].ReallocateCPU ( used, size ) ) return 0x0;		// keeps existing elements
 		mBuf[b].mMax += cnt;
-		int new_size = mBuf[b].mMax * mBuf[b].mStride;
-		char* new_data = (char*) malloc ( new_size );		
-		if ( mBuf[b].mCpu != 0x0 ) free ( mBuf[b].mCpu );
-		mBuf[b].mCpu = new_data;		
+		mBuf[b].mSize = size;
 	}
+	mBuf[b].MarkDirty ( n, cnt );
 	mBuf[b].mNum += cnt;
 	return mBuf[b].mCpu + (n * mBuf[b].mStride);
 }
@@ -391,24 +1194,136 @@ bool DataX::DelElem ( uchar i, int ndx )
 {
 	int b=mRef[i]; if ( b==BUNDEF) return 0;
 	if ( ndx < 0 || ndx >= mBuf[b].mNum ) return false;
-	memcpy ( mBuf[b].mCpu + ndx*mBuf[b].mStride, mBuf[b].mCpu + (ndx+1)*mBuf[b].mStride, (mBuf[b].mNum-1-ndx)*mBuf[b].mStride );		
+	memmove ( mBuf[b].mCpu + ndx*mBuf[b].mStride, mBuf[b].mCpu + (ndx+1)*mBuf[b].mStride, (mBuf[b].mNum-1-ndx)*mBuf[b].mStride );		
+	mBuf[b].MarkDirty ( ndx, mBuf[b].mNum-1-ndx );
 	mBuf[b].mNum--;	
 	return true;
 }
 
+// Delete element in all buffers. The last element is moved into its place.
+bool DataX::DelElemSwap ( int n )
+{
+	if ( mBuf.size()==0 ) return false;
+	int last = (int) mBuf[0].mNum - 1;
+	if ( n < 0 || n > last ) return false;
+
+	for (size_t b = 0; b < mBuf.size(); b++) {
+		DataPtr& buf = mBuf[b];
+		if ( buf.mNum != (uint64_t) last + 1 ) { dbgprintf ( "ERROR: Buffer mismatch deleting element.\n" ); continue; }
+		if ( n != last ) {
+			memcpy ( buf.mCpu + (uint64_t) n*buf.mStride, buf.mCpu + (uint64_t) last*buf.mStride, buf.mStride );
+			buf.MarkDirty ( n );
+		}
+		buf.mNum--;
+	}
+	if ( bHandles ) MoveHandle ( last, n );
+	return true;
+}
+
+// Delete many elements in all buffers. Holes are filled from the end,
+// highest index first, so only as many elements move as are deleted.
+int DataX::DelElems ( std::vector<int>& list )
+{
+	if ( mBuf.size()==0 || list.size()==0 ) return 0;
+	int num = (int) mBuf[0].mNum;
+
+	std::vector<int> del;
+	del.reserve ( list.size() );
+	for (size_t k = 0; k < list.size(); k++)
+		if ( list[k] >= 0 && list[k] < num ) del.push_back ( list[k] );
+	std::sort ( del.begin(), del.end(), std::greater<int>() );
+	del.erase ( std::unique ( del.begin(), del.end() ), del.end() );
+	int cnt = (int) del.size();
+
+	for (size_t b = 0; b < mBuf.size(); b++) {			// one pass per buffer
+		DataPtr& buf = mBuf[b];
+		if ( buf.mNum != (uint64_t) num ) { dbgprintf ( "ERROR: Buffer mismatch deleting elements.\n" ); continue; }
+		char* dat = buf.mCpu;
+		uint64_t stride = buf.mStride;
+		int last = num - 1;
+		for (int k = 0; k < cnt; k++, last--) {
+			if ( del[k] != last ) {
+				memcpy ( dat + del[k]*stride, dat + last*stride, stride );
+				buf.MarkDirty ( del[k] );
+			}
+		}
+		buf.mNum = num - cnt;
+	}
+	if ( bHandles ) {
+		int last = num - 1;
+		for (int k = 0; k < cnt; k++, last--)
+			MoveHandle ( last, del[k] );
+	}
+	return cnt;
+}
+
+//---------------------------------------------------------------- Element handles
+void DataX::UseHandles ( bool on )
+{
+	bHandles = on;
+	SyncHandles ( (on && mBuf.size() > 0) ? (int) mBuf[0].mNum : 0 );
+}
+
+// Release handles past num, and give new elements up to num a handle
+void DataX::SyncHandles ( int num )
+{
+	if ( !bHandles ) num = 0;
+	while ( (int) mElemHandle.size() > num ) {
+		int s = mElemHandle.back();
+		mElemHandle.pop_back();
+		mHandleElem[s] = -1;
+		if ( ++mHandleGen[s] == 0 ) mHandleGen[s] = 1;		// generation 0 is never issued
+		mHandleFree.push_back ( s );
+	}
+	while ( (int) mElemHandle.size() < num ) {
+		int s;
+		if ( mHandleFree.size() > 0 ) {
+			s = mHandleFree.back();
+			mHandleFree.pop_back();
+		} else {
+			s = (int) mHandleElem.size();
+			mHandleElem.push_back ( -1 );
+			mHandleGen.push_back ( 1 );
+		}
+		mHandleElem[s] = (int) mElemHandle.size();
+		mElemHandle.push_back ( s );
+	}
+}
+
+// Element 'to' was deleted and the last element, 'from', moved into it
+void DataX::MoveHandle ( int from, int to )
+{
+	if ( from >= (int) mElemHandle.size() ) SyncHandles ( from+1 );	// elements added without AddElem()
+	if ( from != to ) {
+		int s = mElemHandle[to];
+		mElemHandle[to] = mElemHandle[from];
+		mElemHandle[from] = s;
+		mHandleElem[ mElemHandle[to] ] = to;
+	}
+	SyncHandles ( from );							// releases the deleted handle, now at the end
+}
+
 //---------------------------------------------------------------- HEAP
+void DataX::HeapRelease ()
+{
+	if ( mHeap != 0x0 && !bHeapView ) free ( mHeap );
+	mHeap = 0x0;
+	bHeapView = false;
+}
+
 void DataX::ResetHeap ()
 {
 	mHeapNum = 0;
-	mHeapFree = -1;
+	mHeapFree = 0;
+	for (int c=0; c < HEAP_CLASSES; c++) mHeapList[c] = -1;
 }
 
-void DataX::AddHeap ( int max )
+void DataX::AddHeap ( hpos max )
 {
+	HeapRelease ();
 	mHeap = (hval*) malloc ( max * sizeof(hval ) );
 	mHeapMax = max;
-	mHeapNum = 0;
-	mHeapFree = -1;
+	ResetHeap ();
 }
 
 hval* DataX::GetHeap ( hpos& num, hpos& max, hpos& free )
@@ -419,24 +1334,37 @@ hval* DataX::GetHeap ( hpos& num, hpos& max, hpos& free )
 	return mHeap;
 }
 
-void DataX::CopyHeap ( DataX& src )
+// Heap stats. Walks the free lists.
+hval* DataX::GetHeap ( HeapStats& stats )
 {
-	hpos num, max, freepos;
-	hval* src_data = src.GetHeap ( num, max, freepos );
-
-	if ( mHeap != 0x0 ) {
-		free ( mHeap );
-		mHeap = 0x0;
-		mHeapNum = 0;
-		mHeapMax = 0;
+	memset ( &stats, 0, sizeof(HeapStats) );
+	stats.num = mHeapNum;
+	stats.max = mHeapMax;
+	stats.free = mHeapFree;
+	for (int c=0; c < HEAP_CLASSES; c++) {
+		for (hpos pos = mHeapList[c]; pos != -1; memcpy ( &pos, mHeap + pos, sizeof(hpos) ) ) {
+			stats.classFree[c]++;
+			stats.freeBlocks++;
+			stats.largestFree = (hpos) HEAP_INIT << c;
+		}
 	}
+	stats.frag = (mHeapNum == 0) ? 0 : (float) mHeapFree / mHeapNum;
+	return mHeap;
+}
 
-	if ( max > 0 ) {
-		mHeap = (hval*) malloc ( max * sizeof(hval));
-		mHeapMax = max;
-		mHeapNum = num;
-		mHeapFree = freepos;
-		memcpy ( mHeap, src_data, mHeapNum * sizeof(hval) );
+void DataX::CopyHeap ( DataX& src )
+{
+	HeapRelease ();
+	mHeapMax = 0;
+	ResetHeap ();
+
+	if ( src.mHeapMax > 0 ) {
+		mHeap = (hval*) malloc ( src.mHeapMax * sizeof(hval));
+		mHeapMax = src.mHeapMax;
+		mHeapNum = src.mHeapNum;
+		mHeapFree = src.mHeapFree;
+		for (int c=0; c < HEAP_CLASSES; c++) mHeapList[c] = src.mHeapList[c];
+		memcpy ( mHeap, src.mHeap, mHeapNum * sizeof(hval) );
 	}
 }
 
@@ -447,20 +1375,25 @@ void DataX::ClearRefs ( hList* list )
 	list->pos = 0;
 }
 
-hval DataX::AddRef ( hval r, hList* list, hval delta )
+hpos DataX::AddRef ( hval r, hList* list, hval delta )
 {	
+	uint max;
 	if ( list->max == 0 ) {
+		hpos new_pos = HeapAlloc ( HEAP_INIT, max );
+		if ( new_pos == -1 ) return -1;											// list unchanged
+		list->pos = new_pos;
+		list->max = max;
 		list->cnt = 1;		
-		list->pos = HeapAlloc ( HEAP_INIT, list->max );
 		*(mHeap + list->pos) = r+delta;
 	} else {
 		if ( list->cnt >= list->max ) {			
-			int siz = list->max;
-			hpos new_pos = HeapAlloc ( siz+HEAP_INIT, list->max );				// Alloc new location
-			//printf ( "MOVE %d -> %d\n", list.pos, new_pos );			
+			uint siz = list->max;
+			hpos new_pos = HeapAlloc ( siz*2, max );							// Alloc next size class
+			if ( new_pos == -1 ) return -1;										// list unchanged
 			memcpy ( mHeap+new_pos, mHeap + list->pos, list->cnt*sizeof(hval) );	// Copy data to new location
 			HeapAddFree ( list->pos, siz );										// Free old location						
 			list->pos = new_pos;				
+			list->max = max;
 		}
 		*(mHeap + list->pos + list->cnt) = r+delta;
 		list->cnt++;
@@ -468,137 +1401,118 @@ hval DataX::AddRef ( hval r, hList* list, hval delta )
 	return list->pos;
 }
 
-void DataX::HeapAddFree ( hpos pos, int size )
+// Size class holding blocks of at least size entries
+int DataX::HeapClass ( uint size )
 {
-	memset ( mHeap+pos, 0xFFFF, size*sizeof(hval) );
-
-	if ( pos < mHeapFree || mHeapFree == -1 ) {
-		// Lowest position. Insert at head of heap.
-		* (hpos*) (mHeap+pos) = size;	
-		* (hpos*) (mHeap+pos + HEAP_POS) = mHeapFree;
-		mHeapFree = pos;		
-		if ( mHeapFree != -1 && *(hpos*) (mHeap+mHeapFree + HEAP_POS) == 0x0 ) { printf( "Heap pointer 0. pHeapFree, %d\n", pos ); }
-
-		assert ( mHeapFree >= -1 );
-	} else {
-		hval* pCurr = mHeap + pos;
-		hval* pPrev = 0x0;
-		hval* pNext = mHeap + mHeapFree;
-		
-		if ( pCurr == pNext ) {		// Freeing the first block
-			mHeapFree = * (hpos*) (pCurr + HEAP_POS);			
-			* (hpos*) (mHeap+mHeapFree + HEAP_POS) = 0xFFFFFFFF;			
-			* (hpos*) (pCurr + HEAP_POS) = 0xFFFFFFFF;	
-			* (hpos*) pCurr = 0xFFFFFFFF;					
-			return;		
-
-		}
-		
-		// Find first block greater than new free pos.
-		while ( pNext < pCurr && pNext != mHeap-1 ) {
-			pPrev = pNext;
-			pNext = mHeap + * (hpos*) (pNext + HEAP_POS);			
-		}
-
-		int x = 0;
-		if ( pPrev + *(pPrev) == pCurr ) {							// Prev block touches current one (expand previous)
-			* (hpos*) pPrev += size;								// - prev.size = prev.size + curr.size
-			x=1;
-		
-		} else if ( pCurr + size == pNext && pNext != mHeap-1 )	{	// Curr block touches next one (expand current block)
-			* (hpos*) (pPrev + HEAP_POS) = pos;							// - prev.next = curr
-			* (hpos*) (pCurr + HEAP_POS) = * (hpos*) (pNext + HEAP_POS);	// - curr.next = next.next
-			* (hpos*) pCurr = size + * (hpos*) pNext;				// - curr.size = size + next.size
-			* (hpos*) (pNext) = 0xFFFFFFFF;							// - curr = null
-			* (hpos*) (pNext + HEAP_POS) = 0xFFFFFFFF;					// - curr.next = null
-			x=2;
-
-		} else {													// Otherwise (linked list insert)
-			* (hpos*) (pPrev + HEAP_POS) = pos;							// - prev.next = curr
-			if ( pNext != mHeap-1 )
-				* (hpos*) (pCurr + HEAP_POS) = (hpos) (pNext - mHeap);		// - curr.next = next				
-			else
-				* (hpos*) (pCurr + HEAP_POS) = 0xFFFFFFFF;				// - curr.next = null (no next node)
-			* (hpos*) pCurr = size;									// - curr.size = size
-			x=3;
-		}
-		if ( pCurr !=mHeap-1 && *(hpos*) (pCurr+HEAP_POS) == 0x0 ) { dbgprintf ( "ERROR: Heap pointer 0. pCurr, %d, %d\n", x, pos );  }
-		if ( pPrev !=mHeap-1 && *(hpos*) (pPrev+HEAP_POS) == 0x0 ) { dbgprintf ( "ERROR: Heap pointer 0. pPrev, %d, %d\n", x, pos );  }
-		if ( pNext !=mHeap-1 && *(hpos*) (pNext+HEAP_POS) == 0x0 ) { dbgprintf ( "ERROR: Heap pointer 0. pNext, %d, %d\n", x, pos ); }
-		if ( *(hpos*) (mHeap+mHeapFree + HEAP_POS) == 0x0 ) { printf ( "ERROR: Heap pointer 0. pHeapFree, %d, %d\n", x, pos );}
-
-		// -- check for bugs (remove eventually)
-		pNext = mHeap + mHeapFree;
-		while ( pNext != mHeap-1 ) {
-			pPrev = pNext;	
-			pNext = mHeap + * (hpos*) (pNext + HEAP_POS);
-			if ( pNext < pPrev && pNext != mHeap-1 ) {
-				printf ( "ERROR: Heap free space out of order. %d, %d\n", x, pos );
-			}
-		}
-		//---
-	}
- }
+	int c = 0;
+	while ( c < HEAP_CLASSES-1 && ((uint) HEAP_INIT << c) < size ) c++;
+	return c;
+}
 
+// Push block onto its class free list. The next link is kept in the block.
+void DataX::HeapAddFree ( hpos pos, uint size )
+{
+	if ( size < HEAP_INIT ) return;						// too small to track
+	int c = HeapClass ( size );
+	if ( ((uint) HEAP_INIT << c) > size ) c--;			// not a class size, round down
+	memcpy ( mHeap + pos, &mHeapList[c], sizeof(hpos) );
+	mHeapList[c] = pos;
+	mHeapFree += (hpos) HEAP_INIT << c;
+}
 
-hpos DataX::HeapExpand ( ushort size, ushort& ret  )
+// Ensure room for size entries at the end of the heap
+hpos DataX::HeapExpand ( uint size, uint& ret  )
 {
-	mHeapMax *= 2;	
-	if ( mHeapMax > HEAP_MAX ) {
-		printf ( "Geom heap size exceeds range of index.\n" );		
+	hpos max = (mHeapMax > 0) ? mHeapMax : HEAP_INIT*8;
+	while ( mHeapNum + size > max ) max *= 2;
+	if ( max > HEAP_MAX ) {
+		dbgprintf ( "ERROR: Heap size exceeds range of index.\n" );
+		ret = 0;
+		return -1;
 	}
-	hval* pNewHeap = (hval*) malloc ( mHeapMax * sizeof(hval));
+	hval* pNewHeap = (hval*) malloc ( max * sizeof(hval));
 	if ( pNewHeap == 0x0 ) {
-		printf ( "Geom heap out of memory.\n" );		
+		dbgprintf ( "ERROR: Heap out of memory.\n" );
+		ret = 0;
+		return -1;
+	}
+	if ( mHeap != 0x0 ) {
+		memcpy ( pNewHeap, mHeap, mHeapNum*sizeof(hval) );
+		HeapRelease ();
 	}
-	memcpy ( pNewHeap, mHeap, mHeapNum*sizeof(hval) );
-	free ( mHeap );
 	mHeap = pNewHeap;
+	mHeapMax = max;
 	ret = size;
-	assert ( mHeapNum >= 0 && mHeapNum < mHeapMax );
 	return mHeapNum;
 }
 
-hpos DataX::HeapAlloc ( ushort size, ushort& ret  )
+hpos DataX::HeapAlloc ( uint size, uint& ret  )
 {
-	hval* pPrev = 0x0;
-	hval* pCurr = mHeap + mHeapFree;
-	hpos pos = -1;
-
-	if ( mHeapNum + size < mHeapMax ) {
-		// Heap not yet full.
-		pos = mHeapNum;
-		ret = size;
-		mHeapNum += size;		
+	int c = HeapClass ( size );
+	uint csz = (uint) HEAP_INIT << c;
+	hpos pos = mHeapList[c];
+
+	if ( pos != -1 ) {
+		// Reuse a free block of this class
+		hpos next;
+		memcpy ( &next, mHeap + pos, sizeof(hpos) );
+		if ( next != -1 && ( next < 0 || next > mHeapNum - (hpos) csz ) ) {	// links may come from a mapped file
+			dbgprintf ( "ERROR: Heap free list %d is corrupt, dropping it.\n", c );
+			next = -1;
+		}
+		mHeapList[c] = next;
+		mHeapFree -= csz;
 	} else {
-		// Heap full, search free space
-		if ( mHeapFree == -1 ) {
-			pos = HeapExpand ( size, ret );			
-			mHeapNum += ret;
-		} else {			
-			while ( *pCurr < size && pCurr != mHeap-1 ) {
-				pPrev = pCurr;
-				pCurr = mHeap + * (hpos*) (pCurr + HEAP_POS);
-			}
-			if ( pCurr != mHeap-1 ) {
-				// Found free space.
-				if ( pPrev == 0x0 ) {
-					mHeapFree = * (hpos*) (pCurr + HEAP_POS);					
-					assert ( mHeapFree >= -1 );
-				} else {
-					* (hpos*) (pPrev+HEAP_POS) = * (hpos*) (pCurr+HEAP_POS);
-				}
-				pos = (hpos) (pCurr - mHeap);
-				ret = *pCurr;
-			} else {
-				// Heap full, no free space. Expand heap.
-				pos = HeapExpand ( size, ret );
-				mHeapNum += ret;
-			}				
-		}		
-	}	
-
-	assert ( pos >= 0 && pos <= mHeapNum );
-	memset ( mHeap+pos, 0x00, size*sizeof(hval) );
+		// Take from the end, expanding if needed
+		if ( mHeapNum + csz > mHeapMax ) {
+			if ( HeapExpand ( csz, ret ) == -1 ) return -1;		// 0 is a valid position
+		}
+		pos = mHeapNum;
+		mHeapNum += csz;
+	}
+	ret = csz;
+	assert ( pos >= 0 && pos + csz <= mHeapNum );
+	memset ( mHeap+pos, 0x00, csz*sizeof(hval) );
 	return pos;
 }
+
+// Repack all lists into a new heap, smallest class that fits each, with no
+// free blocks. Every list in the heap must be in one of the given buffers.
+hpos DataX::HeapCompact ( const std::vector<int>& list_bufs )
+{
+	hpos need = 0;
+	for (size_t k=0; k < list_bufs.size(); k++) {
+		int b = mRef[ list_bufs[k] ]; if ( b == BUNDEF ) continue;
+		for (uint64_t n=0; n < mBuf[b].mNum; n++) {
+			hList* list = (hList*) mBuf[b].getPtr(n);
+			if ( list->max > 0 ) need += (hpos) HEAP_INIT << HeapClass ( list->cnt );
+		}
+	}
+	hpos max = (need > HEAP_INIT*8) ? need : HEAP_INIT*8;
+	hval* pNewHeap = (hval*) malloc ( max * sizeof(hval) );
+	if ( pNewHeap == 0x0 ) {
+		dbgprintf ( "ERROR: Heap out of memory.\n" );
+		return 0;
+	}
+	hpos pos = 0;
+	for (size_t k=0; k < list_bufs.size(); k++) {
+		int b = mRef[ list_bufs[k] ]; if ( b == BUNDEF ) continue;
+		for (uint64_t n=0; n < mBuf[b].mNum; n++) {
+			hList* list = (hList*) mBuf[b].getPtr(n);
+			if ( list->max == 0 ) continue;
+			uint sz = (uint) HEAP_INIT << HeapClass ( list->cnt );
+			memcpy ( pNewHeap + pos, mHeap + list->pos, list->cnt*sizeof(hval) );
+			memset ( pNewHeap + pos + list->cnt, 0x00, (sz - list->cnt)*sizeof(hval) );
+			list->pos = pos;
+			list->max = sz;
+			pos += sz;
+		}
+	}
+	hpos reclaimed = mHeapNum - need;
+	HeapRelease ();
+	mHeap = pNewHeap;
+	mHeapMax = max;
+	ResetHeap ();
+	mHeapNum = need;
+	return reclaimed;
+}
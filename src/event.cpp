@@ -16,14 +16,24 @@
 // OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 #include "event.h"
+#include <atomic>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+	#define EVENT_SSE2
+	#include <emmintrin.h>
+#endif
 
-static char mbuf [ 16384 ];
 
 extern char* new_event_data ( size_t size, int& max, EventPool* pool, eventStr_t name, const char* msg=0 );
 extern void free_event_data ( char*& data, EventPool* pool, eventStr_t name, int cid, const char* msg=0 );
 extern void free_event ( Event& e, const char* msg=0 );
 extern void expand_event ( Event& e, size_t size );
-extern int event_alloc;
+extern std::atomic<int> event_alloc;
+
+// Serialized header: int len, name, target, int cid, 8-byte time stamp. See Wire format in event.h
+static_assert ( sizeof(int) == 4 && sizeof(eventStr_t) == 4 && sizeof(timeStamp_t) == 8, "Event header members must be fixed width" );
+static_assert ( 2*sizeof(int) + 2*sizeof(eventStr_t) + sizeof(timeStamp_t) == EVENT_HEADER_SIZE, "Event header size" );
 #ifdef DEBUG_EVENT_MEM
 	extern void emem_rename ( Event& e, eventStr_t oldname, eventStr_t newname, const char* msg );
 #endif
@@ -63,6 +73,7 @@ Event::Event ( size_t size, eventStr_t targ, eventStr_t name, eventStr_t state,
 	mTarget = targ;
 	mName = name;
 	mDataLen = 0;
+	mCallID = 0;
 	
 	mCID = event_alloc;			// creation ID	
 	mData = new_event_data ( size, mMax, pool, name, msg );	  // payload allocation	
@@ -71,6 +82,7 @@ Event::Event ( size_t size, eventStr_t targ, eventStr_t name, eventStr_t state,
 	mOwner = pool;
 	bOwn = true;					// event retains ownership
 	bDestroy = true;			
+	bReadErr = false;
 	mPos = mData;
 }
 
@@ -83,6 +95,7 @@ Event::Event ( eventStr_t target, eventStr_t name)
 	mTarget = target;
 	mName = name;
 	mDataLen = 0;
+	mCallID = 0;
 	mMax = 0;	
 	mData = 0x0;
 	mPos = 0x0;	
@@ -90,6 +103,7 @@ Event::Event ( eventStr_t target, eventStr_t name)
 	mCID = -1;
 	bOwn = true;
 	bDestroy = true;
+	bReadErr = false;
 
 	// check member variable structure (important!)
 	int headersz = (char*) &mData - (char*) &mDataLen;
@@ -110,9 +124,11 @@ void Event::copyEventVars ( Event* dst, const Event* src )
 	dst->mRefs = src->mRefs;
 	dst->mSrcSock = src->mSrcSock;
 	dst->mTargetID = src->mTargetID;			
+	dst->mCallID = src->mCallID;
 	dst->mMax = src->mMax;	
 	dst->bOwn = src->bOwn;	
 	dst->bDestroy = src->bDestroy;
+	dst->bReadErr = src->bReadErr;
 	dst->mDataLen = src->mDataLen;
 	
 	// data transfer of ownership
@@ -260,81 +276,48 @@ void Event::setName ( eventStr_t new_name, const char* new_msg )
 }
 
 
+// Attach. Fixed width, little-endian. See Wire format in event.h
 void Event::attachInt ( int i)
 {
-	if ( mDataLen+sizeof(int) > mMax ) expand ( mDataLen*2 );
-	* (int*) mPos = i;
-	mPos += sizeof(int);
-	mDataLen += sizeof(int);
+	attachWire<int32_t> ( i );
 }
 void Event::attachUChar (unsigned char i)
 {
-	if ( mDataLen+sizeof(char) > mMax ) expand ( mDataLen*2 );
-	* (unsigned char*) mPos = i;
-	mPos += sizeof(char);
-	mDataLen += sizeof(char);
+	attachWire<uint8_t> ( i );
 }
 void Event::attachShort (short i)
 {
-	if ( mDataLen+sizeof(signed short) > mMax ) expand ( mDataLen*2 );
-	* (signed short*) mPos = i;
-	mPos += sizeof(signed short);
-	mDataLen += sizeof(signed short);
+	attachWire<int16_t> ( i );
 }
-
 void Event::attachUShort ( unsigned short i)
 {
-	if ( mDataLen+sizeof(short) > mMax ) expand ( mDataLen*2 );
-	* (unsigned short*) mPos = i;
-	mPos += sizeof(signed short);
-	mDataLen += sizeof(signed short);
+	attachWire<uint16_t> ( i );
 }
-
 void Event::attachUInt (unsigned int i)
 {
-	if ( mDataLen+sizeof(int) > mMax ) expand ( mDataLen*2 );
-	* (unsigned int*) mPos = i;
-	mPos += sizeof(int);
-	mDataLen += sizeof(int);
+	attachWire<uint32_t> ( i );
 }
 void Event::attachULong (unsigned long i)
 {
-	if ( mDataLen+sizeof(unsigned long) > mMax ) expand ( mDataLen*2 );
-	* (unsigned long*) mPos = i;
-	mPos += sizeof(unsigned long);
-	mDataLen += sizeof(unsigned long);
+	attachWire<uint32_t> ( (uint32_t) i );		// 32-bit on the wire
 }
-
 void Event::attachInt64 (xlong i)
 {
-	if ( mDataLen+sizeof(xlong) > mMax ) expand ( mDataLen*2 );
-	* (xlong*) mPos = i;
-	mPos += sizeof(xlong);
-	mDataLen += sizeof(xlong);
+	attachWire<uint64_t> ( i );
 }
 void Event::attachFloat (float f)
 {
-	if ( mDataLen+sizeof(float) > mMax ) expand ( mDataLen*2 );
-	* (float*) mPos = f;
-	mPos += sizeof(float);
-	mDataLen += sizeof(float);
+	attachWire<float> ( f );
 }
-
 void Event::attachDouble (double f)
 {
-	if ( mDataLen+sizeof(double) > mMax ) expand ( mDataLen*2 );
-	* (double*) mPos = f;
-	mPos += sizeof(double);
-	mDataLen += sizeof(double);
+	attachWire<double> ( f );
 }
-
 void Event::attachBool ( bool b)
 {
-	if ( mDataLen+sizeof(bool) > mMax ) expand ( mDataLen*2 );
-	* (bool*) mPos = b;
-	mPos += sizeof(bool);
-	mDataLen += sizeof(bool);
+	attachWire<uint8_t> ( b ? 1 : 0 );
 }
+
 void Event::attachVec4 ( Vec4F v )
 {
 	attachFloat ( v.x );
@@ -466,127 +449,351 @@ Vec4F Event::getVec4 ()
 
 void Event::writeUShort (int pos, unsigned short i)
 {
-	* (unsigned short*) (getData() + pos) = i;
+	wirePut<uint16_t> ( getData() + pos, i );
 }
 
+// Get. Bounds-checked, fixed width, little-endian
 int Event::getInt ()
 {
-	int i = * (int*) mPos;
-	mPos += sizeof(int);
-	return i;
+	return getWire<int32_t> ();
 }
 unsigned char Event::getUChar ()
 {
-	unsigned char i = * (unsigned char*) mPos;
-	mPos += sizeof(unsigned char);
-	return i;
+	return getWire<uint8_t> ();
 }
 signed short Event::getShort ()
 {
-	signed short i = * (signed short*) mPos;
-	mPos += sizeof(signed short);
-	return i;
+	return getWire<int16_t> ();
 }
 unsigned short Event::getUShort ()
 {
-	unsigned short i = * (unsigned short*) mPos;
-	mPos += sizeof(unsigned short);
-	return i;
+	return getWire<uint16_t> ();
 }
 unsigned int Event::getUInt ()
 {
-	unsigned int i = * (unsigned int*) mPos;
-	mPos += sizeof(unsigned int);
-	return i;
+	return getWire<uint32_t> ();
 }
 unsigned long Event::getULong ()
 {
-	unsigned long i = * (unsigned long*) mPos;
-	mPos += sizeof(unsigned long);
-	return i;
+	return getWire<uint32_t> ();
 }
-
 xlong Event::getInt64 ()
 {
-	xlong i = * (xlong*) mPos;
-	mPos += sizeof(xlong);
-	return i;
+	return getWire<uint64_t> ();
 }
 float Event::getFloat ()
 {
-	float f = * (float*) mPos;
-	mPos += sizeof(float);
-	return f;
+	return getWire<float> ();
 }
 double Event::getDouble ()
 {
-	double d = * (double*) mPos;
-	mPos += sizeof(double);
-	return d;
+	return getWire<double> ();
 }
 bool Event::getBool ()
 {
-	bool b = * (bool*) mPos;
-	mPos += sizeof(bool);
-	return b;
+	return getWire<uint8_t> () != 0;
 }
 
+// Length-prefixed reads. A length beyond the payload is a read error.
 std::string Event::getStr ()
 {
-	if ( mPos-mData >= mDataLen ) return "EVENT READ OVERFLOW";
 	int i = getInt ();
-	if ( i > mDataLen ) {
-		dbgprintf ("ERROR: Event string length is corrupt.\n");
-		return "ERROR";
+	if ( i == 0 ) return "";
+	if ( i < 0 || i > mData + mDataLen - mPos ) {
+		readError ();
+		return "";
 	}
-	if ( i > 0 ) {
-		// dbgprintf  ( "  len: %d npos: %d\n", i, (int) (mPos-getData()) );
-		memcpy ( mbuf, mPos, i ); *(mbuf + i) = '\0';
-		mPos += i;
-		if ( mPos >= getData() + mDataLen ) mPos = getData() + mDataLen;
-		return std::string ( mbuf );
-	}
-	return "";
+	std::string str ( mPos, i );
+	mPos += i;
+	return str;
 }
 
 void Event::getStr (char* str)
 {
-	if ( mPos-mData >= mDataLen ) {strcpy(str, "EVENT READ OVERFLOW"); return; }
+	str[0] = '\0';
 	int i = getInt ();
-	if ( i > 0 ) {
-		strncpy ( str, mPos, i ); str[i] = '\0';
-		mPos += i;
-		if ( mPos >= getData() + mDataLen ) mPos = getData() + mDataLen;
+	if ( i == 0 ) return;
+	if ( i < 0 || i > mData + mDataLen - mPos ) {
+		readError ();
+		return;
 	}
+	memcpy ( str, mPos, i ); str[i] = '\0';
+	mPos += i;
 }
 
 void Event::getMem ( char* buf, int maxlen )
 {
 	int len = getInt ();
-	if ( mPos >= getData() + mDataLen ) return;
+	if ( len == 0 ) return;
+	if ( len < 0 || len > mData + mDataLen - mPos ) {
+		readError ();
+		return;
+	}
 	memcpy ( buf, mPos, imin ( len, maxlen ) );
 	mPos += len;
 }
 void Event::getBuf ( char* buf, int len )
 {
-	if ( mPos >= getData() + mDataLen ) return;
+	if ( len < 0 || len > mData + mDataLen - mPos ) {
+		readError ();
+		return;
+	}
 	memcpy ( buf, mPos, len );
 	mPos += len;
 }
 
 void Event::getBufAtPos ( int pos, char* buf, int len )
 {
+	if ( pos < 0 || len < 0 || pos + len > mDataLen ) {
+		readError ();
+		return;
+	}
 	memcpy ( buf, getData() + pos, len ) ;
 }
 
+//---- Compact numeric encodings
+
+static inline uint64_t zigzag_enc ( int64_t v )		{ return ( (uint64_t) v << 1 ) ^ (uint64_t) ( v >> 63 ); }
+static inline int64_t zigzag_dec ( uint64_t z )		{ return (int64_t) ( z >> 1 ) ^ -(int64_t) ( z & 1 ); }
+
+// Write LEB128 at p, which must have 10 bytes free. Returns bytes written.
+static inline int varint_put ( char* p, uint64_t v )
+{
+	int n = 0;
+	while ( v >= 0x80 ) {
+		p[n++] = (char) ( v | 0x80 );
+		v >>= 7;
+	}
+	p[n++] = (char) v;
+	return n;
+}
+
+// Read LEB128, advancing p. False if truncated or longer than 10 bytes.
+static inline bool varint_get ( const char*& p, const char* end, uint64_t& v )
+{
+	v = 0;
+	for ( int shift = 0; p < end && shift < 64; shift += 7 ) {
+		uint8_t b = (uint8_t) *p++;
+		v |= (uint64_t) ( b & 0x7F ) << shift;
+		if ( ( b & 0x80 ) == 0 ) return true;
+	}
+	return false;
+}
+
+static inline int quant_bytes ( int bits )			{ return ( bits <= 8 ) ? 1 : ( bits <= 16 ) ? 2 : 4; }
+static inline double quant_levels ( int bits )		{ return (double) ( ( (uint64_t) 1 << bits ) - 1 ); }
+
+// Clamps bits to 1..32. False if [vmin,vmax] is empty or not finite; values then encode as 0 and decode as vmin.
+static inline bool quant_check ( float vmin, float vmax, int& bits )
+{
+	bits = ( bits < 1 ) ? 1 : ( bits > 32 ) ? 32 : bits;
+	if ( vmax > vmin && std::isfinite ( (double) vmax - vmin ) ) return true;
+	dbgprintf ( "ERROR: Quantized range [%f,%f] is empty or not finite.\n", vmin, vmax );
+	return false;
+}
+
+static inline uint32_t quant_enc ( float v, float vmin, float vmax, double scale, double levels )
+{
+	if ( !( v > vmin ) ) return 0;					// also NaN
+	if ( v >= vmax ) return (uint32_t) levels;
+	double q = ( (double) v - vmin ) * scale + 0.5;
+	return ( q < levels ) ? (uint32_t) q : (uint32_t) levels;
+}
+
+void Event::attachUVarint ( uint64_t v )
+{
+	if ( mDataLen + 10 > mMax ) expand ( imax ( mMax*2, mDataLen + 10 ) );
+	int n = varint_put ( mPos, v );
+	mPos += n;
+	mDataLen += n;
+}
+void Event::attachVarint ( int64_t v )
+{
+	attachUVarint ( zigzag_enc ( v ) );
+}
+
+uint64_t Event::getUVarint ()
+{
+	uint64_t v;
+	const char* p = mPos;
+	if ( !varint_get ( p, mData + mDataLen, v ) ) {
+		readError ();
+		return 0;
+	}
+	mPos = (char*) p;
+	return v;
+}
+int64_t Event::getVarint ()
+{
+	return zigzag_dec ( getUVarint () );
+}
+
+void Event::attachDeltaArray ( const int* v, int count )
+{
+	int worst = 10 + count * 5;							// 32-bit deltas take at most 5 bytes
+	if ( mDataLen + worst > mMax ) expand ( imax ( mMax*2, mDataLen + worst ) );
+	char* p = mPos;
+	p += varint_put ( p, (uint64_t) count );
+	int prev = 0;
+	for ( int n = 0; n < count; n++ ) {
+		int d = (int) ( (uint32_t) v[n] - (uint32_t) prev );		// wraps, decoder wraps the same way
+		p += varint_put ( p, zigzag_enc ( d ) );
+		prev = v[n];
+	}
+	mDataLen += int ( p - mPos );
+	mPos = p;
+}
+
+int Event::getDeltaArray ( int* out, int max )
+{
+	const char* p = mPos;
+	const char* end = mData + mDataLen;
+	uint64_t count, z;
+	if ( !varint_get ( p, end, count ) || count > (uint64_t) max || count > (uint64_t) ( end - p ) ) {
+		readError ();
+		return 0;
+	}
+	int num = (int) count;
+	int prev = 0;
+	int n = 0;
+	while ( n < num ) {
+		#ifdef EVENT_SSE2
+			// 16 deltas in -64..63 are 16 bytes with no continuation bit.
+			// Zigzag decode bytes, widen to 32-bit and prefix sum four lanes at a time.
+			if ( num - n >= 16 && end - p >= 16 ) {
+				__m128i b = _mm_loadu_si128 ( (const __m128i*) p );
+				if ( _mm_movemask_epi8 ( b ) == 0 ) {
+					__m128i zero = _mm_setzero_si128 ();
+					__m128i half = _mm_and_si128 ( _mm_srli_epi16 ( b, 1 ), _mm_set1_epi8 ( 0x7F ) );
+					__m128i neg = _mm_sub_epi8 ( zero, _mm_and_si128 ( b, _mm_set1_epi8 ( 1 ) ) );
+					__m128i d8 = _mm_xor_si128 ( half, neg );
+					__m128i s8 = _mm_cmpgt_epi8 ( zero, d8 );
+					__m128i d16[2] = { _mm_unpacklo_epi8 ( d8, s8 ), _mm_unpackhi_epi8 ( d8, s8 ) };
+					__m128i carry = _mm_set1_epi32 ( prev );
+					for ( int h = 0; h < 2; h++ ) {
+						__m128i s16 = _mm_srai_epi16 ( d16[h], 15 );
+						__m128i d32[2] = { _mm_unpacklo_epi16 ( d16[h], s16 ), _mm_unpackhi_epi16 ( d16[h], s16 ) };
+						for ( int q = 0; q < 2; q++ ) {
+							__m128i x = d32[q];
+							x = _mm_add_epi32 ( x, _mm_slli_si128 ( x, 4 ) );
+							x = _mm_add_epi32 ( x, _mm_slli_si128 ( x, 8 ) );
+							x = _mm_add_epi32 ( x, carry );
+							_mm_storeu_si128 ( (__m128i*) ( out + n ), x );
+							carry = _mm_shuffle_epi32 ( x, 0xFF );
+							n += 4;
+						}
+					}
+					prev = out[ n-1 ];
+					p += 16;
+					continue;
+				}
+			}
+		#endif
+		if ( !varint_get ( p, end, z ) ) {
+			readError ();
+			return 0;
+		}
+		prev = (int) ( (uint32_t) prev + (uint32_t) zigzag_dec ( z ) );
+		out[n++] = prev;
+	}
+	mPos = (char*) p;
+	return num;
+}
+
+void Event::attachQuantized ( float v, float vmin, float vmax, int bits )
+{
+	bool ok = quant_check ( vmin, vmax, bits );
+	double levels = ok ? quant_levels ( bits ) : 0;
+	uint32_t q = quant_enc ( v, vmin, vmax, ok ? levels / ( (double) vmax - vmin ) : 0, levels );
+	switch ( quant_bytes ( bits ) ) {
+	case 1:	attachWire<uint8_t> ( (uint8_t) q );	break;
+	case 2:	attachWire<uint16_t> ( (uint16_t) q );	break;
+	default: attachWire<uint32_t> ( q );			break;
+	}
+}
+
+float Event::getQuantized ( float vmin, float vmax, int bits )
+{
+	bool ok = quant_check ( vmin, vmax, bits );
+	uint32_t q;
+	switch ( quant_bytes ( bits ) ) {
+	case 1:	q = getWire<uint8_t> ();	break;
+	case 2:	q = getWire<uint16_t> ();	break;
+	default: q = getWire<uint32_t> ();	break;
+	}
+	if ( !ok ) return vmin;
+	return (float) ( vmin + q * ( ( (double) vmax - vmin ) / quant_levels ( bits ) ) );
+}
+
+void Event::attachQuantizedArray ( const float* v, int count, float vmin, float vmax, int bits )
+{
+	bool ok = quant_check ( vmin, vmax, bits );
+	int lane = quant_bytes ( bits );
+	int len = (int) sizeof(int) + count * lane;
+	if ( mDataLen + len > mMax ) expand ( imax ( mMax*2, mDataLen + len ) );
+	double levels = ok ? quant_levels ( bits ) : 0;
+	double scale = ok ? levels / ( (double) vmax - vmin ) : 0;
+	char* p = mPos;
+	wirePut<int> ( p, count );
+	p += sizeof(int);
+	for ( int n = 0; n < count; n++, p += lane ) {
+		uint32_t q = quant_enc ( v[n], vmin, vmax, scale, levels );
+		if ( lane == 1 )		*p = (char) q;
+		else if ( lane == 2 )	wirePut<uint16_t> ( p, (uint16_t) q );
+		else					wirePut<uint32_t> ( p, q );
+	}
+	mPos += len;
+	mDataLen += len;
+}
+
+int Event::getQuantizedArray ( float* out, int max, float vmin, float vmax, int bits )
+{
+	bool ok = quant_check ( vmin, vmax, bits );
+	int lane = quant_bytes ( bits );
+	const char* end = mData + mDataLen;
+	if ( mPos + sizeof(int) > end ) { readError (); return 0; }
+	int count = wireGet<int> ( mPos );
+	const char* p = mPos + sizeof(int);
+	if ( count < 0 || count > max || count > ( end - p ) / lane ) { readError (); return 0; }
+
+	double dstep = ok ? ( (double) vmax - vmin ) / quant_levels ( bits ) : 0;
+	float step = (float) dstep;
+	int n = 0;
+	#if defined(EVENT_SSE2) && !defined(EVENT_BIG_ENDIAN)
+		// 8 and 16-bit lanes: widen to 32-bit, convert and scale 8 values at a time
+		if ( lane <= 2 ) {
+			__m128i zero = _mm_setzero_si128 ();
+			__m128 vstep = _mm_set1_ps ( step );
+			__m128 vbase = _mm_set1_ps ( vmin );
+			for ( ; n + 8 <= count; n += 8 ) {
+				__m128i w = ( lane == 1 ) ? _mm_unpacklo_epi8 ( _mm_loadl_epi64 ( (const __m128i*) ( p + n ) ), zero )
+										  : _mm_loadu_si128 ( (const __m128i*) ( p + n*2 ) );
+				__m128 lo = _mm_cvtepi32_ps ( _mm_unpacklo_epi16 ( w, zero ) );
+				__m128 hi = _mm_cvtepi32_ps ( _mm_unpackhi_epi16 ( w, zero ) );
+				_mm_storeu_ps ( out + n, _mm_add_ps ( _mm_mul_ps ( lo, vstep ), vbase ) );
+				_mm_storeu_ps ( out + n + 4, _mm_add_ps ( _mm_mul_ps ( hi, vstep ), vbase ) );
+			}
+		}
+	#endif
+	for ( ; n < count; n++ ) {
+		const char* q = p + n * lane;
+		uint32_t v = ( lane == 1 ) ? (uint8_t) *q : ( lane == 2 ) ? wireGet<uint16_t> ( q ) : wireGet<uint32_t> ( q );
+		out[n] = ( lane == 4 ) ? (float) ( vmin + v * dstep ) : vmin + v * step;
+	}
+	mPos = (char*) p + count * lane;
+	return count;
+}
+
 void Event::startRead ()
 {
 	mPos = mData;
+	bReadErr = false;
 }
 void Event::startWrite ()
 {
 	mPos = mData;
 	mDataLen = 0;
+	bReadErr = false;
 }
 
 std::string	Event::getNameStr ()
@@ -606,7 +813,15 @@ char* Event::serialize ()
 	char* serial_data = mData - Event::staticSerializedHeaderSize();
 
 	// transfer current serialized header values into payload area
-	memcpy ( serial_data, header, Event::staticSerializedHeaderSize() );
+	#ifdef EVENT_BIG_ENDIAN
+		wirePut ( serial_data, mDataLen );
+		wirePut ( serial_data + 4, mName );
+		wirePut ( serial_data + 8, mTarget );
+		wirePut ( serial_data + 12, mCID );
+		wirePut ( serial_data + 16, mTimeStamp.GetSJT() );
+	#else
+		memcpy ( serial_data, header, Event::staticSerializedHeaderSize() );
+	#endif
 
 	// data is now complete. attachments in payload are already serialized
 
@@ -625,7 +840,13 @@ void Event::deserialize (char* buf, int serial_len )
 	memcpy ( mData - hsz, buf, serial_len );
 
 	// Transfer serialized header into Event pointer (not the same as mData pointer)
-	memcpy ( (char*) this + Event::staticOffsetLenInfo(), buf, hsz );
+	#ifdef EVENT_BIG_ENDIAN
+		mName = wireGet<eventStr_t> ( buf + 4 );
+		mTarget = wireGet<eventStr_t> ( buf + 8 );
+		mTimeStamp.SetSJT ( wireGet<sjtime> ( buf + 16 ) );
+	#else
+		memcpy ( (char*) this + Event::staticOffsetLenInfo(), buf, hsz );
+	#endif
 
 	// Update payload length and read/write pos
 	mDataLen = serial_len - hsz;
@@ -634,6 +855,64 @@ void Event::deserialize (char* buf, int serial_len )
 	mCID = cid;			// restore cid
 }
 
+// Write the compact header directly before the payload. Returns its start; len is header + payload.
+char* Event::serializeCompact ( int& len, uchar flags )
+{
+	sjtime t = mTimeStamp.GetSJT();
+	if ( mTarget != 'app ' )	flags |= EVENT_CH_TARGET;
+	if ( t != 0 )				flags |= EVENT_CH_TIME;
+
+	char hdr[ EVENT_COMPACT_MAX ];
+	int n = 0;
+	hdr[ n++ ] = (char) flags;
+	n += varint_put ( hdr + n, (uint32_t) mDataLen );
+	wirePut ( hdr + n, mName );					n += sizeof(eventStr_t);
+	if ( flags & EVENT_CH_TARGET ) {	wirePut ( hdr + n, mTarget );	n += sizeof(eventStr_t); }
+	if ( flags & EVENT_CH_TIME ) {		wirePut ( hdr + n, t );			n += sizeof(sjtime); }
+
+	char* serial_data = mData - n;
+	memcpy ( serial_data, hdr, n );
+	len = n + mDataLen;
+	return serial_data;
+}
+
+// Parse a compact header. Needs only the bytes received so far.
+int Event::staticCompactHeader ( const char* buf, int avail, int& data_len )
+{
+	if ( avail < 2 ) return 0;
+	uchar flags = (uchar) buf[0];
+	const char* p = buf + 1;
+	const char* end = buf + ( avail < EVENT_COMPACT_MAX ? avail : EVENT_COMPACT_MAX );
+	uint64_t v;
+	if ( !varint_get ( p, end, v ) ) {
+		return ( p - buf > 5 ) ? -1 : 0;			// 32-bit lengths take at most 5 bytes
+	}
+	if ( v > 0x3FFFFFFF ) return -1;
+	int hdr_len = int( p - buf ) + sizeof(eventStr_t);
+	if ( flags & EVENT_CH_TARGET )	hdr_len += sizeof(eventStr_t);
+	if ( flags & EVENT_CH_TIME )	hdr_len += sizeof(sjtime);
+	if ( avail < hdr_len ) return 0;
+	data_len = (int) v;
+	return hdr_len;
+}
+
+// Payload is copied once into mData. Header fields are read in place.
+void Event::deserializeCompact ( char* buf, int hdr_len, int data_len )
+{
+	uchar flags = (uchar) buf[0];
+	char* p = buf + hdr_len;
+	if ( flags & EVENT_CH_TIME ) {		p -= sizeof(sjtime);		mTimeStamp.SetSJT ( wireGet<sjtime> ( p ) ); }
+	else								mTimeStamp.SetSJT ( 0 );
+	if ( flags & EVENT_CH_TARGET ) {	p -= sizeof(eventStr_t);	mTarget = wireGet<eventStr_t> ( p ); }
+	else								mTarget = 'app ';
+	p -= sizeof(eventStr_t);
+	mName = wireGet<eventStr_t> ( p );
+
+	memcpy ( mData, buf + hdr_len, data_len );
+	mDataLen = data_len;
+	mPos = mData + mDataLen;
+}
+
 void Event::setTime ( unsigned long t )
 {
 	mTimeStamp.SetSJT ( t );
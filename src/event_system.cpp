@@ -22,8 +22,8 @@
 #include <cmath>
 #include <stdio.h>
 
-int event_alloc = 0;
-int event_free = 0;
+std::atomic<int> event_alloc ( 0 );		// atomic, as shared events may be freed on any thread
+std::atomic<int> event_free ( 0 );
 #ifdef DEBUG_EVENT_MEM
 	vecTrack_t event_tracks;
 #endif
@@ -84,6 +84,7 @@ void new_event ( Event& p, size_t size, eventStr_t targ, eventStr_t name, eventS
 	p.mTarget = targ;
 	p.mName = name;
 	p.mDataLen = 0;
+	p.mCallID = 0;
 	p.mCID = event_alloc;			// creation ID
 	
 	// reuse payload
@@ -172,7 +173,7 @@ void free_event_data ( char*& data, EventPool* pool, eventStr_t name, int cid, c
 		}
 		std::string tag = std::to_string(cid) + ":" + nameToStr(name);
 		event_tracks.push_back ( eventTrack(tag,msg) );
-		printf ( "%p: +%s, %d/%d +%d, %s\n", data, tag.c_str(), event_alloc, event_free, event_alloc-event_free, msg );			
+		printf ( "%p: +%s, %d/%d +%d, %s\n", data, tag.c_str(), event_alloc.load(), event_free.load(), event_alloc-event_free, msg );			
 	}
 
 	void emem_track_free ( char* data, int cid, eventStr_t name, const char* msg ) 
@@ -185,7 +186,7 @@ void free_event_data ( char*& data, EventPool* pool, eventStr_t name, int cid, c
 		if ( found >= 0 ) {
 			event_tracks.erase ( event_tracks.begin() + found );		// remove from list
 		}
-		printf ( "%p: -%s, %d/%d +%d, %s\n", data, tag.c_str(), event_alloc, event_free, event_alloc-event_free, msg );					
+		printf ( "%p: -%s, %d/%d +%d, %s\n", data, tag.c_str(), event_alloc.load(), event_free.load(), event_alloc-event_free, msg );					
 	}
 
 	void emem_rename ( Event& e, eventStr_t oldname, eventStr_t newname, const char* msg )
@@ -293,6 +294,89 @@ void EventQueue::trace ()
 }
 
 
+//---------------------------------------------- Shared Event
+
+SharedEvent::SharedEvent ( Event& e )
+{
+	mBlock = new SharedEventBlock;
+	mBlock->refs = 1;
+	Event& d = mBlock->event;
+	d.acquire ( e );
+
+	// Move pooled payloads to the heap and reserve room for the trailers netSend
+	// appends, so a shared payload is never freed into a pool or reallocated.
+	if ( d.mData != 0x0 && ( d.mOwner != 0x0 || d.mMax < d.mDataLen + SHARED_EVENT_TRAILER ) ) {
+		int max;
+		char* data = new_event_data ( d.mDataLen + SHARED_EVENT_TRAILER, max, 0x0, d.mName, "share" );
+		memcpy ( data, d.mData, d.mDataLen );
+		free_event_data ( d.mData, d.mOwner, d.mName, d.mCID, "share" );
+		d.mData = data;
+		d.mMax = max;
+		d.mOwner = 0x0;
+	}
+	d.mPos = d.mData;
+	d.bOwn = true;
+	d.bDestroy = true;
+}
+
+SharedEvent::SharedEvent ( const SharedEvent& src ) : mBlock ( src.mBlock )
+{
+	if ( mBlock ) mBlock->refs.fetch_add ( 1, std::memory_order_relaxed );
+}
+
+SharedEvent& SharedEvent::operator= ( const SharedEvent& src )
+{
+	if ( src.mBlock ) src.mBlock->refs.fetch_add ( 1, std::memory_order_relaxed );
+	reset ();
+	mBlock = src.mBlock;
+	return *this;
+}
+
+SharedEvent& SharedEvent::operator= ( SharedEvent&& src )
+{
+	if ( this != &src ) {
+		reset ();
+		mBlock = src.mBlock;
+		src.mBlock = 0x0;
+	}
+	return *this;
+}
+
+// Last handle frees the event, on whichever thread drops it
+void SharedEvent::reset ()
+{
+	if ( mBlock && mBlock->refs.fetch_sub ( 1, std::memory_order_acq_rel ) == 1 ) {
+		delete mBlock;
+	}
+	mBlock = 0x0;
+}
+
+void SharedEvent::getReader ( Event& e ) const
+{
+	if ( e.bOwn && e.mData != 0x0 ) {
+		free_event_data ( e.mData, e.mOwner, e.mName, e.mCID, "~view" );
+	}
+	e.copyEventVars ( &e, &mBlock->event );
+	e.mPos = e.mData;
+	e.bOwn = false;							// view only, never frees or expands shared data
+	e.bDestroy = false;
+	e.bReadErr = false;
+}
+
+Event& SharedEvent::getWritable ()
+{
+	// A count of 1 means no other handle exists, and none can appear except through this one
+	if ( mBlock->refs.load ( std::memory_order_acquire ) > 1 ) {
+		SharedEventBlock* b = new SharedEventBlock;
+		b->refs = 1;
+		b->event.copy ( mBlock->event );
+		reset ();
+		mBlock = b;
+	}
+	return mBlock->event;
+}
+
+
 #ifdef BUILD_EVENT_POOLING
 
 //------------------------------------------- EVENT POOLING [optional]
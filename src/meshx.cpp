@@ -95,9 +95,7 @@ void MeshX::ComputeNormals (bool flat)
 	}
 
 	// Clear vertex normals	
-	for (vn = (Vec3F*) GetStart(BVERTNORM); vn <= (Vec3F*) GetEnd(BVERTNORM); vn++) {
-		vn->x = 0; vn->y = 0; vn->z = 0;
-	}
+	FillBuffer ( BVERTNORM, 0 );
 
 	// Compute normals of all faces
 	if (flat) {
@@ -113,8 +111,6 @@ void MeshX::ComputeNormals (bool flat)
 	} else {
 		// Smoothed normals
 
-		int n=0;		
-		Vec3F* vertbuf  = (Vec3F*) GetBufData(BVERTPOS);	// efficiency, stride not needed
 		Vec3F* vnormbuf = (Vec3F*) GetBufData(BVERTNORM);	// efficiency, stride not needed
 
 		// overall slow function due to scattered reads & writes 
@@ -143,35 +139,28 @@ void MeshX::ComputeNormals (bool flat)
 		}
 
 		// Normalize vertex normals
-		Vec3F vec;
-		for (vn = (Vec3F*) GetStart(BVERTNORM); vn <= (Vec3F*) GetEnd(BVERTNORM); vn++) 
-			vn->Normalize ();
+		ForEachRange ( BVERTNORM, [vnormbuf] ( uint64_t begin, uint64_t end ) {
+			for (uint64_t n = begin; n < end; n++)
+				vnormbuf[n].Normalize ();
+		} );
 	}	
 }
 
 void MeshX::FlipNormals ()
 {
-	Vec3F* vn;	
-	for (vn = (Vec3F*) GetStart(BVERTNORM); vn <= (Vec3F*) GetEnd(BVERTNORM); vn++) 
-		*vn *= -1.0f;
+	Vec3F* vnormbuf = (Vec3F*) GetBufData(BVERTNORM);
+	ForEachRange ( BVERTNORM, [vnormbuf] ( uint64_t begin, uint64_t end ) {
+		for (uint64_t n = begin; n < end; n++)
+			vnormbuf[n] *= -1.0f;
+	} );
 }
 
 void MeshX::ComputeBounds (Vec3F& bmin, Vec3F& bmax, int vmin, int vmax)
 {
 	if (vmax == 0) vmax = GetNumVert() - 1;
 
-	Vec3F* v1 = GetVertPos ( vmin );
-	bmin = *v1; bmax = *v1;
-	
-	for (int n=vmin+1; n <= vmax; n++) {
-		v1 = GetVertPos ( n );
-		if ( v1->x < bmin.x ) bmin.x = v1->x;
-		if ( v1->y < bmin.y ) bmin.y = v1->y;
-		if ( v1->z < bmin.z ) bmin.z = v1->z;
-		if ( v1->x > bmax.x ) bmax.x = v1->x;
-		if ( v1->y > bmax.y ) bmax.y = v1->y;
-		if ( v1->z > bmax.z ) bmax.z = v1->z;		
-	}
+	Vec3F sum;
+	ReduceF3 ( BVERTPOS, bmin, bmax, sum, vmin, vmax );
 }
 
 Vec3F MeshX::NormalizeMesh ( float sz, Vec3F& ctr, int vmin, int vmax )
@@ -187,13 +176,16 @@ Vec3F MeshX::NormalizeMesh ( float sz, Vec3F& ctr, int vmin, int vmax )
 	ctr = (bmin + bmax) * Vec3F(0.5f,0.5f,0.5f);
 	
 	// Compute new vertex positions		
-	Vec3F* v = GetVertPos(vmin);
-	for (int n=vmin; n <= vmax; n++) {
+	Vec3F* vertbuf = (Vec3F*) GetBufData(BVERTPOS);
+	ForEachRange ( BVERTPOS, [&] ( uint64_t begin, uint64_t end ) {
+		Vec3F* v = vertbuf + begin;
+		for (uint64_t n = begin; n < end; n++) {
 																// v = range [bmin,bmax] - input mesh 
-		*v = ((*v)*sz - bmin) / (bmax-bmin);					// v'= range [0, 1] - normalize mesh
-		*v = *v * Vec3F(2,2,2) + Vec3F(-1,-1,-1);		// o = range [-1,1] - output range, all shapes have this range
-		v++;
-	}
+			*v = ((*v)*sz - bmin) / (bmax-bmin);				// v'= range [0, 1] - normalize mesh
+			*v = *v * Vec3F(2,2,2) + Vec3F(-1,-1,-1);			// o = range [-1,1] - output range, all shapes have this range
+			v++;
+		}
+	}, vmin, vmax );
 	return (bmax - bmin)*0.5f;
 }
 
@@ -290,7 +282,7 @@ void MeshX::Smooth ( int iter )
 			flist = GetVertFList ( n );
 			vec.Set (0,0,0);
 			hval* fptr = GetHeap() + flist->pos;
-			for (int j=0; j < flist->cnt; j++) {	// loop over neighboring faces of vertex
+			for (uint j=0; j < flist->cnt; j++) {	// loop over neighboring faces of vertex
 				vec.x += face_pos[ (*fptr) ].x;
 				vec.y += face_pos[ (*fptr) ].y;
 				vec.z += face_pos[ (*fptr) ].z;
@@ -563,7 +555,7 @@ xref MeshX::AddVertFVF ( float x, float y, float z )
 void MeshX::DebugFVF ()
 {
 	int n;
-	int j;	
+	uint j;	
 	Vec3F* v;
 	AttrV3* f;
 	hList* flist;
@@ -572,7 +564,7 @@ void MeshX::DebugFVF ()
 	for (n=0; n < GetNumVert(); n++) {
 		v = GetVertPos ( n );
 		flist = GetVertFList ( n );		
-		printf ( "%d: (%2.1f,%2.1f,%2.1f) f:%d {", n, v->x, v->y, v->z, flist->pos );
+		printf ( "%d: (%2.1f,%2.1f,%2.1f) f:%lld {", n, v->x, v->y, v->z, (long long) flist->pos );
 		if ( flist->cnt > 0 ) {
 			for (j=0; j < flist->cnt; j++) 
 				printf ( "%d ", *(GetHeap() + flist->pos+j) - FACE_DELTA );
@@ -698,7 +690,7 @@ xref MeshX::AddEdgeCM ( xref v1, xref v2, xref face )
 void MeshX::DebugCM ()
 {
 	int n;
-	int j;	
+	uint j;	
 	Vec3F* v; 
 	hList *elist, *flist;
 	AttrEdge* e; 
@@ -711,12 +703,12 @@ void MeshX::DebugCM ()
 		v = GetVertPos ( n );
 		elist = GetVertEList ( n );
 		flist = GetVertFList ( n );
-		printf ( "%d: (%2.1f,%2.1f,%2.1f) e:%d {", n, v->x, v->y, v->z, elist->pos );
+		printf ( "%d: (%2.1f,%2.1f,%2.1f) e:%lld {", n, v->x, v->y, v->z, (long long) elist->pos );
 		if ( elist->cnt > 0 ) { 
 			for (j=0; j < elist->cnt; j++) 
 				printf ( "%d ", *(GetHeap()+ elist->pos+j) - EDGE_DELTA );
 		}
-		printf ( "}, f:%d {", flist->pos );
+		printf ( "}, f:%lld {", (long long) flist->pos );
 		if ( flist->cnt > 0 ) {
 			for (j=0; j < flist->cnt; j++) 
 				printf ( "%d ", *(GetHeap()+ flist->pos+j) - FACE_DELTA );
@@ -777,8 +769,8 @@ void MeshX::DebugHeap ()
 void MeshX::Measure ()
 {	
 	hval* pHeap = GetHeap ();
-	hval* pCurr = GetHeap() + GetHeapFree();	
-	int vs, es, fs, hs, hm, as, frees = 0;
+	int vs, es, fs;
+	xlong hs, hm, as, frees = 0;
 	vs = GetNumVert(); if ( vs != 0 ) vs *= GetBufStride( BVERTPOS) * GetNumElem(BVERTPOS);
 	es = GetNumEdge(); if ( es != 0 ) es *= GetBufStride( BEDGES ) * GetNumElem(BEDGES);
 	fs = GetNumFace3(); if ( fs != 0 ) fs *= GetBufStride( BFACEV3 ) * GetNumElem(BFACEV3);
@@ -786,11 +778,7 @@ void MeshX::Measure ()
 	hm = GetHeapMax() * sizeof(hval);
 	
 	if ( pHeap != 0x0 ) {
-		while ( pCurr != pHeap-1 ) {
-			frees += *(pCurr);
-			pCurr = pHeap + * (hpos*) (pCurr + HEAP_POS);
-		}
-		frees *= sizeof(hval);
+		frees = GetHeapFree() * sizeof(hval);
 	} else {
 		frees = 0;
 		hm = 1;
@@ -804,7 +792,7 @@ void MeshX::Measure ()
 	printf ( "NumVert:     %07.1fk (%d)\n", vs/1024.0, GetNumVert() );
 	printf ( "NumFace:     %07.1fk (%d)\n", fs/1024.0, GetNumFace3() );
 	printf ( "NumEdge:     %07.1fk (%d)\n", es/1024.0, GetNumEdge() );
-	printf ( "Heap Size:   %07.1fk (%d)\n", hs/1024.0, GetHeapNum() );
+	printf ( "Heap Size:   %07.1fk (%lld)\n", hs/1024.0, (long long) GetHeapNum() );
 	printf ( "Free Size:   %07.1fk\n", frees/1024.0 );
 	printf ( "Heap Used:   %07.1fk (%5.1f%%)\n", (hs-frees)/1024.0, (hs-frees)*100.0/(vs+es+fs+hs-frees) );
 	printf ( "Heap Max:    %07.1fk\n", hm/1024.0 );	
@@ -0,0 +1,342 @@
+//----------------------------------------------------------------------------------------------------------------------
+//
+// Network Metrics Endpoint
+// Quanta Sciences, Rama Hoetzlein (c) 2007-2020
+//
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef BUILD_METRICS
+
+#include "httplib.h"				// before network headers, for winsock ordering
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <chrono>
+
+#include "net_metrics.h"
+#include "event_system.h"
+
+extern std::atomic<int> event_alloc;
+extern std::atomic<int> event_free;
+
+static xlong metrics_msec ()
+{
+	return (xlong) std::chrono::duration_cast<std::chrono::milliseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count ();
+}
+
+// Quote and escape for JSON strings and Prometheus label values
+static std::string metrics_quote ( const char* s )
+{
+	std::string out = "\"";
+	for ( ; *s; s++ ) {
+		if ( *s == '"' || *s == '\\' )	{ out += '\\'; out += *s; }
+		else if ( *s == '\n' )			out += "\\n";
+		else if ( (unsigned char) *s >= 0x20 ) out += *s;
+	}
+	return out + "\"";
+}
+
+static void metrics_printf ( std::string& out, const char* fmt, ... )
+{
+	char buf[ 512 ];
+	va_list args;
+	va_start ( args, fmt );
+	vsnprintf ( buf, sizeof ( buf ), fmt, args );
+	va_end ( args );
+	out += buf;
+}
+
+NetMetrics::NetMetrics ()
+{
+	for ( int n = 0; n < 3; n++ ) mSlot[ n ].seq.store ( 0 );
+	mLatest.store ( -1 );
+	mPublishTime.store ( 0 );
+	mPublishes = 0;
+	mLastPublish = 0;
+	mPublishMs = 100;
+	mStaleMs = 5000;
+	mNumNet = 0;
+	mNumPool = 0;
+	mServer = 0;
+}
+
+NetMetrics::~NetMetrics ()
+{
+	Stop ();
+}
+
+void NetMetrics::addNetwork ( NetworkSystem* net, const char* name )
+{
+	if ( mNumNet >= METRICS_MAX_NET ) return;
+	mNet[ mNumNet ] = net;
+	strncpy ( mNetName[ mNumNet ], name, METRICS_NAME_LEN-1 );
+	mNetName[ mNumNet ][ METRICS_NAME_LEN-1 ] = '\0';
+	mNumNet++;
+}
+
+void NetMetrics::addPool ( EventPool* pool, const char* name )
+{
+	if ( mNumPool >= METRICS_MAX_POOL || pool == 0 ) return;
+	mPool[ mNumPool ] = pool;
+	strncpy ( mPoolName[ mNumPool ], name, METRICS_NAME_LEN-1 );
+	mPoolName[ mNumPool ][ METRICS_NAME_LEN-1 ] = '\0';
+	mNumPool++;
+}
+
+// Copy counters into the slot after the latest. Readers of the latest slot are unaffected.
+void NetMetrics::Publish ( bool force )
+{
+	xlong now = metrics_msec ();
+	if ( !force && mPublishes > 0 && now - mLastPublish < (xlong) mPublishMs ) return;
+	mLastPublish = now;
+
+	int w = ( mLatest.load ( std::memory_order_relaxed ) + 1 ) % 3;
+	Slot& slot = mSlot[ w ];
+	uint32_t seq = slot.seq.load ( std::memory_order_relaxed );
+	slot.seq.store ( seq + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence ( std::memory_order_release );
+
+	MetricsSnapshot& s = slot.snap;
+	s.publishes = ++mPublishes;
+	s.time = now;
+	s.numNet = mNumNet;
+	for ( int n = 0; n < mNumNet; n++ ) {
+		memcpy ( s.netName[ n ], mNetName[ n ], METRICS_NAME_LEN );
+		mNet[ n ]->netGetStats ( s.net[ n ] );
+	}
+	s.numPool = mNumPool;
+	for ( int n = 0; n < mNumPool; n++ ) {
+		memcpy ( s.poolName[ n ], mPoolName[ n ], METRICS_NAME_LEN );
+		s.poolBins[ n ] = 0;
+		#ifdef BUILD_EVENT_POOLING
+			EventPool* pool = mPool[ n ];
+			s.poolBins[ n ] = ( pool->getNumBins () < METRICS_POOL_BINS ) ? pool->getNumBins () : METRICS_POOL_BINS;
+			for ( int b = 0; b < s.poolBins[ n ]; b++ ) {
+				s.poolWidth[ n ][ b ] = pool->getBinWidth ( b );
+				s.poolAlloc[ n ][ b ] = pool->getAllocated ( b );
+			}
+		#endif
+	}
+	s.eventAlloc = event_alloc;
+	s.eventFree = event_free;
+	s.numPerf = PERF_GET_STATS ( s.perf, PERF_STAT_MAX );
+
+	slot.seq.store ( seq + 2, std::memory_order_release );
+	mLatest.store ( w, std::memory_order_release );
+	mPublishTime.store ( now, std::memory_order_relaxed );
+}
+
+// Copy the latest snapshot. Retries if the publisher reused the slot during the copy.
+bool NetMetrics::getSnapshot ( MetricsSnapshot& out )
+{
+	for ( int tries = 0; tries < 100; tries++ ) {
+		int r = mLatest.load ( std::memory_order_acquire );
+		if ( r < 0 ) return false;
+		Slot& slot = mSlot[ r ];
+		uint32_t seq = slot.seq.load ( std::memory_order_acquire );
+		if ( seq & 1 ) continue;
+		memcpy ( (void*) &out, (const void*) &slot.snap, sizeof ( MetricsSnapshot ) );
+		std::atomic_thread_fence ( std::memory_order_acquire );
+		if ( slot.seq.load ( std::memory_order_relaxed ) == seq ) return true;
+	}
+	return false;
+}
+
+std::string NetMetrics::getPrometheus ()
+{
+	std::string out;
+	MetricsSnapshot* s = new MetricsSnapshot;
+	if ( !getSnapshot ( *s ) ) {
+		delete s;
+		return out;
+	}
+	struct { const char* name; const char* type; const char* help; } fam[] = {
+		{ "libmin_net_sockets",					"gauge",	"Socket slots in use" },
+		{ "libmin_net_connected",				"gauge",	"Connected sockets" },
+		{ "libmin_net_queued_events",			"gauge",	"Events awaiting processing" },
+		{ "libmin_net_calls_pending",			"gauge",	"Calls in flight" },
+		{ "libmin_net_rx_bytes_total",			"counter",	"Bytes received" },
+		{ "libmin_net_tx_bytes_total",			"counter",	"Bytes sent" },
+		{ "libmin_net_rx_events_total",			"counter",	"Events received" },
+		{ "libmin_net_tx_events_total",			"counter",	"Events sent" },
+		{ "libmin_net_rx_limited_total",		"counter",	"Receives deferred by rate limits" },
+		{ "libmin_net_tx_limited_total",		"counter",	"Sends refused by rate limits" },
+		{ "libmin_net_checksum_errors_total",	"counter",	"Events dropped on CRC mismatch" },
+		{ "libmin_net_fairness",				"gauge",	"Jain's index of bytes received per socket" },
+	};
+	for ( int f = 0; f < 12; f++ ) {
+		metrics_printf ( out, "# HELP %s %s\n# TYPE %s %s\n", fam[ f ].name, fam[ f ].help, fam[ f ].name, fam[ f ].type );
+		for ( int n = 0; n < s->numNet; n++ ) {
+			NetStats& st = s->net[ n ];
+			std::string label = "{net=" + metrics_quote ( s->netName[ n ] ) + "}";
+			switch ( f ) {
+			case 0:	metrics_printf ( out, "%s%s %d\n", fam[ f ].name, label.c_str (), st.sockets );		break;
+			case 1:	metrics_printf ( out, "%s%s %d\n", fam[ f ].name, label.c_str (), st.connected );	break;
+			case 2:	metrics_printf ( out, "%s%s %d\n", fam[ f ].name, label.c_str (), st.queued );		break;
+			case 3:	metrics_printf ( out, "%s%s %d\n", fam[ f ].name, label.c_str (), st.callsPending );	break;
+			case 4:	metrics_printf ( out, "%s%s %llu\n", fam[ f ].name, label.c_str (), st.rxBytes );	break;
+			case 5:	metrics_printf ( out, "%s%s %llu\n", fam[ f ].name, label.c_str (), st.txBytes );	break;
+			case 6:	metrics_printf ( out, "%s%s %llu\n", fam[ f ].name, label.c_str (), st.rxEvents );	break;
+			case 7:	metrics_printf ( out, "%s%s %llu\n", fam[ f ].name, label.c_str (), st.txEvents );	break;
+			case 8:	metrics_printf ( out, "%s%s %llu\n", fam[ f ].name, label.c_str (), st.rxLimited );	break;
+			case 9:	metrics_printf ( out, "%s%s %llu\n", fam[ f ].name, label.c_str (), st.txLimited );	break;
+			case 10: metrics_printf ( out, "%s%s %llu\n", fam[ f ].name, label.c_str (), st.checksumErrors ); break;
+			case 11: metrics_printf ( out, "%s%s %f\n", fam[ f ].name, label.c_str (), st.fairness );	break;
+			}
+		}
+	}
+
+	// calls, per method
+	const char* call_fam[] = { "libmin_net_calls_total", "libmin_net_call_replies_total", "libmin_net_call_timeouts_total", "libmin_net_call_closed_total" };
+	for ( int f = 0; f < 4; f++ ) {
+		metrics_printf ( out, "# TYPE %s counter\n", call_fam[ f ] );
+		for ( int n = 0; n < s->numNet; n++ ) {
+			for ( int c = 0; c < s->net[ n ].numCalls; c++ ) {
+				NetStats& st = s->net[ n ];
+				xlong v = ( f == 0 ) ? st.call[ c ].calls : ( f == 1 ) ? st.call[ c ].replies : ( f == 2 ) ? st.call[ c ].timeouts : st.call[ c ].closed;
+				metrics_printf ( out, "%s{net=%s,method=%s} %llu\n", call_fam[ f ], metrics_quote ( s->netName[ n ] ).c_str (),
+								metrics_quote ( nameToStr ( st.call[ c ].name ).c_str () ).c_str (), v );
+			}
+		}
+	}
+	metrics_printf ( out, "# HELP libmin_net_call_latency_usec Call round trip, upper bound of histogram bucket\n# TYPE libmin_net_call_latency_usec summary\n" );
+	for ( int n = 0; n < s->numNet; n++ ) {
+		for ( int c = 0; c < s->net[ n ].numCalls; c++ ) {
+			NetStats& st = s->net[ n ];
+			std::string label = "net=" + metrics_quote ( s->netName[ n ] ) + ",method=" + metrics_quote ( nameToStr ( st.call[ c ].name ).c_str () );
+			metrics_printf ( out, "libmin_net_call_latency_usec{%s,quantile=\"0.5\"} %llu\n", label.c_str (), st.call[ c ].p50Usec );
+			metrics_printf ( out, "libmin_net_call_latency_usec{%s,quantile=\"0.99\"} %llu\n", label.c_str (), st.call[ c ].p99Usec );
+			metrics_printf ( out, "libmin_net_call_latency_usec{%s,quantile=\"1\"} %llu\n", label.c_str (), st.call[ c ].maxUsec );
+			metrics_printf ( out, "libmin_net_call_latency_usec_sum{%s} %llu\n", label.c_str (), st.call[ c ].sumUsec );
+			metrics_printf ( out, "libmin_net_call_latency_usec_count{%s} %llu\n", label.c_str (), st.call[ c ].replies );
+		}
+	}
+
+	// allocators
+	metrics_printf ( out, "# HELP libmin_pool_allocated Items allocated per pool bin\n# TYPE libmin_pool_allocated gauge\n" );
+	for ( int n = 0; n < s->numPool; n++ ) {
+		for ( int b = 0; b < s->poolBins[ n ]; b++ ) {
+			metrics_printf ( out, "libmin_pool_allocated{pool=%s,width=\"%d\"} %d\n", metrics_quote ( s->poolName[ n ] ).c_str (), s->poolWidth[ n ][ b ], s->poolAlloc[ n ][ b ] );
+		}
+	}
+	metrics_printf ( out, "# TYPE libmin_event_alloc_total counter\nlibmin_event_alloc_total %d\n", s->eventAlloc );
+	metrics_printf ( out, "# TYPE libmin_event_free_total counter\nlibmin_event_free_total %d\n", s->eventFree );
+
+	// perf
+	const char* perf_fam[] = { "libmin_perf_count_total", "libmin_perf_msec_total", "libmin_perf_max_msec" };
+	for ( int f = 0; f < 3; f++ ) {
+		metrics_printf ( out, "# TYPE %s %s\n", perf_fam[ f ], ( f == 2 ) ? "gauge" : "counter" );
+		for ( int p = 0; p < s->numPerf; p++ ) {
+			std::string label = metrics_quote ( s->perf[ p ].name );
+			if ( f == 0 )		metrics_printf ( out, "%s{name=%s} %llu\n", perf_fam[ f ], label.c_str (), s->perf[ p ].count );
+			else if ( f == 1 )	metrics_printf ( out, "%s{name=%s} %f\n", perf_fam[ f ], label.c_str (), s->perf[ p ].totalMs );
+			else				metrics_printf ( out, "%s{name=%s} %f\n", perf_fam[ f ], label.c_str (), s->perf[ p ].maxMs );
+		}
+	}
+
+	metrics_printf ( out, "# TYPE libmin_metrics_publishes_total counter\nlibmin_metrics_publishes_total %llu\n", s->publishes );
+	metrics_printf ( out, "# TYPE libmin_metrics_age_seconds gauge\nlibmin_metrics_age_seconds %f\n", ( metrics_msec () - s->time ) / 1000.0 );
+	delete s;
+	return out;
+}
+
+std::string NetMetrics::getJSON ()
+{
+	std::string out;
+	MetricsSnapshot* s = new MetricsSnapshot;
+	if ( !getSnapshot ( *s ) ) {
+		delete s;
+		return "{}";
+	}
+	metrics_printf ( out, "{\"publishes\":%llu,\"age_ms\":%llu,\"net\":{", s->publishes, metrics_msec () - s->time );
+	for ( int n = 0; n < s->numNet; n++ ) {
+		NetStats& st = s->net[ n ];
+		metrics_printf ( out, "%s%s:{\"sockets\":%d,\"connected\":%d,\"queued\":%d,\"calls_pending\":%d,", ( n > 0 ) ? "," : "",
+						metrics_quote ( s->netName[ n ] ).c_str (), st.sockets, st.connected, st.queued, st.callsPending );
+		metrics_printf ( out, "\"rx_bytes\":%llu,\"tx_bytes\":%llu,\"rx_events\":%llu,\"tx_events\":%llu,\"rx_limited\":%llu,\"tx_limited\":%llu,\"checksum_errors\":%llu,\"fairness\":%f,\"calls\":{",
+						st.rxBytes, st.txBytes, st.rxEvents, st.txEvents, st.rxLimited, st.txLimited, st.checksumErrors, st.fairness );
+		for ( int c = 0; c < st.numCalls; c++ ) {
+			metrics_printf ( out, "%s%s:{\"calls\":%llu,\"replies\":%llu,\"timeouts\":%llu,\"closed\":%llu,\"sum_usec\":%llu,\"p50_usec\":%llu,\"p99_usec\":%llu,\"max_usec\":%llu}",
+						( c > 0 ) ? "," : "", metrics_quote ( nameToStr ( st.call[ c ].name ).c_str () ).c_str (), st.call[ c ].calls, st.call[ c ].replies,
+						st.call[ c ].timeouts, st.call[ c ].closed, st.call[ c ].sumUsec, st.call[ c ].p50Usec, st.call[ c ].p99Usec, st.call[ c ].maxUsec );
+		}
+		out += "}}";
+	}
+	out += "},\"pool\":{";
+	for ( int n = 0; n < s->numPool; n++ ) {
+		metrics_printf ( out, "%s%s:[", ( n > 0 ) ? "," : "", metrics_quote ( s->poolName[ n ] ).c_str () );
+		for ( int b = 0; b < s->poolBins[ n ]; b++ ) {
+			metrics_printf ( out, "%s{\"width\":%d,\"allocated\":%d}", ( b > 0 ) ? "," : "", s->poolWidth[ n ][ b ], s->poolAlloc[ n ][ b ] );
+		}
+		out += "]";
+	}
+	metrics_printf ( out, "},\"events\":{\"alloc\":%d,\"free\":%d},\"perf\":{", s->eventAlloc, s->eventFree );
+	for ( int p = 0; p < s->numPerf; p++ ) {
+		metrics_printf ( out, "%s%s:{\"count\":%llu,\"total_ms\":%f,\"max_ms\":%f}", ( p > 0 ) ? "," : "",
+						metrics_quote ( s->perf[ p ].name ).c_str (), s->perf[ p ].count, s->perf[ p ].totalMs, s->perf[ p ].maxMs );
+	}
+	out += "}}\n";
+	delete s;
+	return out;
+}
+
+// Healthy while the event loop keeps publishing.
+std::string NetMetrics::getHealth ( int& status )
+{
+	std::string out;
+	if ( mLatest.load ( std::memory_order_acquire ) < 0 ) {
+		status = 503;
+		return "{\"status\":\"starting\"}\n";
+	}
+	xlong age = metrics_msec () - mPublishTime.load ( std::memory_order_relaxed );
+	status = ( age > (xlong) mStaleMs ) ? 503 : 200;
+	metrics_printf ( out, "{\"status\":\"%s\",\"age_ms\":%llu}\n", ( status == 200 ) ? "ok" : "stale", age );
+	return out;
+}
+
+int NetMetrics::Start ( int port, const char* host )
+{
+	if ( mServer != 0 ) return 0;
+	httplib::Server* svr = new httplib::Server;
+	svr->new_task_queue = [] { return new httplib::ThreadPool ( 1 ); };		// one worker, scrapes are infrequent
+
+	svr->Get ( "/metrics", [this] ( const httplib::Request&, httplib::Response& res ) {
+		res.set_content ( getPrometheus (), "text/plain; version=0.0.4" );
+	});
+	svr->Get ( "/metrics.json", [this] ( const httplib::Request&, httplib::Response& res ) {
+		res.set_content ( getJSON (), "application/json" );
+	});
+	svr->Get ( "/health", [this] ( const httplib::Request&, httplib::Response& res ) {
+		int status;
+		res.set_content ( getHealth ( status ), "application/json" );
+		res.status = status;
+	});
+
+	int bound = port;
+	if ( port == 0 ) {
+		bound = svr->bind_to_any_port ( host );
+	} else if ( !svr->bind_to_port ( host, port ) ) {
+		bound = 0;
+	}
+	if ( bound <= 0 ) {
+		dbgprintf ( "ERROR: Metrics unable to bind %s:%d\n", host, port );
+		delete svr;
+		return 0;
+	}
+	mServer = svr;
+	mThread = std::thread ( [svr] { svr->listen_after_bind (); } );
+	return bound;
+}
+
+void NetMetrics::Stop ()
+{
+	if ( mServer == 0 ) return;
+	httplib::Server* svr = (httplib::Server*) mServer;
+	svr->stop ();
+	if ( mThread.joinable () ) mThread.join ();
+	delete svr;
+	mServer = 0;
+}
+
+#endif
@@ -0,0 +1,225 @@
+//----------------------------------------------------------------------------------------------------------------------
+//
+// Network Binary Trace
+// Quanta Sciences, Rama Hoetzlein (c) 2007-2020
+//
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include "net_trace.h"
+#include "event.h"
+
+// Per-thread ring. Only the owning thread writes records and head.
+// Each slot carries a sequence number: 2h+1 while record h is being
+// written, 2h+2 once complete. Save copies a record only if the slot holds
+// the expected complete sequence before and after the copy, so records
+// being written or overwritten are skipped rather than saved torn.
+// Clear moves a start mark instead of resetting head, so it never writes
+// state another thread owns.
+// Rings stay allocated for the life of the process so that a ring may
+// still be saved after its thread has exited.
+struct NetTraceSlot {
+	std::atomic<uint64_t>	seq;
+	NetTraceRec				rec;
+};
+struct NetTraceRing {
+	std::atomic<uint64_t>	head;						// total records written
+	std::atomic<uint64_t>	start;						// first record to save, set by Clear
+	uint16_t				tid;
+	NetTraceSlot			slot[ NTR_RING_SIZE ];
+};
+
+#define NTR_MAGIC		0x3152544E					// 'NTR1'
+
+struct NetTraceFileHdr {
+	uint32_t	magic;
+	uint32_t	rec_size;
+	uint64_t	count;
+};
+
+std::atomic<bool> NetTrace::m_enabled ( false );
+
+static std::mutex					g_traceLock;
+static std::vector<NetTraceRing*>	g_traceRings;
+static thread_local NetTraceRing*	t_traceRing = 0;
+
+static NetTraceRing* trace_new_ring ()
+{
+	NetTraceRing* r = new NetTraceRing;
+	r->head.store ( 0 );
+	r->start.store ( 0 );
+	for ( int i = 0; i < NTR_RING_SIZE; i++ ) r->slot[ i ].seq.store ( 0 );
+	std::lock_guard<std::mutex> lock ( g_traceLock );
+	r->tid = (uint16_t) g_traceRings.size ();
+	g_traceRings.push_back ( r );
+	t_traceRing = r;
+	return r;
+}
+
+void NetTrace::Record ( int code, uint32_t name, int sock, int len )
+{
+	NetTraceRing* r = t_traceRing;
+	if ( r == 0 ) r = trace_new_ring ();
+
+	uint64_t h = r->head.load ( std::memory_order_relaxed );
+	NetTraceSlot& slot = r->slot[ h & ( NTR_RING_SIZE - 1 ) ];
+	slot.seq.store ( 2*h + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence ( std::memory_order_release );		// odd sequence is visible before the record changes
+	NetTraceRec& rec = slot.rec;
+	rec.time = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds> ( std::chrono::steady_clock::now ().time_since_epoch () ).count ();
+	rec.name = name;
+	rec.sock = sock;
+	rec.len = len;
+	rec.code = (uint16_t) code;
+	rec.tid = r->tid;
+	slot.seq.store ( 2*h + 2, std::memory_order_release );
+	r->head.store ( h + 1, std::memory_order_release );
+}
+
+// Drop the records written so far. Threads may keep recording.
+void NetTrace::Clear ()
+{
+	std::lock_guard<std::mutex> lock ( g_traceLock );
+	for ( int n = 0; n < (int) g_traceRings.size (); n++ ) {
+		NetTraceRing* r = g_traceRings[ n ];
+		r->start.store ( r->head.load ( std::memory_order_acquire ), std::memory_order_relaxed );
+	}
+}
+
+// Write the most recent records of every ring, merged in time order.
+// Threads may keep recording; records they overwrite during the copy are skipped.
+int NetTrace::Save ( const char* fname )
+{
+	std::vector<NetTraceRec> all;
+	{
+		std::lock_guard<std::mutex> lock ( g_traceLock );
+		for ( int n = 0; n < (int) g_traceRings.size (); n++ ) {
+			NetTraceRing* r = g_traceRings[ n ];
+			uint64_t h = r->head.load ( std::memory_order_acquire );
+			uint64_t first = ( h > NTR_RING_SIZE ) ? h - NTR_RING_SIZE : 0;
+			uint64_t start = r->start.load ( std::memory_order_relaxed );
+			if ( first < start ) first = start;
+			for ( uint64_t i = first; i < h; i++ ) {
+				NetTraceSlot& slot = r->slot[ i & ( NTR_RING_SIZE - 1 ) ];
+				if ( slot.seq.load ( std::memory_order_acquire ) != 2*i + 2 ) continue;
+				NetTraceRec rec = slot.rec;
+				std::atomic_thread_fence ( std::memory_order_acquire );	// copy completes before the recheck
+				if ( slot.seq.load ( std::memory_order_relaxed ) != 2*i + 2 ) continue;
+				all.push_back ( rec );
+			}
+		}
+	}
+	std::stable_sort ( all.begin (), all.end (), [] ( const NetTraceRec& a, const NetTraceRec& b ) { return a.time < b.time; } );
+
+	FILE* fp = fopen ( fname, "wb" );
+	if ( fp == 0 ) return -1;
+	NetTraceFileHdr hdr;
+	hdr.magic = NTR_MAGIC;
+	hdr.rec_size = sizeof ( NetTraceRec );
+	hdr.count = all.size ();
+	fwrite ( &hdr, sizeof ( hdr ), 1, fp );
+	if ( all.size () > 0 ) {
+		fwrite ( &all[ 0 ], sizeof ( NetTraceRec ), all.size (), fp );
+	}
+	fclose ( fp );
+	return (int) all.size ();
+}
+
+const char* NetTrace::getCodeName ( int code )
+{
+	switch ( code ) {
+	case NTR_RECV:			return "RECV";
+	case NTR_RX_PARTIAL:	return "RX_PARTIAL";
+	case NTR_RX_EVENT:		return "RX_EVENT";
+	case NTR_RX_DROP:		return "RX_DROP";
+	case NTR_RECV_ERROR:	return "RECV_ERROR";
+	case NTR_TX_EVENT:		return "TX_EVENT";
+	case NTR_TX_PARTIAL:	return "TX_PARTIAL";
+	case NTR_TX_RESIDUAL:	return "TX_RESIDUAL";
+	case NTR_TX_FAIL:		return "TX_FAIL";
+	}
+	return ( code >= NTR_USER ) ? "USER" : "?";
+}
+
+// Event names are four arbitrary bytes
+static std::string trace_json_escape ( const std::string& s )
+{
+	std::string out;
+	char hex[ 8 ];
+	for ( size_t i = 0; i < s.size (); i++ ) {
+		unsigned char c = (unsigned char) s[ i ];
+		if ( c == '"' || c == '\\' ) {
+			out += '\\';
+			out += (char) c;
+		} else if ( c < 0x20 || c >= 0x7F ) {
+			snprintf ( hex, sizeof ( hex ), "\\u%04x", c );
+			out += hex;
+		} else {
+			out += (char) c;
+		}
+	}
+	return out;
+}
+
+// Render a saved trace as text or Chrome trace JSON.
+// Times are relative to the first record. fname_out = 0 writes to stdout.
+bool NetTrace::Decode ( const char* fname_in, const char* fname_out, int fmt )
+{
+	FILE* fp = fopen ( fname_in, "rb" );
+	if ( fp == 0 ) return false;
+	NetTraceFileHdr hdr;
+	if ( fread ( &hdr, sizeof ( hdr ), 1, fp ) != 1 || hdr.magic != NTR_MAGIC || hdr.rec_size != sizeof ( NetTraceRec ) ) {
+		fclose ( fp );
+		return false;
+	}
+	fseek ( fp, 0, SEEK_END );										// count must fit the file before allocating
+	long fsize = ftell ( fp );
+	fseek ( fp, (long) sizeof ( hdr ), SEEK_SET );
+	if ( fsize < (long) sizeof ( hdr ) || hdr.count > ( (uint64_t) fsize - sizeof ( hdr ) ) / sizeof ( NetTraceRec ) ) {
+		fclose ( fp );
+		return false;
+	}
+	std::vector<NetTraceRec> all ( hdr.count );
+	if ( hdr.count > 0 && fread ( &all[ 0 ], sizeof ( NetTraceRec ), hdr.count, fp ) != hdr.count ) {
+		fclose ( fp );
+		return false;
+	}
+	fclose ( fp );
+
+	FILE* out = ( fname_out == 0 ) ? stdout : fopen ( fname_out, "w" );
+	if ( out == 0 ) return false;
+
+	uint64_t t0 = ( hdr.count > 0 ) ? all[ 0 ].time : 0;
+	char code_buf[ 16 ];
+
+	if ( fmt == NTR_CHROME ) fprintf ( out, "{\"traceEvents\":[\n" );
+
+	for ( uint64_t n = 0; n < hdr.count; n++ ) {
+		NetTraceRec& r = all[ n ];
+		std::string name = ( r.name == 0 ) ? "-" : nameToStr ( r.name );
+		const char* code = getCodeName ( r.code );
+		if ( r.code >= NTR_USER ) {
+			snprintf ( code_buf, sizeof ( code_buf ), "USER_%d", r.code - NTR_USER );
+			code = code_buf;
+		}
+		if ( fmt == NTR_CHROME ) {
+			// instant events, thread scope, timestamps in microseconds
+			name = trace_json_escape ( name );
+			fprintf ( out, "%s{\"name\":\"%s %s\",\"cat\":\"net\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"sock\":%d,\"len\":%d}}",
+						( n > 0 ) ? ",\n" : "", code, name.c_str (), double ( r.time - t0 ) / 1000.0, r.tid, r.sock, r.len );
+		} else {
+			fprintf ( out, "%14.6f ms  t%-2d  %-11s  sock %3d  %-4s  %d\n", double ( r.time - t0 ) / 1000000.0, r.tid, code, r.sock, name.c_str (), r.len );
+		}
+	}
+	if ( fmt == NTR_CHROME ) fprintf ( out, "\n],\"displayTimeUnit\":\"ns\"}\n" );
+
+	if ( out != stdout ) fclose ( out );
+	return true;
+}
@@ -6,6 +6,7 @@
 //----------------------------------------------------------------------------------------------------------------------
 
 #include <assert.h>
+#include <algorithm>
 
 
 #include "network_system.h"
@@ -16,6 +17,8 @@
 	#include <netinet/tcp.h> 
 	#include <sys/stat.h>
 	#include <errno.h>    
+	#include <pthread.h>
+	#include <sched.h>
 #elif _WIN32
 	#include <winsock2.h>
 #elif __ANDROID__
@@ -36,6 +39,18 @@
 	#include <openssl/x509v3.h>
 #endif
 
+// Hardware CRC32C (SSE4.2), selected at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+	#define CRC32C_HW
+	#include <nmmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define CRC32C_TARGET
+	#else
+		#define CRC32C_TARGET	__attribute__((target("sse4.2")))
+	#endif
+#endif
+
 //#define DEBUG_STREAM				// enable this to read/write network stream to disk file
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -303,6 +318,13 @@ inline void NetworkSystem::CXSocketUpdateAddr ( int sock_i, bool src )
 	int ntype;
 	ntype = (src) ? s.src.type : s.dest.type;
 
+	// unix domain sockets carry their path address from creation
+	if ( s.mode == NET_UNIX ) {
+		CXSocketSetBlockMode ( s.socket, s.blocking );
+		TRACE_EXIT ( (__func__) );
+		return;
+	}
+
 	// determine IP to use
 	netIP ip;	
 	switch (ntype) {
@@ -382,9 +404,15 @@ NetworkSystem::NetworkSystem ( const char* trace_file_name )
 	m_pathPrivateKey = str("");
 	m_pathCertDir = str("");
 	m_pathCertFile = str("");
+	m_kernelTLS = false;
 	
 	m_printVerbose = false;
 	m_printFlow = false;
+	m_checksum = false;
+	m_compactHdr = false;
+	m_checksumErrors = 0;
+	m_callsActive = 0;
+	m_dispatchSock = -1;
 	m_trace = 0;
 	m_check = 0;
 	m_indentCount = 0;
@@ -395,6 +423,14 @@ NetworkSystem::NetworkSystem ( const char* trace_file_name )
 	m_reconnectInterval = 5000;		// 5 seconds
 	m_reconnectLimit = 10;				// 10x tries
 	m_processInterval = 200;	 	  // 200 msec, packet interval
+	m_acceptBudget = NET_ACCEPT_BUDGET;
+	m_busyPoll = false;
+	m_busyPollPinned = false;
+	m_busyPollCPU = -1;
+	m_busyPollUsec = 0;
+	m_rxRate = m_txRate = m_rateBurst = 0;		// unlimited
+	m_rxEventBudget = m_txEventBudget = 0;
+	m_rrStart = 0;
 
 	TimeX curr_time;
 	curr_time.SetTimeNSec();
@@ -442,6 +478,31 @@ void NetworkSystem::CXSocketMakeNoDelay ( CX_SOCKET sock_h )
 	TRACE_EXIT ( (__func__) );
 } 
 
+// Kernel busy polling on socket receive (Linux). Needs CAP_NET_ADMIN above net.core.busy_read.
+void NetworkSystem::CXSocketBusyPoll ( CX_SOCKET sock_h, int usec ) 
+{
+	#ifdef SO_BUSY_POLL
+		int ret = setsockopt ( sock_h, SOL_SOCKET, SO_BUSY_POLL, (char *) &usec, sizeof ( usec ) );
+		if ( ret < 0 ) {
+			netPrintf ( PRINT_VERBOSE, "    SO_BUSY_POLL not set: Errno: %d", errno );
+		}
+	#endif
+} 
+
+bool NetworkSystem::CXThreadPinCPU ( int cpu ) 
+{
+	#ifdef _WIN32
+		return SetThreadAffinityMask ( GetCurrentThread ( ), DWORD_PTR(1) << cpu ) != 0;
+	#elif defined(__linux__) && !defined(__ANDROID__)
+		cpu_set_t set;
+		CPU_ZERO ( &set );
+		CPU_SET ( cpu, &set );
+		return pthread_setaffinity_np ( pthread_self ( ), sizeof ( set ), &set ) == 0;
+	#else
+		return false;
+	#endif
+} 
+
 bool NetworkSystem::valid_socket_index ( int i ) 
 {
 	return i >= 0 && i < m_socks.size ( );
@@ -594,11 +655,7 @@ void NetworkSystem::netServerSetupHandshakeSSL ( int sock_i )
 	}
 
 	s.ssl = SSL_new ( s.ctx );
-	long lret = SSL_set_mode ( s.ssl, SSL_MODE_ENABLE_PARTIAL_WRITE );
-	if ( lret & SSL_MODE_ENABLE_PARTIAL_WRITE == 0 ) {
-		std::cout << "SSL_MODE_ENABLE_PARTIAL_WRITE = 0" << std::endl;
-		exit (0);
-	}
+	netSetupModeSSL ( sock_i );
 	
 	if ( ( ret = SSL_set_fd ( s.ssl, s.socket ) ) <= 0 ) {
 		str msg = netGetErrorStringSSL ( ret, s.ssl );
@@ -640,6 +697,9 @@ void NetworkSystem::netServerAcceptSSL ( int sock_i )
 	} else if (ret == 1) { // SSL connection complete.
 		netPrintf ( PRINT_VERBOSE_HS, "Call to ssl accept succeded" );
 		netPrintf ( PRINT_VERBOSE_HS, "Ready for safe transfer: %d", SSL_is_init_finished ( s.ssl ) );
+		#ifdef SSL_OP_ENABLE_KTLS
+			netPrintf ( PRINT_VERBOSE_HS, "Kernel TLS: send %d, recv %d", (int) BIO_get_ktls_send ( SSL_get_wbio ( s.ssl ) ), (int) BIO_get_ktls_recv ( SSL_get_rbio ( s.ssl ) ) );
+		#endif
 		netServerCompleteConnection ( sock_i ); // Handshake succeeded. Complete connection.
 	}
 	
@@ -709,6 +769,52 @@ bool NetworkSystem::netServerStart ( netPort srv_port, int security )
 	return true;
 }
 
+bool NetworkSystem::netServerStart ( str srv_path )
+{
+	TRACE_ENTER ( (__func__) );
+
+	#ifndef CX_UNIX_SOCK
+		netPrintf ( PRINT_ERROR, "Unix domain sockets not supported on this platform." );
+		TRACE_EXIT ( (__func__) );
+		return false;
+	#else
+	m_hostType = 's';
+	netPrintf ( PRINT_VERBOSE, "Start Server (local): %s", srv_path.c_str() );
+
+	// Create new listening socket on path
+	NetAddr addr1 ( NTYPE_ANY, getHostName(), 0, 0 );
+	if ( !addr1.setPath ( srv_path ) ) {
+		netPrintf ( PRINT_ERROR, "Server path too long: %s", srv_path.c_str() );
+		TRACE_EXIT ( (__func__) );
+		return false;
+	}
+	NetAddr addr2;
+	addr2.setPath ( "" );
+	int srv_sock_i = netAddSocket ( NET_SRV, NET_UNIX, STATE_START, false, addr1, addr2 ), ret;
+	m_socks[ srv_sock_i ].security = NET_SECURITY_PLAIN_TCP;		// local only, no TLS
+
+	// Bind & Listen
+	ret = netSocketBind ( srv_sock_i );
+	if (netFuncError(ret)) {
+		netPrintf(PRINT_ERROR, "Server fail to bind local sock: %s", srv_path.c_str() );
+		TRACE_EXIT ( (__func__) );
+		return false;
+	}
+	ret = netSocketListen ( srv_sock_i );	
+	if (netFuncError(ret)) {
+		netPrintf(PRINT_ERROR, "Server fail to listen on local sock.");
+		TRACE_EXIT ( (__func__) );
+		return false;
+	}
+
+	// Start accept handshake
+	m_socks[ srv_sock_i ].state = STATE_HANDSHAKE;
+
+	TRACE_EXIT ( (__func__) );
+	return true;
+	#endif
+}
+
 void NetworkSystem::netServerAcceptClient ( int sock_i )
 {
 	TRACE_ENTER ( (__func__) );
@@ -722,32 +828,49 @@ void NetworkSystem::netServerAcceptClient ( int sock_i )
 	netPort srv_port;
 	srv_port = m_socks[ sock_i ].src.port;
 	int security_level = m_socks[ sock_i ].security;			// server security level
+	int srv_mode = m_socks[ sock_i ].mode;						// TCP or UNIX
+	NetAddr srv_local = m_socks[ sock_i ].src;
 	netIP cli_ip = 0;
 	netPort cli_port = 0;
 
-	// TCP Accept
-	CX_SOCKET sock_h;		// New literal socket
-	int result = netSocketAccept ( sock_i, sock_h, cli_ip, cli_port );
-	if ( result < 0 ) {		
-		// Accept error.
-		netManageHandshakeError ( sock_i, "connection not accepted" );		
-		TRACE_EXIT ( (__func__) );
-		return;
-	} else if ( result==0 ) {
-		// Waiting. Not yet accepted.
+	// Drain the listen backlog, up to the accept budget.
+	// Many clients may reconnect at once, e.g. after a server restart.
+	for ( int accepted = 0; accepted < m_acceptBudget; accepted++ ) {
+
+		// TCP Accept
+		CX_SOCKET sock_h;		// New literal socket
+		int result = netSocketAccept ( sock_i, sock_h, cli_ip, cli_port );
+		if ( result < 0 ) {		
+			// Accept error, e.g. out of descriptors. Keep listening, retry next tick.
+			break;
+		} else if ( result==0 ) {
+			// Waiting. Backlog empty.
+			break;
+		}
+		#ifndef _WIN32
+			if ( sock_h >= FD_SETSIZE ) {
+				netPrintf ( PRINT_ERROR, "Accepted socket %d exceeds select limit (%d). Closed.", sock_h, FD_SETSIZE );
+				CXSocketClose ( sock_h );
+				continue;
+			}
+		#endif
 
-	} else if (result > 0) {
 		// Add socket for client
 		netIP srv_ip = m_hostIp; // Listen/accept on ANY address (0.0.0.0), final connection needs the server IP
 		NetAddr addr1 ( NTYPE_CONNECT, srv_name, srv_ip, srv_port );
 		NetAddr addr2 ( NTYPE_CONNECT, "", cli_ip, cli_port );
-		int cli_sock_i = netAddSocket ( NET_SRV, NET_TCP, STATE_START, false, addr1, addr2 ); // Create new socket
+		if ( srv_mode == NET_UNIX ) {
+			addr1.setPath ( srv_local.path );
+			addr2.setPath ( "" );
+		}
+		int cli_sock_i = netAddSocket ( NET_SRV, srv_mode, STATE_START, false, addr1, addr2, sock_h ); // Create new socket
 
 		// Set socket origin & info
 		NetSock& s = m_socks[ cli_sock_i ];
-		CXSocketSetBlockMode ( sock_h, false);  // non-blocking
+		#ifndef __linux__
+			CXSocketSetBlockMode ( sock_h, false);  // non-blocking (accept4 sets this on linux)
+		#endif
 		s.security = security_level;						// security level
-		s.socket = sock_h;											// assign literal socket
 		s.dest.ip = cli_ip;											// assign client IP
 		s.dest.port = cli_port;									// assign client port
 		s.state = STATE_START;
@@ -767,7 +890,7 @@ void NetworkSystem::netServerAcceptClient ( int sock_i )
 			#ifdef BUILD_OPENSSL
 				netServerSetupHandshakeSSL ( cli_sock_i );
 				if ( s.security & NET_SECURITY_FAIL ) {
-					netManageHandshakeError ( sock_i, "SSL handshake failed");
+					netManageHandshakeError ( cli_sock_i, "SSL handshake failed");
 				}
 			#endif	
 		} else if ( s.security & NET_SECURITY_PLAIN_TCP ) { 		
@@ -780,12 +903,12 @@ void NetworkSystem::netServerAcceptClient ( int sock_i )
 void NetworkSystem::netServerCompleteConnection ( int sock_i )
 {
 	TRACE_ENTER ( (__func__) );
-	int srv_sock_svc = netFindSocket ( NET_SRV, NET_TCP, NTYPE_ANY );
+	int srv_sock_svc = netFindSocket ( NET_SRV, m_socks[ sock_i ].mode, NTYPE_ANY );
 	if ( srv_sock_svc == -1 ) {
 	   netPrintf ( PRINT_ERROR_HS, "Unable to find server listen socket" );
 	}
 	netPort srv_port;
-	srv_port = m_socks[ srv_sock_svc ].src.port;
+	srv_port = (srv_sock_svc == -1) ? 0 : m_socks[ srv_sock_svc ].src.port;
 	NetSock& s = m_socks [ sock_i ];	
 
 	assert(s.side != NET_CLI);
@@ -798,6 +921,8 @@ void NetworkSystem::netServerCompleteConnection ( int sock_i )
 	e.attachInt64 ( m_hostIp );		// Server IP
 	e.attachInt64 ( srv_port );		// Server port
 	e.attachInt ( sock_i );			// Connection ID (goes back to the client)
+	e.attachInt ( m_checksum );		// CRC32C offered (client replies with 'cCrc' to accept)
+	e.attachInt ( m_compactHdr );	// Compact headers offered (client replies with 'cCmp' to accept)
 	netSend ( e, sock_i );			// Send TCP connected event to client
 
 	netPrintf(PRINT_VERBOSE, "  Sent sOkT event to client." );
@@ -836,13 +961,14 @@ void NetworkSystem::netServerCheckConnectionHandshakes ( )
 
 			// OpenSSL
 			if (s.security & NET_SECURITY_OPENSSL) {
-				if (s.state==STATE_HANDSHAKE) {
+				if (s.state==STATE_HANDSHAKE && s.src.type == NTYPE_CONNECT) {		// client connections only, not the listener
 					netManageHandshakeError(sock_i, "server SSL timeout");
+					continue;
 				}
 			}
 
-			// TCP/IP protocols
-			if ( s.security & NET_SECURITY_PLAIN_TCP ) {
+			// TCP/IP protocols (TCP accept precedes either security level)
+			if ( s.security & (NET_SECURITY_PLAIN_TCP | NET_SECURITY_OPENSSL) ) {
 				// Check listening socket
 				if ( s.state == STATE_HANDSHAKE && s.src.type == NTYPE_ANY ) {
 					//printf ( "Listening: %d\n", sock_i );
@@ -859,7 +985,7 @@ void NetworkSystem::netServerProcessIO ( )
 {
 	TimeX current_time;
 	current_time.SetTimeNSec();
-	if (current_time.GetElapsedMSec(m_lastNetProcess) < m_processInterval) return;
+	if (!m_busyPoll && current_time.GetElapsedMSec(m_lastNetProcess) < m_processInterval) return;
 	m_lastNetProcess = current_time;
 
 	TRACE_ENTER ( (__func__) );
@@ -869,10 +995,25 @@ void NetworkSystem::netServerProcessIO ( )
 
 	NET_PERF_PUSH ( "findsocks" );
 
-	for ( int sock_i = 0; sock_i < (int) m_socks.size ( ); sock_i++ ) { 
+	// Round-robin. Start at a different socket each tick, so that with
+	// rate limits or event budgets no socket is always served first.
+	int num = (int) m_socks.size ( );
+	int first = ( num > 0 ) ? m_rrStart % num : 0;
+	m_rrStart = first + 1;
+
+	for ( int k = 0; k < num; k++ ) { 
+		int sock_i = ( first + k ) % num;
+		if ( !valid_socket_index ( sock_i ) ) continue;			// removed during this tick
 		NetSock& s = m_socks[ sock_i ];
+		s.rxEventsTick = s.txEventsTick = 0;
 
 		if ( netSocketIsSelected ( &sockReadSet, sock_i ) ) {
+
+			// Listening socket. Accept pending connections.
+			if ( s.state == STATE_HANDSHAKE && s.src.type == NTYPE_ANY ) {
+				netServerAcceptClient ( sock_i );		// may add sockets, s is not valid after this
+				continue;
+			}
 			
 			// OpenSSL
 			if (s.security & NET_SECURITY_OPENSSL) {				
@@ -893,6 +1034,9 @@ void NetworkSystem::netServerProcessIO ( )
 			// Send pending data
 			netSendResidualEvent ( sock_i );
 		}
+		#ifdef BUILD_OPENSSL
+			netResumeSSL ( sock_i, &sockReadSet, &sockWriteSet );
+		#endif
 	}
 	NET_PERF_POP ( );
 	TRACE_EXIT ( (__func__) );
@@ -958,11 +1102,6 @@ void NetworkSystem::netClientSetupHandshakeSSL ( int sock_i )
 	}		
 
 	s.ssl = SSL_new ( s.ctx );
-	long lret = SSL_set_mode ( s.ssl, SSL_MODE_ENABLE_PARTIAL_WRITE );
-	if ( lret & SSL_MODE_ENABLE_PARTIAL_WRITE == 0 ) {
-		std::cout << "SSL_MODE_ENABLE_PARTIAL_WRITE = 0" << std::endl;
-		exit (0);
-	}
 	
 	if ( ! s.ssl ) {
 		str msg = netGetErrorStringSSL ( ret, s.ssl );
@@ -973,6 +1112,7 @@ void NetworkSystem::netClientSetupHandshakeSSL ( int sock_i )
 	} else {
 		netPrintf ( PRINT_VERBOSE_HS, "Call to ssl succeded" );
 	}	
+	netSetupModeSSL ( sock_i );
 
 	if ( ( ret = SSL_set_fd ( s.ssl, s.socket ) ) != 1 ) {
 		str msg = netGetErrorStringSSL ( ret, s.ssl );
@@ -1020,6 +1160,9 @@ void NetworkSystem::netClientConnectSSL ( int sock_i )
 	
 	} else if ( ret == 1 ) { // SSL connect succeeded.
 		netPrintf ( PRINT_VERBOSE_HS, "Call to ssl connect succeded." );
+		#ifdef SSL_OP_ENABLE_KTLS
+			netPrintf ( PRINT_VERBOSE_HS, "Kernel TLS: send %d, recv %d", (int) BIO_get_ktls_send ( SSL_get_wbio ( s.ssl ) ), (int) BIO_get_ktls_recv ( SSL_get_rbio ( s.ssl ) ) );
+		#endif
 		netPrintf ( PRINT_VERBOSE_HS, "Waiting for sOkT event from server." );
 		
 		// Note: We DO NOT set state=CONNECTED here yet.
@@ -1130,6 +1273,35 @@ int NetworkSystem::netFindOrCreateSocket (str srv_name, netPort srv_port, netIP
 }	
 
 
+int NetworkSystem::netFindOrCreateLocalSocket ( str srv_path, bool block )
+{
+	#ifndef CX_UNIX_SOCK
+		netPrintf ( PRINT_ERROR_HS, "Unix domain sockets not supported on this platform." );
+		return -1;
+	#else
+	// Find socket to specific server path (only one per client)
+	NetAddr srv_addr = NetAddr ( NTYPE_CONNECT, srv_path, 0, 0 );
+	if ( !srv_addr.setPath ( srv_path ) ) {
+		netPrintf ( PRINT_ERROR_HS, "Server path too long: %s", srv_path.c_str() );
+		return -1;
+	}
+	int cli_sock_i = netFindSocket ( NET_CLI, NET_UNIX, STATE_NONE, srv_addr );
+
+	if ( cli_sock_i == NET_ERR ) {
+		// Add new socket. Client side is unnamed (autobind not needed for stream sockets)
+		NetAddr cli_addr = NetAddr ( NTYPE_CONNECT, "", m_hostIp, 0 );
+		cli_addr.setPath ( "" );
+		cli_sock_i = netAddSocket ( NET_CLI, NET_UNIX, STATE_NONE, block, cli_addr, srv_addr );
+		if ( cli_sock_i == NET_ERR ) {
+			netPrintf ( PRINT_ERROR_HS, "Unable to add local socket" );
+			return -1;
+		}
+		m_socks[ cli_sock_i ].security = NET_SECURITY_PLAIN_TCP;		// local only, no TLS
+	}
+	return cli_sock_i;
+	#endif
+}
+
 int NetworkSystem::netClientConnectToServer ( str srv_name, netPort srv_port, bool block, int cli_sock_i )
 {
 	TRACE_ENTER ( (__func__) );
@@ -1140,11 +1312,20 @@ int NetworkSystem::netClientConnectToServer ( str srv_name, netPort srv_port, bo
 	// Reuse or create a client socket
 	if ( ! valid_socket_index( cli_sock_i ) ) {
 		
-		// Resolve server name/port to server IP
-		srv_ip = netResolveServerIP ( srv_name, srv_port );
+		if ( netIsLocalPath ( srv_name ) ) {
+			// Unix domain socket, no name resolution
+			cli_sock_i = netFindOrCreateLocalSocket ( srv_name, block );
+		} else {
+			// Resolve server name/port to server IP
+			srv_ip = netResolveServerIP ( srv_name, srv_port );
 		
-		// Create new socket if needed
-		cli_sock_i = netFindOrCreateSocket ( srv_name, srv_port, srv_ip, block );
+			// Create new socket if needed
+			cli_sock_i = netFindOrCreateSocket ( srv_name, srv_port, srv_ip, block );
+		}
+		if ( cli_sock_i == NET_ERR ) {
+			TRACE_EXIT ( (__func__) );
+			return NET_ERR;
+		}
 	}
 
 	// Return if already connected (likely waiting for sOkT from server)
@@ -1243,6 +1424,17 @@ void NetworkSystem::netClientCheckConnectionHandshakes ( )
 			if ( s.security & NET_SECURITY_OPENSSL) {				
 				// OpenSSL - retry connect during handshake
 				#ifdef BUILD_OPENSSL					
+				if ( s.state == STATE_START && s.ssl == 0 ) {
+					// Non-blocking TCP connect was in progress. Start TLS once it completes.
+					netClientHandshake ( sock_i );
+					if ( s.state == STATE_CONNECTED ) {
+						netClientSetupHandshakeSSL ( sock_i );		// state changes to STATE_HANDSHAKE
+						if ( s.security & NET_SECURITY_FAIL ) {
+							netManageHandshakeError ( sock_i, "SSL handshake failed" );
+							continue;
+						}
+					}
+				}
 				if ( s.state == STATE_HANDSHAKE ) {
 					netClientConnectSSL(sock_i);	// This call is MORE important than the others
 				}
@@ -1277,7 +1469,7 @@ void NetworkSystem::netClientProcessIO ( )
 {
 	TimeX current_time;
 	current_time.SetTimeNSec();
-	if (current_time.GetElapsedMSec(m_lastNetProcess) < m_processInterval) return;
+	if (!m_busyPoll && current_time.GetElapsedMSec(m_lastNetProcess) < m_processInterval) return;
 	m_lastNetProcess = current_time;
 
 	TRACE_ENTER ( (__func__) );
@@ -1287,6 +1479,7 @@ void NetworkSystem::netClientProcessIO ( )
 	NET_PERF_PUSH ( "findsocks" );
 	
 	for ( int sock_i = 0; sock_i < (int) m_socks.size ( ); sock_i++ ) { 		
+		m_socks[ sock_i ].rxEventsTick = m_socks[ sock_i ].txEventsTick = 0;
 		if ( netSocketIsSelected ( &sockReadSet, sock_i ) ) {			
 			// Receive any pending data
 			netReceiveData(sock_i);
@@ -1295,6 +1488,9 @@ void NetworkSystem::netClientProcessIO ( )
 			// Send any pending data
 			netSendResidualEvent( sock_i );
 		}
+		#ifdef BUILD_OPENSSL
+			netResumeSSL ( sock_i, &sockReadSet, &sockWriteSet );
+		#endif
 	}	
 	NET_PERF_POP ( );
 	TRACE_EXIT ( (__func__) );
@@ -1379,6 +1575,36 @@ int NetworkSystem::netNonFatalErrorSSL ( int sock, int ret )
 	return ret;		// pass-thru other ret error values
 }
 
+// Partial writes let a large event drain over several ticks, and a moving write buffer
+// lets a retry come from txBuf rather than the original event.
+void NetworkSystem::netSetupModeSSL ( int sock_i )
+{
+	NetSock& s = m_socks[ sock_i ];
+	s.sslWantTx = 0;
+	s.sslWantRx = 0;
+	if ( s.ssl == 0 ) return;
+	SSL_set_mode ( s.ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
+	#ifdef SSL_OP_ENABLE_KTLS
+		if ( m_kernelTLS ) {
+			SSL_set_options ( s.ssl, SSL_OP_ENABLE_KTLS );		// falls back to user-space TLS if unsupported
+		}
+	#endif
+}
+
+// TLS may need the opposite direction to make progress (e.g. a key update).
+// Resume a write blocked on read when readable, and a read blocked on write when writable.
+void NetworkSystem::netResumeSSL ( int sock_i, fd_set* sockReadSet, fd_set* sockWriteSet )
+{
+	if ( !valid_socket_index ( sock_i ) || m_socks[ sock_i ].ssl == 0 ) return;
+
+	if ( m_socks[ sock_i ].sslWantTx == SSL_ERROR_WANT_READ && netSocketIsSelected ( sockReadSet, sock_i ) ) {
+		netSendResidualEvent ( sock_i );
+	}
+	if ( valid_socket_index ( sock_i ) && m_socks[ sock_i ].sslWantRx == SSL_ERROR_WANT_WRITE && netSocketIsSelected ( sockWriteSet, sock_i ) ) {
+		netReceiveData ( sock_i );
+	}
+}
+
 #endif
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -1405,6 +1631,8 @@ void NetworkSystem::netProcessEvents ( Event& e )
 			netIP srv_ip = e.getInt64 ( );		// Server IP
 			int srv_port = e.getInt64 ( );		// Server port
 			int srv_sock = e.getInt ( );		// Server sock which maintains this client
+			bool srv_crc = e.isEnd() ? false : e.getInt ( );	// Server offers CRC32C (older servers omit this)
+			bool srv_compact = e.isEnd() ? false : e.getInt ( );	// Server offers compact headers
 
 			int cli_sock = e.getSrcSock();		// Client sock which received accept (srcsock, not in payload)
 	
@@ -1419,6 +1647,21 @@ void NetworkSystem::netProcessEvents ( Event& e )
 			m_socks[cli_sock].dest.sock = srv_sock; // assign server socket
 			m_socks[cli_sock].src.port = cli_port; // assign client port from server			
 
+			// Accept CRC32C if both sides want it. Server enables its side on 'cCrc'.
+			m_socks[cli_sock].crc = false;
+			if ( m_checksum && srv_crc ) {
+				Event ke;
+				netMakeEvent ( ke, 'cCrc', 'net ' );
+				ke.attachInt ( srv_sock );
+				if ( netSend ( ke, cli_sock ) ) m_socks[cli_sock].crc = true;
+			}
+			// Accept compact headers if both sides want them. Events after 'cCmp' are compact.
+			if ( m_compactHdr && srv_compact ) {
+				Event ke;
+				netMakeEvent ( ke, 'cCmp', 'net ' );
+				if ( netSend ( ke, cli_sock ) ) m_socks[cli_sock].compactTx = true;
+			}
+
 			// Connection complete
 			bool ssl = m_socks[cli_sock].security & NET_SECURITY_OPENSSL;
 			netPrintf(PRINT_VERBOSE, "SUCCESS %s. Client %s:%d (sock %d), To Server: %s:%d (sock %d)", ssl ? "OpenSSL" : "TCP", getIPStr(cli_ip).c_str(), cli_port, cli_sock, getIPStr(srv_ip).c_str(), srv_port, srv_sock);
@@ -1433,6 +1676,29 @@ void NetworkSystem::netProcessEvents ( Event& e )
 
 			break;
 		} 
+		case 'cCrc': {
+			// Client accepted CRC32C. Checked events are self-describing, so enable from here on.
+			int cli_sock = e.getSrcSock();
+			if ( m_checksum && valid_socket_index(cli_sock) ) {
+				m_socks[ cli_sock ].crc = true;
+				netPrintf ( PRINT_VERBOSE_HS, "SRV: CRC32C enabled on sock %d", cli_sock );
+			}
+			break;
+		}
+		case 'cCmp': {
+			// Client sends compact headers from here on (receive side switched in netReceiveEvent).
+			// Reply so the client switches too; events after 'sCmp' are compact.
+			int cli_sock = e.getSrcSock();
+			if ( valid_socket_index(cli_sock) && !m_socks[ cli_sock ].compactTx ) {
+				Event ke;
+				netMakeEvent ( ke, 'sCmp', 'net ' );
+				if ( netSend ( ke, cli_sock ) ) {
+					m_socks[ cli_sock ].compactTx = true;
+					netPrintf ( PRINT_VERBOSE_HS, "SRV: Compact headers enabled on sock %d", cli_sock );
+				}
+			}
+			break;
+		}
 		case 'cEXT': { 
 			// Client has exited from this server.
 			int local_sock_i = e.getUInt ( ); // Socket to close
@@ -1461,56 +1727,93 @@ void NetworkSystem::netInitialize ( )
 	TRACE_EXIT ( (__func__) );
 }
 
-int NetworkSystem::netAddSocket ( int side, int mode, int state, bool block, NetAddr src, NetAddr dest )
+int NetworkSystem::netAddSocket ( int side, int mode, int state, bool block, NetAddr src, NetAddr dest, CX_SOCKET sock_h )
 {
 	TRACE_ENTER ( (__func__) );
 
+	// Reuse a terminated slot, if any
+	int n = -1;
+	while ( m_sockFree.size() > 0 && n == -1 ) {
+		int i = m_sockFree.back ();
+		m_sockFree.pop_back ();
+		if ( i < (int) m_socks.size() && m_socks[ i ].state == STATE_TERMINATED && m_socks[ i ].pktBuf != 0 ) n = i;	// skip stale entries
+	}
+
 	NetSock s;
+	if ( n >= 0 ) {
+		// retain buffers of the old slot
+		NetSock& old = m_socks[ n ];
+		#ifdef BUILD_OPENSSL
+			if ( old.ctx != 0 ) netFreeSSL ( n );
+		#endif
+		s.pktBuf = old.pktBuf;	s.pktMax = old.pktMax;
+		s.rxBuf = old.rxBuf;	s.rxMax = old.rxMax;
+		s.txBuf = old.txBuf;	s.txMax = old.txMax;
+		s.event = old.event;
+	} else {
+		// take preallocated buffers
+		if ( m_sockSpare.size() == 0 ) {
+			netAllocSockBuffers ( NET_SOCK_BATCH );
+		}
+		NetSockBufs& b = m_sockSpare.back ();
+		s.pktBuf = b.pktBuf;	s.pktMax = b.pktMax;
+		s.rxBuf = b.rxBuf;		s.rxMax = b.rxMax;
+		s.txBuf = b.txBuf;		s.txMax = b.txMax;
+		s.event = b.event;
+		m_sockSpare.pop_back ();
+	}
+
 	s.side = side;
 	s.mode = mode;
 	s.state = state;
 	s.lastStateChange.SetTimeNSec ( );
 	s.src = src;
 	s.dest = dest;
-	s.socket = 0;
+	s.socket = sock_h;							// accepted socket, or 0 to create one
 	s.timeout.tv_sec = 0; 
 	s.timeout.tv_usec = 0;
 	s.blocking = block;
 	s.broadcast = 0;
 	s.security = m_security; 
 	s.reconnectBudget = s.reconnectLimit = m_reconnectLimit;  
+	s.crc = false;
+	s.crcErrors = 0;
+	s.compactTx = s.compactRx = false;
+	s.rxEventsTick = s.txEventsTick = 0;
+	s.rxBytes = s.txBytes = 0;
+	s.rxEvents = s.txEvents = 0;
+	s.rxLimited = s.txLimited = 0;
 
 	#ifdef BUILD_OPENSSL
 		s.ctx = 0;
 		s.ssl = 0;
 		s.bio = 0;
+		s.sslWantTx = 0;
+		s.sslWantRx = 0;
 	#endif
 
-	// inital packet buf
-	s.pktMax = 8192;			// fixed size
-	s.pktBuf = (char*) malloc ( s.pktMax );		
+	// packet buf, fixed size
 	s.pktPtr = s.pktBuf;
 	s.pktLen = 0;
 	s.pktCounter = 0;
 
-	// initial rx buf
-	s.rxMax = 8192;			// expandable
-	s.rxBuf = (char*) malloc(s.rxMax);
+	// rx buf, expandable
 	s.rxPtr = s.rxBuf;
 	s.rxLen = 0;
+	s.eventLen = s.eventHdr = 0;
 
-	// initial tx buf
-	s.txMax = 8192;			// expandable
-	s.txBuf = (char*) malloc(s.txMax);
+	// tx buf, expandable
 	s.txPtr = s.txBuf;
 	s.txLen = 0;	
 	s.txPktSize = 0;
 
-	// socket recv event
-	s.event = new Event ( 'net ', 'Psox' );
-
-	int n = m_socks.size ( );
-	m_socks.push_back ( s );
+	if ( n >= 0 ) {
+		m_socks[ n ] = s;
+	} else {
+		n = m_socks.size ( );
+		m_socks.push_back ( s );
+	}
+	netSetBuckets ( n, m_rxRate, m_txRate, m_rateBurst );
 
 	netSocketCreate ( n );
 	
@@ -1518,6 +1821,39 @@ int NetworkSystem::netAddSocket ( int side, int mode, int state, bool block, Net
 	return n;
 }
 
+// Preallocate buffers for new socket slots, and room in the socket list
+void NetworkSystem::netAllocSockBuffers ( int count )
+{
+	if ( m_socks.capacity() < m_socks.size() + count ) {
+		m_socks.reserve ( std::max ( m_socks.size() * 2, m_socks.size() + count ) );
+	}
+	NetSockBufs b;
+	for ( int n = 0; n < count; n++ ) {
+		b.pktMax = 8192;
+		b.pktBuf = (char*) malloc ( b.pktMax );
+		b.rxMax = 8192;
+		b.rxBuf = (char*) malloc ( b.rxMax );
+		b.txMax = 8192;
+		b.txBuf = (char*) malloc ( b.txMax );
+		b.event = new Event ( 'net ', 'Psox' );		// socket recv event
+		m_sockSpare.push_back ( b );
+	}
+}
+
+// Return buffers of a removed slot to the spare list
+void NetworkSystem::netReleaseSockBuffers ( NetSock& s )
+{
+	if ( s.pktBuf == 0 ) return;
+	NetSockBufs b;
+	b.pktBuf = s.pktBuf;	b.pktMax = s.pktMax;
+	b.rxBuf = s.rxBuf;		b.rxMax = s.rxMax;
+	b.txBuf = s.txBuf;		b.txMax = s.txMax;
+	b.event = s.event;
+	m_sockSpare.push_back ( b );
+	s.pktBuf = s.rxBuf = s.txBuf = 0;
+	s.event = 0;
+}
+
 void NetworkSystem::netSocketReuse ( int sock_i )
 {
 	// Several steps must occur to allow socket reuse.
@@ -1664,11 +2000,31 @@ int NetworkSystem::netDeleteSocket ( int sock_i, int force )
 		netPrintf(PRINT_VERBOSE_HS, "Terminating socket: %d", sock_i);
 		CXSocketClose ( s.socket );
 		s.state = STATE_TERMINATED;
+		netDropQueuedReplies ( sock_i );
+		m_statsClosed.rxBytes += s.rxBytes;				// keep totals for netGetStats
+		m_statsClosed.txBytes += s.txBytes;
+		m_statsClosed.rxEvents += s.rxEvents;
+		m_statsClosed.txEvents += s.txEvents;
+		m_statsClosed.rxLimited += s.rxLimited;
+		m_statsClosed.txLimited += s.txLimited;
+		#ifdef CX_UNIX_SOCK
+			if ( s.mode == NET_UNIX ) {
+				for ( size_t n = 0; n < s.rxFds.size(); n++ ) netCloseDescriptors ( s.rxFds[n].fds );		// unclaimed descriptors
+				s.rxFds.clear ();
+				s.txFd = -1;
+				if ( s.side == NET_SRV && s.src.type == NTYPE_ANY && !s.src.isAbstract() && !s.src.path.empty() ) {
+					unlink ( s.src.path.c_str() );		// remove listening path from filesystem
+				}
+			}
+		#endif
+		m_sockFree.push_back ( sock_i );				// slot and buffers reused by netAddSocket
+
 		// remove sockets at end of list
 		// --- FOR NOW, THIS IS NECESSARY ON CLIENT (which may have only 1 socket),
 		// BUT IN FUTURE CLIENTS SHOULD BE ABLE TO HAVE ANY NUMBER OF PREVIOUSLY TERMINATED SOCKETS
 		if ( m_socks.size ( ) > 0 ) {
-			while ( m_socks[ m_socks.size() -1 ].state == STATE_TERMINATED ) {
+			while ( m_socks.size ( ) > 0 && m_socks[ m_socks.size() -1 ].state == STATE_TERMINATED ) {
+				netReleaseSockBuffers ( m_socks.back ( ) );
 				m_socks.erase ( m_socks.end ( ) -1 );
 			}
 		}
@@ -1676,6 +2032,7 @@ int NetworkSystem::netDeleteSocket ( int sock_i, int force )
 	
 	// Inform app of socket removal
 	if ( wasConnected ) {
+		netCancelCalls ( sock_i );
 		if ( m_hostType == 's' ) {
 			Event se (120, 'app ', 'cFIN', 0, m_eventPool );
 			se.attachInt ( sock_i );
@@ -1733,6 +2090,13 @@ void NetworkSystem::netReportError ( int result )
 int NetworkSystem::netProcessQueue ( void )
 {
 	// TRACE_ENTER ( (__func__) );	
+	if ( m_busyPoll && !m_busyPollPinned ) {
+		// pin the thread that spins on netProcessQueue
+		m_busyPollPinned = true;
+		if ( m_busyPollCPU >= 0 && !CXThreadPinCPU ( m_busyPollCPU ) ) {
+			netPrintf ( PRINT_ERROR, "Unable to pin network thread to cpu %d", m_busyPollCPU );
+		}
+	}
 	if ( m_socks.size ( ) > 0 ) {
 		if ( m_hostType == 'c' ) {
 			netClientCheckConnectionHandshakes ( );
@@ -1748,11 +2112,29 @@ int NetworkSystem::netProcessQueue ( void )
 	while ( m_eventQueue.getSize ( ) > 0 ) {
 
 		m_eventQueue.PopFront ( e );
-		iOk += netEventCallback ( *e );		// count each user event handled ok				
+		if ( m_eventFds.size ( ) > 0 ) {
+			std::map< Event*, std::vector<int> >::iterator it = m_eventFds.find ( e );
+			if ( it != m_eventFds.end ( ) ) {
+				m_dispatchFds.swap ( it->second );		// available to netRecvDescriptor in the callback
+				m_dispatchSock = e->getSrcSock ( );
+				m_eventFds.erase ( it );
+			}
+		}
+		if ( e->mCallID & NET_CALL_REPLY ) {
+			netCompleteCall ( *e );				// reply to a netCall, goes to its handler
+		} else {
+			iOk += netEventCallback ( *e );		// count each user event handled ok				
+		}
+		if ( m_dispatchSock != -1 ) {
+			netCloseDescriptors ( m_dispatchFds );	// not claimed by the callback
+			m_dispatchSock = -1;
+		}
 		
 		e->consume ();
 		delete e;
 	}
+	netSendQueuedReplies ( );
+	netCheckCallTimeouts ( );
 	// TRACE_EXIT ( (__func__) );
 	return iOk;
 }
@@ -1788,11 +2170,269 @@ xlong NetworkSystem::ComputeChecksum ( char* buf, int len )
 	return sum;	
 }
 
+// CRC32C (Castagnoli polynomial, reflected 0x82F63B78)
+// Uses the SSE4.2 crc32 instruction when the CPU has it, otherwise slice-by-8 tables.
+//
+struct CRC32CTables {
+	uint32_t t[8][256];
+	CRC32CTables () {
+		for (int n=0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k=0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : (c >> 1);
+			t[0][n] = c;
+		}
+		for (int n=0; n < 256; n++)
+			for (int k=1; k < 8; k++) t[k][n] = (t[k-1][n] >> 8) ^ t[0][ t[k-1][n] & 0xFF ];
+	}
+};
+
+static uint32_t crc32c_sw ( uint32_t crc, const uchar* p, size_t len )
+{
+	static const CRC32CTables tbl;			// built once, thread-safe init
+	const uint32_t (*t)[256] = tbl.t;
+	while ( len > 0 && ((uintptr_t) p & 7) ) { crc = (crc >> 8) ^ t[0][ (crc ^ *p++) & 0xFF ]; len--; }
+	while ( len >= 8 ) {
+		uint32_t lo, hi;
+		memcpy ( &lo, p, 4 );
+		memcpy ( &hi, p+4, 4 );
+		lo ^= crc;
+		crc = t[7][ lo & 0xFF ] ^ t[6][ (lo >> 8) & 0xFF ] ^ t[5][ (lo >> 16) & 0xFF ] ^ t[4][ lo >> 24 ] ^
+			  t[3][ hi & 0xFF ] ^ t[2][ (hi >> 8) & 0xFF ] ^ t[1][ (hi >> 16) & 0xFF ] ^ t[0][ hi >> 24 ];
+		p += 8; len -= 8;
+	}
+	while ( len-- > 0 ) crc = (crc >> 8) ^ t[0][ (crc ^ *p++) & 0xFF ];
+	return crc;
+}
+
+#ifdef CRC32C_HW
+CRC32C_TARGET static uint32_t crc32c_hw ( uint32_t crc, const uchar* p, size_t len )
+{
+	uint64_t c = crc;
+	while ( len > 0 && ((uintptr_t) p & 7) ) { c = _mm_crc32_u8 ( (uint32_t) c, *p++ ); len--; }
+	while ( len >= 8 ) {
+		uint64_t v;
+		memcpy ( &v, p, 8 );
+		c = _mm_crc32_u64 ( c, v );
+		p += 8; len -= 8;
+	}
+	while ( len-- > 0 ) c = _mm_crc32_u8 ( (uint32_t) c, *p++ );
+	return (uint32_t) c;
+}
+
+static bool crc32c_hw_supported ()
+{
+	#ifdef _MSC_VER
+		int info[4];
+		__cpuid ( info, 1 );
+		return (info[2] & (1 << 20)) != 0;
+	#else
+		return __builtin_cpu_supports ( "sse4.2" );
+	#endif
+}
+#endif
+
+uint32_t NetworkSystem::ComputeCRC32C ( uint32_t crc, const char* buf, int len )
+{
+	crc = ~crc;
+	#ifdef CRC32C_HW
+		static const bool hw = crc32c_hw_supported ();
+		if ( hw ) return ~crc32c_hw ( crc, (const uchar*) buf, len );
+	#endif
+	return ~crc32c_sw ( crc, (const uchar*) buf, len );
+}
+
+// Stamp a serialized event with CRC32C over header and payload.
+// The CRC is carried in the header mCID slot (the receiver keeps its own CID),
+// and NET_CRC_FLAG in the length field marks the event as checked.
+void NetworkSystem::netStampChecksum ( char* buf, int len )
+{
+	wirePut<int> ( buf + Event::staticOffsetLenInfo(), wireGet<int> ( buf + Event::staticOffsetLenInfo() ) | NET_CRC_FLAG );
+	wirePut<uint32_t> ( buf + Event::staticOffsetCIDInfo(), 0 );
+	uint32_t crc = ComputeCRC32C ( 0, buf, len );
+	wirePut<uint32_t> ( buf + Event::staticOffsetCIDInfo(), crc );
+}
+
+// Jain's fairness index over bytes received on connected sockets: (sum x)^2 / (n * sum x^2).
+// 1 = all sockets received equally, 1/n = one socket received everything.
+float NetworkSystem::getFairness ( )
+{
+	double sum = 0, sum_sq = 0;
+	int n = 0;
+	for ( int i = 0; i < (int) m_socks.size ( ); i++ ) {
+		NetSock& s = m_socks[ i ];
+		if ( s.state != STATE_CONNECTED ) continue;
+		sum += double ( s.rxBytes );
+		sum_sq += double ( s.rxBytes ) * double ( s.rxBytes );
+		n++;
+	}
+	return ( sum_sq > 0 ) ? float ( ( sum * sum ) / ( n * sum_sq ) ) : 1.0f;
+}
+
+void NetworkSystem::netPrintRateStats ( )
+{
+	dbgprintf ( "------ RATE STATS. Fairness (rx): %.3f\n", getFairness ( ) );
+	dbgprintf ( "sock     rx_bytes  rx_events  rx_limited     tx_bytes  tx_events  tx_limited\n" );
+	for ( int i = 0; i < (int) m_socks.size ( ); i++ ) {
+		NetSock& s = m_socks[ i ];
+		if ( s.state != STATE_CONNECTED ) continue;
+		dbgprintf ( "%4d %12llu %10llu %11llu %12llu %10llu %11llu\n", i, s.rxBytes, s.rxEvents, s.rxLimited, s.txBytes, s.txEvents, s.txLimited );
+	}
+	dbgprintf ( "------\n" );
+}
+
+void NetworkSystem::netGetStats ( NetStats& st )
+{
+	st = m_statsClosed;
+	for ( int i = 0; i < (int) m_socks.size ( ); i++ ) {
+		NetSock& s = m_socks[ i ];
+		if ( s.state == STATE_TERMINATED ) continue;
+		st.sockets++;
+		if ( s.state == STATE_CONNECTED ) st.connected++;
+		st.rxBytes += s.rxBytes;
+		st.txBytes += s.txBytes;
+		st.rxEvents += s.rxEvents;
+		st.txEvents += s.txEvents;
+		st.rxLimited += s.rxLimited;
+		st.txLimited += s.txLimited;
+	}
+	st.queued = m_eventQueue.getSize ( );
+	st.callsPending = m_callsActive;
+	st.checksumErrors = m_checksumErrors;
+	st.fairness = getFairness ( );
+
+	// busiest methods
+	std::vector< std::pair< xlong, eventStr_t > > order;
+	for ( std::map< eventStr_t, NetCallStats >::iterator it = m_callStats.begin ( ); it != m_callStats.end ( ); it++ ) {
+		order.push_back ( std::pair< xlong, eventStr_t > ( it->second.calls, it->first ) );
+	}
+	std::sort ( order.rbegin ( ), order.rend ( ) );
+	st.numCalls = ( order.size ( ) < NET_STATS_CALLS ) ? (int) order.size ( ) : NET_STATS_CALLS;
+	for ( int n = 0; n < st.numCalls; n++ ) {
+		NetCallStats& cs = m_callStats[ order[ n ].second ];
+		st.call[ n ].name = order[ n ].second;
+		st.call[ n ].calls = cs.calls;
+		st.call[ n ].replies = cs.replies;
+		st.call[ n ].timeouts = cs.timeouts;
+		st.call[ n ].closed = cs.closed;
+		st.call[ n ].sumUsec = cs.sumUsec;
+		st.call[ n ].maxUsec = cs.maxUsec;
+		st.call[ n ].p50Usec = cs.getPercentileUsec ( 0.50f );
+		st.call[ n ].p99Usec = cs.getPercentileUsec ( 0.99f );
+	}
+}
+
+// Verify a complete serialized event. Events without a CRC flag pass.
+bool NetworkSystem::netVerifyChecksum ( int sock_i, char* buf, int len )
+{
+	NetSock& s = m_socks[ sock_i ];
+	uint32_t crc_recv, crc;
+	if ( s.compactRx ) {
+		// Compact header: CRC trails the event
+		if ( ( buf[0] & NET_CH_CRC ) == 0 ) return true;
+		crc_recv = wireGet<uint32_t> ( buf + len - sizeof(uint32_t) );
+		crc = ComputeCRC32C ( 0, buf, len - sizeof(uint32_t) );
+	} else {
+		if ( (wireGet<int> ( buf + Event::staticOffsetLenInfo() ) & NET_CRC_FLAG) == 0 ) return true;
+		crc_recv = wireGet<uint32_t> ( buf + Event::staticOffsetCIDInfo() );
+		wirePut<uint32_t> ( buf + Event::staticOffsetCIDInfo(), 0 );
+		crc = ComputeCRC32C ( 0, buf, len );
+	}
+	if ( crc == crc_recv ) return true;
+
+	s.crcErrors++;
+	m_checksumErrors++;
+	netPrintf ( PRINT_ERROR, "CRC mismatch on sock %d, event %s (%d bytes). Dropped. Total errors: %llu", sock_i, nameToStr( netEventName ( s, buf ) ).c_str(), len, m_checksumErrors );
+	return false;
+}
+
+// Total serialized length of an event (header + payload), from its header in either format.
+// Returns 0 until enough of the header has arrived, -1 if malformed or larger
+// than NET_MAX_EVENT. Sets s.eventHdr.
+int NetworkSystem::netEventLength ( NetSock& s, char* buf, int avail )
+{
+	int len;
+	if ( s.compactRx ) {
+		int data_len;
+		s.eventHdr = Event::staticCompactHeader ( buf, avail, data_len );
+		if ( s.eventHdr <= 0 ) return s.eventHdr;
+		len = data_len + ( ( buf[0] & NET_CH_CRC ) ? (int) sizeof(uint32_t) : 0 );
+	} else {
+		if ( avail < Event::staticSerializedHeaderSize() ) return 0;
+		s.eventHdr = Event::staticSerializedHeaderSize();
+		len = wireGet<int> ( buf + Event::staticOffsetLenInfo() ) & ~NET_LEN_FLAGS;
+	}
+	if ( len < 0 || len > NET_MAX_EVENT - s.eventHdr ) return -1;		// length comes off the wire
+	return s.eventHdr + len;
+}
+
+// Event name from a serialized header, either format. Needs s.eventHdr.
+eventStr_t NetworkSystem::netEventName ( NetSock& s, char* buf )
+{
+	if ( !s.compactRx ) return wireGet<eventStr_t> ( buf + Event::staticOffsetLenInfo() + 4 );
+	int offs = s.eventHdr - sizeof(eventStr_t);
+	if ( buf[0] & EVENT_CH_TARGET )	offs -= sizeof(eventStr_t);
+	if ( buf[0] & EVENT_CH_TIME )	offs -= sizeof(sjtime);
+	return wireGet<eventStr_t> ( buf + offs );
+}
+
+xlong NetworkSystem::getChecksumErrors ( int sock_i )
+{
+	if ( sock_i == -1 ) return m_checksumErrors;
+	if ( !valid_socket_index ( sock_i ) ) return 0;
+	return m_socks[ sock_i ].crcErrors;
+}
+
+// Build and queue one complete event. buf holds s.eventLen bytes, header first.
+void NetworkSystem::netReceiveEvent ( int sock_i, char* buf )
+{
+	NetSock& s = m_socks[ sock_i ];
+
+	// Descriptors passed with this event (unix domain)
+	std::vector<int> fds;
+	xlong at = s.rxEventPos;
+	s.rxEventPos += s.eventLen;
+	if ( s.rxFds.size() > 0 ) netTakeDescriptors ( s, at, s.rxEventPos, fds );
+
+	if ( !netVerifyChecksum ( sock_i, buf, s.eventLen ) ) {
+		// Integrity check failed, drop event
+		NET_TRACE ( NTR_RX_DROP, netEventName ( s, buf ), sock_i, s.eventLen );
+		netCloseDescriptors ( fds );
+		return;
+	}
+	// Create event; target and time stamp will be set during deserialize
+	bool call;
+	int data_len = s.eventLen - s.eventHdr;
+	if ( s.compactRx && ( buf[0] & NET_CH_CRC ) ) data_len -= sizeof(uint32_t);
+	new_event ( *s.event, data_len, 'app ', netEventName ( s, buf ), 0, m_eventPool, "netRecv" );
+	s.event->rescope ( "nets" );								// belongs to network now
+	s.event->setSrcSock ( sock_i );							// tag event /w socket
+	s.event->setSrcIP ( s.src.ip );							// recover sender address from socket
+
+	// Deserialize directly from input buffer (for performance)
+	if ( s.compactRx ) {
+		s.event->deserializeCompact ( buf, s.eventHdr, data_len );
+		call = ( buf[0] & NET_CH_CALL ) != 0;
+	} else {
+		s.event->deserialize ( buf, s.eventLen );
+		call = ( wireGet<int> ( buf + Event::staticOffsetLenInfo() ) & NET_CALL_FLAG ) != 0;
+	}
+	netUnwrapCall ( *s.event, call );						// strip call id, if any
+
+	// Peer sends compact headers after 'cCmp' / 'sCmp'. Switch before framing the next event.
+	if ( s.event->getTarget () == 'net ' && ( s.event->getName () == 'cCmp' || s.event->getName () == 'sCmp' ) ) {
+		s.compactRx = true;
+	}
+	NET_TRACE ( NTR_RX_EVENT, s.event->getName(), sock_i, s.eventLen );
+	Event* eq = netQueueEvent ( *s.event );					// queue event (consumed later)
+	if ( fds.size() > 0 ) m_eventFds[ eq ].swap ( fds );	// handed out by netRecvDescriptor during its callback
+	s.rxEvents++;
+	s.rxEventsTick++;
+}
+
 void NetworkSystem::netDeserializeEvents(int sock_i)
 {
-	TRACE_ENTER ( (__func__) );
+	// Hot path. Traced with NET_TRACE records, not TRACE_ENTER or flow strings.
 	NetSock& s = m_socks[ sock_i ];
-	int header_sz = Event::staticSerializedHeaderSize();
 
 	// Consumer pattern:
 	// - retrieve entire event from stream directly if possible (for performance)
@@ -1801,10 +2441,11 @@ void NetworkSystem::netDeserializeEvents(int sock_i)
 	// Notes:
 	//  bufferLen = length of data remaining on this call (decreases as consumed)
 	//  eventLen  = total length of expected event (including header) 
+	//  eventHdr  = header length of expected event, full or compact (see netEventLength)
 	//  recvLen   = partial length currently received (over multiple calls to this func), when 0 = start new event
 	//  recvMax   = maximum length of temp buffer, may dynamic resize for large events	
 
-	netPrintf ( PRINT_FLOW, "PKT #%d, %d bytes.", s.pktCounter, s.pktLen );	
+	if ( m_printFlow ) netPrintf ( PRINT_FLOW, "PKT #%d, %d bytes.", s.pktCounter, s.pktLen );
 	
 	s.pktCounter++;
 	s.pktPtr = s.pktBuf;			// recv packet itself is atomic, start at beginning
@@ -1812,28 +2453,17 @@ void NetworkSystem::netDeserializeEvents(int sock_i)
 	xlong chksum = 0;
 
 	while ( s.pktLen > 0 ) {
-		if ( s.rxLen == 0 && s.pktLen >= header_sz ) { // Check for new or partial event
-			
-			// Start of new event, retrieve total event length from encoded header
-			s.eventLen = *((int*)(s.pktPtr + Event::staticOffsetLenInfo())) + Event::staticSerializedHeaderSize ( );
+		if ( s.rxLen == 0 && ( s.eventLen = netEventLength ( s, s.pktPtr, s.pktLen ) ) > 0 ) {
+			// Start of new event, total event length retrieved from encoded header
 
 			if ( s.pktLen >= s.eventLen ) {
-				// Create event; no name/target. will be set during deserialize		
-				eventStr_t name = *(eventStr_t*) (s.pktPtr + Event::staticOffsetLenInfo() + 4);
-				new_event ( *s.event, s.eventLen - Event::staticSerializedHeaderSize ( ), 'app ', name, 0, m_eventPool, "netRecv" );
-				s.event->rescope ( "nets" );									// belongs to network now
-				s.event->setSrcSock ( sock_i );								// tag event /w socket
-				s.event->setSrcIP( m_socks[ sock_i ].src.ip );				// recover sender address from socket
-				
-				// Deserialize directly from input buffer (for performance)				
-				s.event->deserialize ( s.pktPtr, s.eventLen );		// deserialize					
-				netQueueEvent ( *s.event );								// queue event (consumed later)				
+				netReceiveEvent ( sock_i, s.pktPtr );
 
 				// Checksum [debugging] - determine if send/recv buffers (events) match byte-for-byte
 				if (m_printFlow) {
 					chksum = ComputeChecksum(s.pktPtr, s.eventLen);
+					netPrintf ( PRINT_FLOW, "RX %d/%d bytes (rxLen=%d), %s --> RECV  chksum=%lld", s.pktLen, s.eventLen, s.rxLen, s.event->getNameStr ( ).c_str(), chksum );	
 				}
-				netPrintf ( PRINT_FLOW, "RX %d/%d bytes (rxLen=%d), %s --> RECV  chksum=%lld", s.pktLen, s.eventLen, s.rxLen, s.event->getNameStr ( ).c_str(), chksum );	
 
 				s.pktLen -= s.eventLen;								// consume event size in bytes
 				s.pktPtr += s.eventLen;
@@ -1846,38 +2476,31 @@ void NetworkSystem::netDeserializeEvents(int sock_i)
 				s.rxPtr += s.pktLen;											// advance recv buffer
 				s.rxLen += s.pktLen;
 				s.pktPtr += s.pktLen;											// consume remaining buffer len bytes
-				netPrintf(PRINT_FLOW, "RX %d/%d bytes (rxLen=%d), %s", s.pktLen, s.eventLen, s.rxLen, s.event->getNameStr().c_str());
+				NET_TRACE ( NTR_RX_PARTIAL, 0, sock_i, s.pktLen );
+				if ( m_printFlow ) netPrintf(PRINT_FLOW, "RX %d/%d bytes (rxLen=%d), %s", s.pktLen, s.eventLen, s.rxLen, s.event->getNameStr().c_str());
 				s.pktLen = 0;
 			}
 
 		} else { 
-			// Continuation of event. Store additional data in recv buffer						
+			// Continuation of event, or header not yet complete. Store additional data in recv buffer						
 			netExpandBuf(s.rxBuf, s.rxPtr, s.rxMax, s.rxLen, s.rxLen + s.pktLen);
 			memcpy ( s.rxPtr, s.pktPtr, s.pktLen );			// transfer into recv buffer
 			s.rxPtr += s.pktLen;								// advance recv buffer
 			s.rxLen += s.pktLen;			
 			s.pktPtr += s.pktLen;								// consume remaining buffer len bytes
-			netPrintf(PRINT_FLOW, "RX %d/%d bytes (rxLen=%d), %s", s.pktLen, s.eventLen, s.rxLen, s.event->getNameStr().c_str());
+			NET_TRACE ( NTR_RX_PARTIAL, 0, sock_i, s.pktLen );
+			if ( m_printFlow ) netPrintf(PRINT_FLOW, "RX %d/%d bytes (rxLen=%d), %s", s.pktLen, s.eventLen, s.rxLen, s.event->getNameStr().c_str());
 			s.pktLen = 0;
 
-			if (s.rxLen >= header_sz && s.eventLen == 0 )  {
-				s.eventLen = *((int*)(s.rxBuf + Event::staticOffsetLenInfo())) + Event::staticSerializedHeaderSize();				
+			if ( s.eventLen == 0 )  {
+				s.eventLen = netEventLength ( s, s.rxBuf, s.rxLen );
 			}
 		}
 
 		// Check for possibly multiple complete events on recv buffer
 		while ( s.rxLen >= s.eventLen && s.eventLen > 0 ) {
 
-			// Create event; no name/target. will be set during deserialize	
-			eventStr_t name = *(eventStr_t*) (s.pktPtr + Event::staticOffsetLenInfo() + 4);
-			new_event ( *s.event, s.eventLen - Event::staticSerializedHeaderSize ( ), 'net ', name, 0, m_eventPool, "netRecv" );
-			s.event->rescope ( "nets" );						// belongs to network now
-			s.event->setSrcSock ( sock_i );					// tag event /w socket
-			s.event->setSrcIP ( m_socks[ sock_i ].src.ip );		// recover sender address from socket
-				
-			// Deserialize event from recv buf			
-			s.event->deserialize ( s.rxBuf, s.eventLen );	// deserialize			
-			netQueueEvent ( *s.event );							// queue event (consumed later)			
+			netReceiveEvent ( sock_i, s.rxBuf );
 			
 			// Checksum [debugging] - determine if send/recv buffers (events) match byte-for-byte
 			if ( m_printFlow ) {
@@ -1888,16 +2511,19 @@ void NetworkSystem::netDeserializeEvents(int sock_i)
 			memmove ( s.rxBuf, s.rxBuf + s.eventLen, s.rxLen);		// must us an overlap-safe memory copy (not memcpy), to shift the data back
 			s.rxPtr = s.rxBuf + s.rxLen;						// reset to beginning of recv						
 
-			netPrintf(PRINT_FLOW, "RX %d/%d bytes (rxLen=%d), %s --> RECV  chksum=%lld", s.eventLen, s.eventLen, s.rxLen, s.event->getNameStr().c_str(), chksum );
-			s.eventLen = 0;													// reset event len
+			if ( m_printFlow ) netPrintf(PRINT_FLOW, "RX %d/%d bytes (rxLen=%d), %s --> RECV  chksum=%lld", s.eventLen, s.eventLen, s.rxLen, s.event->getNameStr().c_str(), chksum );
 
 			// Check for additional event(s)
-			if (s.rxLen > header_sz) {
-				s.eventLen = *((int*)(s.rxBuf + Event::staticOffsetLenInfo())) + Event::staticSerializedHeaderSize();	
-			}
+			s.eventLen = netEventLength ( s, s.rxBuf, s.rxLen );
+		}
+
+		if ( s.eventLen < 0 ) {
+			// Header cannot be framed. Nothing after it can be either, so drop the stream.
+			netPrintf ( PRINT_ERROR, "Malformed event header on sock %d. Dropped %d bytes.", sock_i, s.rxLen + s.pktLen );
+			s.rxLen = s.pktLen = s.eventLen = 0;
+			s.rxPtr = s.rxBuf;
 		}
 	}
-	TRACE_EXIT ( (__func__) );
 } 
 
 // -- Original deserialize func (NOT CORRECT)
@@ -2017,22 +2643,35 @@ void NetworkSystem::netReceiveByInjectedBuf(int sock_i, char* buf, int buflen )
 
 void NetworkSystem::netReceiveData ( int sock_i )
 {
-	TRACE_ENTER ( (__func__) );
 	NetSock& s = m_socks[ sock_i ];	
 	int result = 1;
+	int len;
+
+	if ( s.rxBucket.rate > 0 ) s.rxBucket.refill ( TimeX::GetSystemNSec ( ) );
 
 	while ( result > 0 ) {
 
-		result = netSocketRecv ( sock_i, s.pktBuf, s.pktMax );
+		// Inbound budget. Data left unread stays in the socket until the next tick.
+		len = s.pktMax;
+		if ( s.rxBucket.rate > 0 && s.rxBucket.tokens < len ) len = (int) s.rxBucket.tokens;
+		if ( len <= 0 || ( m_rxEventBudget > 0 && s.rxEventsTick >= m_rxEventBudget ) ) {
+			s.rxLimited++;
+			return;
+		}
+
+		result = netSocketRecv ( sock_i, s.pktBuf, len );
 		
 		if ( result < 0 ) {
 			// recv error
+			NET_TRACE ( NTR_RECV_ERROR, 0, sock_i, result );
 			netManageTransmitError ( sock_i, "recv error" );			
-			TRACE_EXIT ( (__func__) );
 			return;
 
 		} else if ( result > 0 ) {
 			// received bytes. deserialize.
+			NET_TRACE ( NTR_RECV, 0, sock_i, result );
+			s.rxBucket.take ( result );
+			s.rxBytes += result;
 			s.pktLen = result; 
 			assert ( result <= s.pktMax );
 			netDeserializeEvents(sock_i);
@@ -2050,17 +2689,15 @@ void NetworkSystem::netReceiveData ( int sock_i )
 		#endif			
 	}
 	// done when result = 0
-
-	TRACE_EXIT ( (__func__) );	
 }
 
 //----------------------------------------------------------------------------------------------------------------------
 // -> Send CODE <-
 //----------------------------------------------------------------------------------------------------------------------
 
-void NetworkSystem::netQueueEvent ( Event& e )
+Event* NetworkSystem::netQueueEvent ( Event& e )
 {
-	TRACE_ENTER ( (__func__) );
+	// Hot path, once per received event. The batch is traced by net*ProcessIO.
 
 	// persistent event
 	Event* eq = new Event;
@@ -2069,8 +2706,7 @@ void NetworkSystem::netQueueEvent ( Event& e )
 	eq->rescope ( "nets" );
 
 	m_eventQueue.Push ( eq );	// data payload is owned by queued event
-
-	TRACE_EXIT ( (__func__) );
+	return eq;
 }
 
 void NetworkSystem::netMakeEvent ( Event& e, eventStr_t name, eventStr_t sys )
@@ -2104,7 +2740,7 @@ int NetworkSystem::netFindSocket ( int side, int mode, int state, NetAddr dest )
 	TRACE_ENTER ( (__func__) );
 	for ( int n = 0; n < m_socks.size ( ); n++ ) { // Find socket with specific destination
 		if ( m_socks[ n ].mode == mode && m_socks[ n ].side == side && m_socks[ n].state == state ) {
-			if ( m_socks[ n ].dest.type == dest.type &&  m_socks[ n ].dest.ip == dest.ip && m_socks[ n ].dest.port == dest.port ) {
+			if ( m_socks[ n ].dest.type == dest.type &&  m_socks[ n ].dest.ip == dest.ip && m_socks[ n ].dest.port == dest.port && m_socks[ n ].dest.path == dest.path ) {
 				TRACE_EXIT ( (__func__) );
 				return n;
 			}
@@ -2118,7 +2754,7 @@ int NetworkSystem::netFindOutgoingSocket ( bool bTcp )
 {
 	TRACE_ENTER ( (__func__) );
 	for ( int n=0; n < m_socks.size ( ); n++ ) { // Find first fully-connected outgoing socket
-		if ( m_socks[ n ].mode==NET_TCP && m_socks[ n ].state == STATE_CONNECTED ) {
+		if ( m_socks[ n ].mode != NET_UDP && m_socks[ n ].state == STATE_CONNECTED ) {
 			TRACE_EXIT ( (__func__) );
 			return n;
 		}
@@ -2138,7 +2774,11 @@ str NetworkSystem::netPrintAddr ( NetAddr adr )
 	case NTYPE_SEARCH:		type = "srch";	break;
 	case NTYPE_CONNECT:		type = "conn";	break;
 	};
-	sprintf ( buf, "%s,%s:%d", type.c_str(), getIPStr(adr.ip).c_str(), adr.port );
+	if ( adr.isLocal() ) {
+		snprintf ( buf, 128, "%s,unix:%s", type.c_str(), adr.path.c_str() );
+	} else {
+		sprintf ( buf, "%s,%s:%d", type.c_str(), getIPStr(adr.ip).c_str(), adr.port );
+	}
 	TRACE_EXIT ( (__func__) );
 	return buf;
 }
@@ -2156,6 +2796,7 @@ void NetworkSystem::netList ( bool verbose )
 		for ( int n = 0; n < m_socks.size (); n++ ) {
 			side = ( m_socks[n].side == NET_CLI ) ? "cli" : "srv";
 			secur = (m_socks[n].security & NET_SECURITY_OPENSSL) ? "ssl" : "tcp";			// future: udp should made a security level, remove s.mode variable.
+			if ( m_socks[n].mode == NET_UNIX ) secur = "unx";
 			stat == "";
 			switch ( m_socks[n].state ) {
 			case STATE_NONE:			stat = "off      ";	break;
@@ -2177,6 +2818,233 @@ void NetworkSystem::netList ( bool verbose )
 	TRACE_EXIT ( (__func__) );
 }
 
+//----------------------------------------------------------------------------------------------------------------------
+// -> CALL CODE <-
+//----------------------------------------------------------------------------------------------------------------------
+
+xlong NetCallStats::getPercentileUsec ( float pct )
+{
+	if ( replies == 0 ) return 0;
+	xlong target = xlong( pct * replies );
+	xlong sum = 0;
+	for ( int b = 0; b < NET_CALL_HIST; b++ ) {
+		sum += hist[ b ];
+		if ( sum > target ) return imin ( xlong(1) << (b + 1), maxUsec );
+	}
+	return maxUsec;
+}
+
+uint32_t NetworkSystem::netCall ( int sock_i, Event& e, funcCallHandler func, int timeout_ms, void* user )
+{
+	TRACE_ENTER ( (__func__) );
+	if ( !valid_socket_index ( sock_i ) || func == 0x0 ) {
+		netPrintf ( PRINT_ERROR, "netCall: invalid socket %d or no handler.", sock_i );
+		TRACE_EXIT ( (__func__) );
+		return 0;
+	}
+
+	// Allocate a call slot. The id carries slot and generation, so replies match in O(1)
+	// and a late reply to an expired call cannot match the slot's next call.
+	int slot;
+	if ( m_callsFree.size ( ) > 0 ) {
+		slot = m_callsFree.back ( );
+		m_callsFree.pop_back ( );
+	} else {
+		if ( m_calls.size ( ) > 0xFFFF ) {
+			netPrintf ( PRINT_ERROR, "netCall: too many calls in flight (%d).", m_callsActive );
+			TRACE_EXIT ( (__func__) );
+			return 0;
+		}
+		slot = (int) m_calls.size ( );
+		m_calls.push_back ( NetCall() );
+		m_calls[ slot ].gen = 0;
+	}
+	NetCall& c = m_calls[ slot ];
+	c.gen = ( c.gen % 0x7FFF ) + 1;				// 1..0x7FFF, id is never 0 and leaves NET_CALL_REPLY clear
+	c.id = ( uint32_t(c.gen) << 16 ) | uint32_t(slot);
+	c.sock = sock_i;
+	c.name = e.getName ( );
+	c.func = func;
+	c.user = user;
+	c.start = TimeX::GetSystemNSec ( );
+	c.deadline = c.start + sjtime(timeout_ms) * MSEC_SCALAR;
+	uint32_t id = c.id;
+
+	e.mCallID = id;
+	bool ok = netSend ( e, sock_i );
+	e.mCallID = 0;
+	if ( !ok ) {
+		m_calls[ slot ].id = 0;
+		m_callsFree.push_back ( slot );
+		TRACE_EXIT ( (__func__) );
+		return 0;
+	}
+	m_callsActive++;
+	m_callStats[ m_calls[ slot ].name ].calls++;
+
+	// Deadlines are removed lazily; rebuild when mostly stale
+	if ( m_callDeadlines.size ( ) > size_t ( 2 * m_callsActive + 1024 ) ) {
+		m_callDeadlines = decltype( m_callDeadlines ) ( );
+		for ( size_t n = 0; n < m_calls.size ( ); n++ ) {
+			if ( m_calls[ n ].id != 0 && n != (size_t) slot ) m_callDeadlines.push ( callDeadline_t ( m_calls[ n ].deadline, m_calls[ n ].id ) );
+		}
+	}
+	m_callDeadlines.push ( callDeadline_t ( m_calls[ slot ].deadline, id ) );
+
+	TRACE_EXIT ( (__func__) );
+	return id;
+}
+
+bool NetworkSystem::netReply ( Event& request, Event& reply )
+{
+	if ( request.mCallID == 0 || ( request.mCallID & NET_CALL_REPLY ) ) {
+		netPrintf ( PRINT_ERROR, "netReply: event %s is not a call.", request.getNameStr ( ).c_str ( ) );
+		return false;
+	}
+	int sock_i = request.getSrcSock ( );
+	if ( !valid_socket_index ( sock_i ) || m_socks[ sock_i ].state != STATE_CONNECTED ) return false;
+	reply.mCallID = request.mCallID | NET_CALL_REPLY;
+
+	// Send now unless earlier replies are waiting. If refused (partial send pending, or
+	// budget), keep a copy and send it from netProcessQueue once the socket drains.
+	std::map< int, std::deque< Event* > >::iterator it = m_replyQueue.find ( sock_i );
+	if ( it == m_replyQueue.end ( ) && netSend ( reply, sock_i ) ) {
+		reply.mCallID = 0;
+		return true;
+	}
+	Event* eq = new Event;
+	eq->copy ( reply );
+	eq->persist ();
+	eq->rescope ( "nets" );
+	m_replyQueue[ sock_i ].push_back ( eq );
+	reply.mCallID = 0;
+	return true;
+}
+
+// Send queued replies in order, stopping on each socket at the first refusal
+void NetworkSystem::netSendQueuedReplies ( )
+{
+	std::map< int, std::deque< Event* > >::iterator it = m_replyQueue.begin ( );
+	while ( it != m_replyQueue.end ( ) ) {
+		std::deque< Event* >& q = it->second;
+		while ( q.size ( ) > 0 && netSend ( *q.front ( ), it->first ) ) {
+			q.front ( )->consume ( );
+			delete q.front ( );
+			q.pop_front ( );
+		}
+		if ( q.size ( ) == 0 ) it = m_replyQueue.erase ( it );
+		else ++it;
+	}
+}
+
+void NetworkSystem::netDropQueuedReplies ( int sock_i )
+{
+	std::map< int, std::deque< Event* > >::iterator it = m_replyQueue.find ( sock_i );
+	if ( it == m_replyQueue.end ( ) ) return;
+	for ( size_t n = 0; n < it->second.size ( ); n++ ) {
+		it->second[ n ]->consume ( );
+		delete it->second[ n ];
+	}
+	netPrintf ( PRINT_VERBOSE, "Dropped %d queued replies for closed sock %d.", (int) it->second.size ( ), sock_i );
+	m_replyQueue.erase ( it );
+}
+
+// Recover call id from a deserialized event. call is the header's call flag.
+void NetworkSystem::netUnwrapCall ( Event& e, bool call )
+{
+	e.mCallID = 0;
+	if ( call && e.mDataLen >= (int) sizeof(uint32_t) ) {
+		e.mDataLen -= sizeof(uint32_t);
+		e.mCallID = wireGet<uint32_t> ( e.mData + e.mDataLen );
+		e.mPos = e.mData + e.mDataLen;
+	}
+}
+
+void NetworkSystem::netCompleteCall ( Event& e )
+{
+	uint32_t id = e.mCallID & ~NET_CALL_REPLY;
+	size_t slot = id & 0xFFFF;
+	if ( slot >= m_calls.size ( ) || m_calls[ slot ].id != id ) {
+		netPrintf ( PRINT_VERBOSE, "Reply %s for unknown or expired call %08x. Dropped.", e.getNameStr ( ).c_str ( ), id );
+		return;
+	}
+	if ( m_calls[ slot ].sock != e.getSrcSock ( ) ) {				// ids are guessable, only the callee may answer
+		netPrintf ( PRINT_ERROR, "Reply %s for call %08x came from sock %d, call was to sock %d. Dropped.", e.getNameStr ( ).c_str ( ), id, e.getSrcSock ( ), m_calls[ slot ].sock );
+		return;
+	}
+	netFinishCall ( slot, e, NET_CALL_OK );
+}
+
+void NetworkSystem::netFinishCall ( int slot, Event& e, int status )
+{
+	NetCall c = m_calls[ slot ];			// copy, handler may issue new calls
+	m_calls[ slot ].id = 0;
+	m_callsFree.push_back ( slot );
+	m_callsActive--;
+
+	NetCallStats& st = m_callStats[ c.name ];
+	if ( status == NET_CALL_OK ) {
+		xlong usec = xlong( TimeX::GetSystemNSec ( ) - c.start ) / 1000;
+		int b = 0;
+		while ( b < NET_CALL_HIST - 1 && ( usec >> (b + 1) ) > 0 ) b++;
+		st.hist[ b ]++;
+		st.replies++;
+		st.sumUsec += usec;
+		if ( usec > st.maxUsec ) st.maxUsec = usec;
+	} else if ( status == NET_CALL_TIMEOUT ) {
+		st.timeouts++;
+	} else {
+		st.closed++;
+	}
+	e.startRead ( );
+	(*c.func) ( e, status, this, c.user );
+}
+
+void NetworkSystem::netCheckCallTimeouts ( )
+{
+	if ( m_callDeadlines.empty ( ) ) return;
+	sjtime now = TimeX::GetSystemNSec ( );
+	while ( !m_callDeadlines.empty ( ) && m_callDeadlines.top ( ).first <= now ) {
+		uint32_t id = m_callDeadlines.top ( ).second;
+		m_callDeadlines.pop ( );
+		size_t slot = id & 0xFFFF;
+		if ( slot < m_calls.size ( ) && m_calls[ slot ].id == id ) {		// skip completed calls
+			Event te ( 'app ', m_calls[ slot ].name );
+			netFinishCall ( slot, te, NET_CALL_TIMEOUT );
+		}
+	}
+}
+
+// Fail all calls waiting on a socket that has gone away
+void NetworkSystem::netCancelCalls ( int sock_i )
+{
+	for ( size_t n = 0; n < m_calls.size ( ); n++ ) {
+		if ( m_calls[ n ].id != 0 && m_calls[ n ].sock == sock_i ) {
+			Event ce ( 'app ', m_calls[ n ].name );
+			netFinishCall ( n, ce, NET_CALL_CLOSED );
+		}
+	}
+}
+
+NetCallStats* NetworkSystem::getCallStats ( eventStr_t name )
+{
+	std::map< eventStr_t, NetCallStats >::iterator it = m_callStats.find ( name );
+	return ( it == m_callStats.end ( ) ) ? 0x0 : &it->second;
+}
+
+void NetworkSystem::netPrintCallStats ( )
+{
+	dbgprintf ( "\n------ CALLS. Pending: %d\n", m_callsActive );
+	dbgprintf ( "name    calls  replies timeouts closed  avg(us)  p50(us)  p99(us)  max(us)\n" );
+	for ( std::map< eventStr_t, NetCallStats >::iterator it = m_callStats.begin ( ); it != m_callStats.end ( ); it++ ) {
+		NetCallStats& st = it->second;
+		xlong avg = ( st.replies > 0 ) ? st.sumUsec / st.replies : 0;
+		dbgprintf ( "%s %8llu %8llu %8llu %6llu %8llu %8llu %8llu %8llu\n", nameToStr ( it->first ).c_str ( ),
+			st.calls, st.replies, st.timeouts, st.closed, avg, st.getPercentileUsec ( 0.50f ), st.getPercentileUsec ( 0.99f ), st.maxUsec );
+	}
+	dbgprintf ( "------\n" );
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // -> LOW-LEVEL WRAPPER <-
 //----------------------------------------------------------------------------------------------------------------------
@@ -2204,7 +3072,7 @@ bool NetworkSystem::netSendLiteral ( str str_lit, int sock_i )
 	strcpy ( buf, str_lit.c_str ( ) );	
 	
 	NetSock& s = m_socks[ sock_i ]; // Send over socket
-	if ( s.mode == NET_TCP ) {
+	if ( s.mode != NET_UDP ) {
 		if ( s.security == NET_SECURITY_PLAIN_TCP || s.state < STATE_HANDSHAKE ) {
 			result = send ( s.socket, buf, len, 0 ); // TCP/IP
 		} else {
@@ -2250,21 +3118,43 @@ void NetworkSystem::netSendResidualEvent ( int sock_i )
 	NetSock& s = m_socks[ sock_i ];	
 	int result = 0;
 
-	if ( s.security == NET_SECURITY_PLAIN_TCP || s.state < STATE_HANDSHAKE ) {
-		result = send ( s.socket, s.txBuf, s.txLen, 0 ); // TCP/IP
-	} else {
-		s.txLen = 0;
+	if ( s.txLen == 0 ) {
 		TRACE_EXIT ( (__func__) );
 		return;
-		//result = SSL_write ( s.ssl, s.txBuf + s.txSoFar, remaining );
+	}
+	if ( s.security == NET_SECURITY_PLAIN_TCP || s.state < STATE_HANDSHAKE ) {
+		result = netSocketSend ( sock_i, s.txBuf, s.txLen ); // TCP/IP or unix domain, carries a pending descriptor
+	} else {
+		#ifdef BUILD_OPENSSL
+			// A retry after WANT_READ/WANT_WRITE repeats the same txBuf and txLen, as TLS requires
+			result = SSL_write ( s.ssl, s.txBuf, s.txLen );
+			s.sslWantTx = 0;
+			if ( result <= 0 ) {
+				int err = SSL_get_error ( s.ssl, result );
+				if ( err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE ) {
+					s.sslWantTx = err;
+				} else {
+					str msg = netGetErrorStringSSL ( result, s.ssl );
+					netPrintf ( PRINT_ERROR, "Failed ssl write (residual): Return: %d: %s", result, msg.c_str ( ) );
+					netManageTransmitError ( sock_i, "ssl write error" );
+				}
+				TRACE_EXIT ( (__func__) );
+				return;
+			}
+		#else
+			s.txLen = 0;
+			TRACE_EXIT ( (__func__) );
+			return;
+		#endif
 	}
 	
 	if ( result > 0 ) {
+		NET_TRACE ( NTR_TX_RESIDUAL, 0, sock_i, result );
 		s.txLen -= result;
 		int remain = s.txLen;
 		memmove ( s.txBuf, s.txBuf + result, remain );		// overlapping move
 		s.txPtr = s.txBuf + remain;
-		if ( result != s.txLen ) {
+		if ( remain > 0 ) {
 			netPrintf ( PRINT_FLOW, "TX %d/%d (txLen=%d)", result, remain, s.txLen );
 		} else {
 			netPrintf ( PRINT_FLOW, "TX %d/%d (txLen=%d) - DONE", result, remain, s.txLen );			
@@ -2274,118 +3164,147 @@ void NetworkSystem::netSendResidualEvent ( int sock_i )
 	TRACE_EXIT ( (__func__) );
 }
 
+// Queue unsent bytes of an event. Sent by netSendResidualEvent when the socket is writable.
+void NetworkSystem::netQueueResidual ( int sock_i, char* buf, int len )
+{
+	NetSock& s = m_socks[ sock_i ];
+	netExpandBuf ( s.txBuf, s.txPtr, s.txMax, s.txLen, s.txLen + len );
+	memcpy ( s.txBuf + s.txLen, buf, len );
+	s.txLen += len;
+	s.txPtr = s.txBuf + s.txLen;
+	netPrintf ( PRINT_FLOW, "TX %d remain (txLen=%d)", len, s.txLen );
+}
+
 bool NetworkSystem::netSend ( Event& e, int sock_i )
 {
-	TRACE_ENTER ( (__func__) );
-	
+	// Hot path. Traced with NET_TRACE records, not TRACE_ENTER or flow strings.
+
 	// caller may wish to send on any outgoing socket
 	if ( sock_i == -1 ) { 
 		sock_i = netFindOutgoingSocket ( true );
-		if ( sock_i == -1 ) 						{ TRACE_EXIT ( (__func__) ); return false; }		
+		if ( sock_i == -1 ) 						return false;		
 	}
 	// check valid socket idx
-	if (!valid_socket_index(sock_i)) 		{ TRACE_EXIT ( (__func__) ); return false; }
+	if (!valid_socket_index(sock_i)) 		return false;
 
 	// get socket
 	NetSock& s = m_socks[ sock_i ];
 	
 	// cannot send on a listening socket
-	if ( m_socks[ sock_i ].src.type == NTYPE_ANY) 	{ TRACE_EXIT ( (__func__) ); return false; }
+	if ( m_socks[ sock_i ].src.type == NTYPE_ANY) 	return false;
 
 	// make sure we have a transmission buffer
-	if ( m_socks[ sock_i ].txLen > 0 ) 		{ TRACE_EXIT ( (__func__) ); return false; }	
+	if ( m_socks[ sock_i ].txLen > 0 ) 		return false;	
+
+	// outbound budget
+	if ( s.txBucket.rate > 0 ) s.txBucket.refill ( TimeX::GetSystemNSec ( ) );
+	if ( s.txBucket.limited ( ) || ( m_txEventBudget > 0 && s.txEventsTick >= m_txEventBudget ) ) {
+		s.txLimited++;
+		return false;
+	}
 
 	// make sure we have an event data buffer
 	int result;
 	e.rescope ( "nets" );
-	if ( e.mData == 0x0 ) 							{ TRACE_EXIT ( (__func__) ); return false; }
+	if ( e.mData == 0x0 ) 							return false;
 	
 	// event retains is persist/consume status
 	//  (will pass thru send back to caller)
 	//
-	e.serialize ();		// Prepare serialized buffer	
-	char* buf = e.getSerializedData ( );
-	int event_len = e.getSerializedLength ( );
+	if ( e.mCallID != 0 ) {
+		// call id trails the payload on the wire
+		if ( e.mDataLen + (int) sizeof(uint32_t) > e.mMax ) e.expand ( e.mDataLen*2 + sizeof(uint32_t) );
+		wirePut<uint32_t> ( e.mData + e.mDataLen, e.mCallID );
+		e.mDataLen += sizeof(uint32_t);
+	}
+	char* buf;
+	int event_len;
+	if ( s.compactTx ) {
+		// Compact header, negotiated for this connection. A CRC trails the event.
+		uchar flags = ( e.mCallID != 0 ) ? NET_CH_CALL : 0;
+		if ( s.crc ) {
+			flags |= NET_CH_CRC;
+			if ( e.mDataLen + (int) sizeof(uint32_t) > e.mMax ) e.expand ( e.mDataLen*2 + sizeof(uint32_t) );
+		}
+		buf = e.serializeCompact ( event_len, flags );
+		if ( s.crc ) {
+			wirePut<uint32_t> ( buf + event_len, ComputeCRC32C ( 0, buf, event_len ) );
+			event_len += sizeof(uint32_t);
+		}
+		if ( e.mCallID != 0 ) e.mDataLen -= sizeof(uint32_t);		// remove trailer from event, buf is unchanged
+	} else {
+		e.serialize ();		// Prepare serialized buffer	
+		buf = e.getSerializedData ( );
+		event_len = e.getSerializedLength ( );
+
+		if ( e.mCallID != 0 ) {
+			wirePut<int> ( buf + Event::staticOffsetLenInfo(), wireGet<int> ( buf + Event::staticOffsetLenInfo() ) | NET_CALL_FLAG );
+			e.mDataLen -= sizeof(uint32_t);		// remove trailer from event, buf is unchanged
+		}
+
+		// Integrity check, when negotiated for this connection
+		if ( s.crc ) {
+			netStampChecksum ( buf, event_len );
+		}
+	}
 
 	// Checksum [debugging] - determine if send/recv buffers match
-	xlong chksum = 0;
 	if ( m_printFlow ) {
-		chksum = ComputeChecksum( buf, event_len );		
+		xlong chksum = ComputeChecksum( buf, event_len );		
+		netPrintf ( PRINT_FLOW, "TX %d bytes, %s --> SENDING  chksum=%lld", event_len, e.getNameStr().c_str(), chksum );
 	}
 
-	netPrintf ( PRINT_FLOW, "TX %d bytes, %s --> SENDING  chksum=%lld", e.getSerializedLength (), e.getNameStr().c_str(), chksum );
-
-	if ( m_socks[ sock_i ].mode == NET_TCP ) { // Send over socket
+	if ( m_socks[ sock_i ].mode != NET_UDP ) { // Send over socket
 		if ( s.security == NET_SECURITY_PLAIN_TCP || s.state < STATE_HANDSHAKE ) {
 
-			result = send ( s.socket, buf, event_len, 0 ); // TCP/IP
+			result = netSocketSend ( sock_i, buf, event_len ); // TCP/IP or unix domain
 
 			if ( result > 0 ) {			
 				// bytes sent
 				if ( result == event_len ) {
 					// full event sent					
+					NET_TRACE ( NTR_TX_EVENT, e.getName(), sock_i, event_len );
 				} else {
 					// partial event sent, transmit more later
-					int remain = event_len - result;
-					netExpandBuf (s.txBuf, s.txPtr, s.txMax, s.txLen, s.txLen + remain);
-					memcpy ( s.txPtr, buf + result, remain);
-					s.txLen += remain;					
-					s.txBuf[ event_len ] = '\0';
-					netPrintf ( PRINT_FLOW, "TX %d/%d, %d remain (txLen=%d)", result, event_len, remain, s.txLen );
+					NET_TRACE ( NTR_TX_PARTIAL, e.getName(), sock_i, result );
+					netQueueResidual ( sock_i, buf + result, event_len - result );
 				}
+				netCountSend ( s, event_len );
 				
 				// done
-				TRACE_EXIT ( (__func__) );
 				return true;
 			}
 			
 		} else {
 			#ifdef BUILD_OPENSSL
 				
-				fd_set sockSet;
-				struct timeval tv = { 0, 0 };
-				int fd = SSL_get_fd ( s.ssl );
-				FD_ZERO ( &sockSet );
-				FD_SET ( fd, &sockSet );	
-				if ( select ( fd + 1, NULL, &sockSet, NULL, &tv ) < 0 ) {
-					TRACE_EXIT ( (__func__) );
-					return false;
-				}
-				
 				result = SSL_write ( s.ssl, buf, event_len );
 
 				if ( result > 0 ) {
 					// bytes sent
-					if ( result == event_len ) {
-						// full event sent
-					} else if ( result < event_len ) {	
-						// partial event sent, transmit more later
-						netExpandBuf (s.txBuf, s.txPtr, s.txMax, s.txLen, event_len + 1);
-						s.txLen = result;
-						s.txPktSize = result;
-						memcpy ( s.txBuf, buf, result );
-						// s.txBuf[ event_len ] = '\0';					
-						netPrintf ( PRINT_VERBOSE, "1 Partial TX: %d < %d", result, event_len);					
-						std::cin.get();						
-					}	else {
-						netPrintf(PRINT_ERROR, "Unexpected TX: %d > %d", result, event_len );
-						exit(-77);
+					if ( result < event_len ) {	
+						// partial event sent (SSL_MODE_ENABLE_PARTIAL_WRITE), transmit more later
+						NET_TRACE ( NTR_TX_PARTIAL, e.getName(), sock_i, result );
+						netQueueResidual ( sock_i, buf + result, event_len - result );
+					} else {
+						NET_TRACE ( NTR_TX_EVENT, e.getName(), sock_i, event_len );
 					}
-					
-					TRACE_EXIT ( (__func__) );
+					netCountSend ( s, event_len );
 					return true;
 
 				} else {
 					// no bytes sent. check why.
-					if ( netNonFatalErrorSSL ( sock_i, result ) ) { 
-						str msg = netGetErrorStringSSL ( result, s.ssl );
-						s.txLen = 0;
-						netPrintf ( PRINT_ERROR, "Non fatal SSL error: Return: %d: %s", result, msg.c_str ( ) );
-						TRACE_EXIT ( (__func__) );
-						return false;						
+					int err = SSL_get_error ( s.ssl, result );
+					if ( err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE ) { 
+						// TLS must retry with the same bytes, so queue the whole event and resume when ready
+						NET_TRACE ( NTR_TX_PARTIAL, e.getName(), sock_i, 0 );
+						netQueueResidual ( sock_i, buf, event_len );
+						s.sslWantTx = err;
+						netCountSend ( s, event_len );
+						return true;
 					} else {
 						str msg = netGetErrorStringSSL ( result, s.ssl );
-						netPrintf ( PRINT_ERROR, "1 Failed ssl write (2): Return: %d: %s", result, msg.c_str ( ) );
+						netPrintf ( PRINT_ERROR, "Failed ssl write: Return: %d: %s", result, msg.c_str ( ) );
 					}
 				} 
 			#endif
@@ -2397,10 +3316,83 @@ bool NetworkSystem::netSend ( Event& e, int sock_i )
 	}
 	
 	// if we got here, send failed
-	TRACE_EXIT ( (__func__) );
+	NET_TRACE ( NTR_TX_FAIL, e.getName(), sock_i, event_len );
 	return false;	
 }
 
+// Send a shared event through a private view, so the shared Event is never modified.
+// The wire header and trailers are written around the shared payload (room is kept
+// for them, see SharedEvent), so sends of one event from several threads take turns.
+bool NetworkSystem::netSend ( SharedEvent& e, int sock_i )
+{
+	if ( e.isEmpty ( ) ) return false;
+	Event view;
+	e.getReader ( view );
+	if ( view.mMax < view.mDataLen + SHARED_EVENT_TRAILER ) {
+		Event copy ( (const Event&) view );		// grown through getWritable without trailer room. Send a private copy.
+		return netSend ( copy, sock_i );
+	}
+	std::lock_guard<std::mutex> lock ( e.getBlock ( )->sendLock );
+	return netSend ( view, sock_i );
+}
+
+void NetworkSystem::netCountSend ( NetSock& s, int len )
+{
+	s.txBucket.take ( len );
+	s.txBytes += len;
+	s.txEvents++;
+	s.txEventsTick++;
+}
+
+bool NetworkSystem::netSendDescriptor ( Event& e, int fd, int sock_i )
+{
+	TRACE_ENTER ( (__func__) );
+	if ( !valid_socket_index(sock_i) || m_socks[ sock_i ].mode != NET_UNIX || fd < 0 ) {
+		netPrintf ( PRINT_ERROR, "Descriptors can only be sent on unix domain sockets." );
+		TRACE_EXIT ( (__func__) );
+		return false;
+	}
+	// descriptor rides with the first byte of this event.
+	// the receiver gets it from netRecvDescriptor in the callback for this event.
+	// if the event is queued before any byte is written, txFd stays set and
+	// goes with the first residual send (see netSocketSend).
+	m_socks[ sock_i ].txFd = fd;
+	bool ok = netSend ( e, sock_i );
+	if ( !ok ) m_socks[ sock_i ].txFd = -1;		// nothing queued, caller keeps fd
+	TRACE_EXIT ( (__func__) );
+	return ok;
+}
+
+int NetworkSystem::netRecvDescriptor ( int sock_i )
+{
+	// only the descriptors passed with the event being handled
+	if ( sock_i != m_dispatchSock || m_dispatchFds.size() == 0 ) return -1;
+	int fd = m_dispatchFds[0];
+	m_dispatchFds.erase ( m_dispatchFds.begin() );		// caller owns fd now
+	return fd;
+}
+
+// Move descriptors that arrived with the event at stream range [at,end) into fds.
+// A read's descriptors belong to the event holding its last byte. Reads that ended
+// before this event carried descriptors for no event, and are closed.
+void NetworkSystem::netTakeDescriptors ( NetSock& s, xlong at, xlong end, std::vector<int>& fds )
+{
+	size_t n = 0;
+	for ( ; n < s.rxFds.size() && s.rxFds[n].to <= end; n++ ) {
+		if ( s.rxFds[n].to > at ) fds.insert ( fds.end(), s.rxFds[n].fds.begin(), s.rxFds[n].fds.end() );
+		else netCloseDescriptors ( s.rxFds[n].fds );
+	}
+	s.rxFds.erase ( s.rxFds.begin(), s.rxFds.begin() + n );
+}
+
+void NetworkSystem::netCloseDescriptors ( std::vector<int>& fds )
+{
+	#ifdef CX_UNIX_SOCK
+		for ( size_t n = 0; n < fds.size(); n++ ) close ( fds[n] );
+	#endif
+	fds.clear ();
+}
+
 // create a transport socket
 //
 int NetworkSystem::netSocketCreate ( int sock_i )
@@ -2412,6 +3404,10 @@ int NetworkSystem::netSocketCreate ( int sock_i )
 	if ( s.socket == 0 ) {
 		if ( s.mode == NET_TCP ) {
 			s.socket = socket ( AF_INET, SOCK_STREAM, IPPROTO_TCP ); 
+		#ifdef CX_UNIX_SOCK
+		} else if ( s.mode == NET_UNIX ) {
+			s.socket = socket ( AF_UNIX, SOCK_STREAM, 0 ); 
+		#endif
 		} else {
 			s.socket = socket ( AF_INET, SOCK_DGRAM, IPPROTO_UDP ); 
 		}
@@ -2419,6 +3415,11 @@ int NetworkSystem::netSocketCreate ( int sock_i )
 	CXSocketUpdateAddr ( sock_i, true );
 	CXSocketUpdateAddr ( sock_i, false );
 
+	if ( m_busyPoll ) {
+		CXSocketBusyPoll ( s.socket, m_busyPollUsec );
+		if ( s.mode == NET_TCP ) CXSocketMakeNoDelay ( s.socket );
+	}
+
 	TRACE_EXIT ( (__func__) );
 	return 1;
 }
@@ -2427,11 +3428,14 @@ int NetworkSystem::netSocketBind ( int sock_i )
 {
 	TRACE_ENTER ( (__func__) );
 	NetSock* s = &m_socks [ sock_i ];
-	int addr_size;
-	addr_size = sizeof ( s->src.addr );
 	netPrintf ( PRINT_VERBOSE, "Bind: %s, port %i", ( s->side == NET_CLI ) ? "cli" : "srv", s->src.port );
+	#ifdef CX_UNIX_SOCK
+		if ( s->mode == NET_UNIX && !s->src.isAbstract() ) {
+			unlink ( s->src.path.c_str() );			// stale path from a previous run would fail bind
+		}
+	#endif
 	int ret = 0;
-	ret = bind ( s->socket, (sockaddr*) &s->src.addr, addr_size );
+	ret = bind ( s->socket, s->src.getSockAddr(), s->src.getSockAddrLen() );
 	if ( netFuncError(ret) ) {
 		netPrintf ( PRINT_ERROR, "Cannot bind to source: Return: %d", ret );
 	}
@@ -2472,12 +3476,14 @@ int NetworkSystem::netSocketConnect ( int sock_i )
 	std::string msg;
 	TRACE_ENTER ( (__func__) );
 	NetSock* s = &m_socks[ sock_i ];
-	int addr_size;
-	addr_size = sizeof ( s->dest.addr );
 
-	netPrintf ( PRINT_VERBOSE_HS, "Trying connect. Client %s:%d  -> Srv %s:%d", getIPStr(s->src.ip).c_str(), s->src.port, getIPStr (s->dest.ip ).c_str ( ), s->dest.port );
+	if ( s->mode == NET_UNIX ) {
+		netPrintf ( PRINT_VERBOSE_HS, "Trying connect. Client -> Srv unix:%s", s->dest.path.c_str() );
+	} else {
+		netPrintf ( PRINT_VERBOSE_HS, "Trying connect. Client %s:%d  -> Srv %s:%d", getIPStr(s->src.ip).c_str(), s->src.port, getIPStr (s->dest.ip ).c_str ( ), s->dest.port );
+	}
 
-	int ret = connect (s->socket, (sockaddr*)&s->dest.addr, addr_size);
+	int ret = connect (s->socket, s->dest.getSockAddr(), s->dest.getSockAddrLen() );
 
 	if ( netFuncError(ret) ) {
 
@@ -2513,10 +3519,14 @@ int NetworkSystem::netSocketAccept ( int sock_i, CX_SOCKET& tcp_sock, netIP& cli
 	TRACE_ENTER ( (__func__) );
 	std::string msg;
 	NetSock& s = m_socks [ sock_i ];
-	struct sockaddr_in sin;
-	int addr_size = sizeof ( sin );
+	struct sockaddr_storage sin;
+	CX_SOCKLEN addr_size = sizeof ( sin );
 
-	tcp_sock = accept ( s.socket, (sockaddr*) &sin, (socklen_t *) (&addr_size) );
+	#ifdef __linux__
+		tcp_sock = accept4 ( s.socket, (sockaddr*) &sin, &addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC );
+	#else
+		tcp_sock = accept ( s.socket, (sockaddr*) &sin, &addr_size );
+	#endif
 
 	if ( !CXSocketIsValid ( tcp_sock ) ) {
 		if ( CXSocketWouldBlock( msg ) ) {
@@ -2532,8 +3542,13 @@ int NetworkSystem::netSocketAccept ( int sock_i, CX_SOCKET& tcp_sock, netIP& cli
 	}
 
 	// Accept completed.
-	cli_ip = sin.sin_addr.s_addr;		// IP address of connecting client
-	cli_port = sin.sin_port;				// Accepting TCP does not know/care what the client port is
+	if ( sin.ss_family == AF_INET ) {
+		cli_ip = ((sockaddr_in*) &sin)->sin_addr.s_addr;		// IP address of connecting client
+		cli_port = ((sockaddr_in*) &sin)->sin_port;			// Accepting TCP does not know/care what the client port is
+	} else {
+		cli_ip = 0;															// unix domain peers have no address
+		cli_port = 0;
+	}
 	TRACE_EXIT ( (__func__) );
 
 	return 1;
@@ -2553,6 +3568,11 @@ int NetworkSystem::netSocketRecv ( int sock_i, char* buf, int bufmax )
 	}
 	
 	addr_size = sizeof ( s.src.addr );
+	if ( s.mode == NET_UNIX ) {
+		result = netSocketRecvLocal ( sock_i, buf, bufmax );	// unix domain, may carry descriptors
+		TRACE_EXIT ( (__func__) );
+		return result;
+	}
 	if ( s.mode == NET_TCP ) {
 		if ( s.security == NET_SECURITY_PLAIN_TCP || s.state < STATE_HANDSHAKE ) { 
 
@@ -2569,13 +3589,22 @@ int NetworkSystem::netSocketRecv ( int sock_i, char* buf, int bufmax )
 		} else {
 			#ifdef BUILD_OPENSSL
 				result = SSL_read(s.ssl, buf, bufmax);
+				s.sslWantRx = 0;
 				if ( result <= 0 ) {
-					if ( netNonFatalErrorSSL ( sock_i, result ) ) { 
+					int err = SSL_get_error ( s.ssl, result );
+					if ( err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE ) {
+						s.sslWantRx = err;
+						TRACE_EXIT ( (__func__) );
+						return 0;			// pending, no error
+					} else if ( err == SSL_ERROR_ZERO_RETURN ) {
+						netPrintf ( PRINT_VERBOSE, "Peer closed TLS connection on sock %d", sock_i );
 						TRACE_EXIT ( (__func__) );
-						return SSL_ERROR_WANT_READ;
+						return -1;			// peer sent close_notify. closed like a failed recv
 					} else {
 						str msg = netGetErrorStringSSL ( result, s.ssl );
 						netPrintf ( PRINT_ERROR, "Failed at ssl read: Returned: %d: %s", result, msg.c_str ( ) );
+						TRACE_EXIT ( (__func__) );
+						return -1;
 					}
 				}
 			#endif
@@ -2588,6 +3617,84 @@ int NetworkSystem::netSocketRecv ( int sock_i, char* buf, int bufmax )
 	return result;		// bytes read
 }
 
+// Receive on unix domain socket
+// - identical to recv, but also collects any descriptors passed with the data (SCM_RIGHTS)
+int NetworkSystem::netSocketRecvLocal ( int sock_i, char* buf, int bufmax )
+{
+	#ifdef CX_UNIX_SOCK
+		NetSock& s = m_socks [ sock_i ];
+		std::string msg;
+		iovec iov;
+		iov.iov_base = buf;
+		iov.iov_len = bufmax;
+		char ctrl [ CMSG_SPACE ( 16 * sizeof(int) ) ];
+		msghdr mh;
+		memset ( &mh, 0, sizeof(mh) );
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = ctrl;
+		mh.msg_controllen = sizeof(ctrl);
+
+		int result = recvmsg ( s.socket, &mh, MSG_CMSG_CLOEXEC );
+		if ( netFuncError(result) ) {
+			return CXSocketWouldBlock(msg) ? 0 : -1;
+		}
+		NetFdGroup g;
+		g.from = s.rxStreamPos;
+		g.to = s.rxStreamPos + result;						// stream range of this read, to match descriptors to events
+		s.rxStreamPos += result;
+		for ( cmsghdr* c = CMSG_FIRSTHDR(&mh); c != 0x0; c = CMSG_NXTHDR(&mh, c) ) {
+			if ( c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS ) {
+				int cnt = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+				int* fds = (int*) CMSG_DATA(c);
+				for ( int n = 0; n < cnt; n++ ) g.fds.push_back ( fds[n] );
+			}
+		}
+		if ( g.fds.size() > 0 ) {
+			if ( result > 0 ) s.rxFds.push_back ( g );
+			else netCloseDescriptors ( g.fds );				// no data to tie them to
+		}
+		if ( mh.msg_flags & MSG_CTRUNC ) {
+			netPrintf ( PRINT_ERROR, "Descriptors truncated on sock %d", sock_i );
+		}
+		return result;
+	#else
+		return -1;
+	#endif
+}
+
+// Send on stream socket
+// - when a descriptor is pending (unix domain), it is attached to the first byte sent
+int NetworkSystem::netSocketSend ( int sock_i, char* buf, int len )
+{
+	NetSock& s = m_socks [ sock_i ];
+	#ifdef CX_UNIX_SOCK
+		if ( s.mode == NET_UNIX && s.txFd >= 0 ) {
+			iovec iov;
+			iov.iov_base = buf;
+			iov.iov_len = len;
+			char ctrl [ CMSG_SPACE ( sizeof(int) ) ];
+			memset ( ctrl, 0, sizeof(ctrl) );
+			msghdr mh;
+			memset ( &mh, 0, sizeof(mh) );
+			mh.msg_iov = &iov;
+			mh.msg_iovlen = 1;
+			mh.msg_control = ctrl;
+			mh.msg_controllen = sizeof(ctrl);
+			cmsghdr* c = CMSG_FIRSTHDR(&mh);
+			c->cmsg_level = SOL_SOCKET;
+			c->cmsg_type = SCM_RIGHTS;
+			c->cmsg_len = CMSG_LEN ( sizeof(int) );
+			memcpy ( CMSG_DATA(c), &s.txFd, sizeof(int) );
+
+			int result = sendmsg ( s.socket, &mh, MSG_NOSIGNAL );
+			if ( result > 0 ) s.txFd = -1;		// descriptor delivered with first byte
+			return result;
+		}
+	#endif
+	return send ( s.socket, buf, len, 0 );
+}
+
 bool NetworkSystem::netSocketIsConnected ( int sock_i )
 {
     TRACE_ENTER ( (__func__) );
@@ -2618,6 +3725,7 @@ bool NetworkSystem::netSocketIsSelected ( fd_set* sockSet, int sock_i )
 		if ( s.ssl ) {
 			return FD_ISSET ( SSL_get_fd ( s.ssl ), sockSet );
 		}
+		return FD_ISSET ( s.socket, sockSet );		// listening socket, no ssl
 	#else
 		return false;
 	#endif
@@ -2647,9 +3755,9 @@ int NetworkSystem::netSocketSelect ( fd_set* sockReadSet, fd_set* sockWriteSet )
 				if ( (int) s.socket > maxfd ) maxfd = s.socket;
 			} else { 
 				#ifdef BUILD_OPENSSL
-					int fd = SSL_get_fd ( s.ssl );
+					int fd = s.ssl ? SSL_get_fd ( s.ssl ) : s.socket;		// listening socket has no ssl
 					FD_SET ( fd, sockReadSet );	
-					if ( s.txLen > 0 ) {
+					if ( ( s.txLen > 0 && s.sslWantTx != SSL_ERROR_WANT_READ ) || s.sslWantRx == SSL_ERROR_WANT_WRITE ) {
 						FD_SET ( fd, sockWriteSet );	
 					}
 					if ( (int) fd > maxfd ) maxfd = fd;
@@ -2666,10 +3774,21 @@ int NetworkSystem::netSocketSelect ( fd_set* sockReadSet, fd_set* sockWriteSet )
 
 	NET_PERF_PUSH ( "select" );
 	timeval tv;
-    tv.tv_sec = m_rcvSelectTimout.tv_sec;
-	tv.tv_usec = m_rcvSelectTimout.tv_usec;
+    tv.tv_sec = m_busyPoll ? 0 : m_rcvSelectTimout.tv_sec;		// busy poll: readiness check only, caller spins
+	tv.tv_usec = m_busyPoll ? 0 : m_rcvSelectTimout.tv_usec;
 	result = select ( maxfd, sockReadSet, sockWriteSet, NULL, &tv ); // Select all sockets that have changed
 	NET_PERF_POP ( );
+
+	#ifdef BUILD_OPENSSL
+		// Decrypted data left in SSL after a budget-limited read is not visible to select
+		for ( int n = 0; n < (int) m_socks.size ( ) && result >= 0; n++ ) {
+			NetSock& s = m_socks[ n ];
+			if ( s.ssl != 0 && s.state == STATE_CONNECTED && SSL_pending ( s.ssl ) > 0 && !FD_ISSET ( SSL_get_fd ( s.ssl ), sockReadSet ) ) {
+				FD_SET ( SSL_get_fd ( s.ssl ), sockReadSet );
+				result++;
+			}
+		}
+	#endif
 	TRACE_EXIT ( (__func__) );
 	return result;
 }
@@ -2765,6 +3884,49 @@ void NetworkSystem::netSetSelectInterval ( int time_ms )
 	m_rcvSelectTimout.tv_usec = ( time_ms % 1000 ) * 1000; 
 }
 
+// Busy poll. netProcessQueue skips the process interval and checks sockets
+// without waiting, so the caller's loop spins on a core. The thread calling
+// netProcessQueue is pinned to cpu (if >= 0) on its next call.
+void NetworkSystem::netSetBusyPoll ( bool enable, int cpu, int busy_usec )
+{
+	m_busyPoll = enable;
+	m_busyPollCPU = cpu;
+	m_busyPollUsec = enable ? busy_usec : 0;
+	m_busyPollPinned = false;
+	for ( int n = 0; n < (int) m_socks.size ( ); n++ ) {		// existing sockets
+		NetSock& s = m_socks[ n ];
+		if ( s.state == STATE_TERMINATED || s.socket == 0 ) continue;
+		CXSocketBusyPoll ( s.socket, m_busyPollUsec );
+		if ( enable && s.mode == NET_TCP ) CXSocketMakeNoDelay ( s.socket );
+	}
+}
+
+// Token bucket limits in bytes per second, 0 = unlimited. Burst defaults to
+// 1/10 second of traffic, at least 64k. Applies to existing and new sockets.
+void NetworkSystem::netSetRateLimit ( int rx_bytes_sec, int tx_bytes_sec, int burst_bytes )
+{
+	m_rxRate = rx_bytes_sec;
+	m_txRate = tx_bytes_sec;
+	m_rateBurst = burst_bytes;
+	for ( int n = 0; n < (int) m_socks.size ( ); n++ ) {
+		netSetBuckets ( n, m_rxRate, m_txRate, m_rateBurst );
+	}
+}
+
+void NetworkSystem::netSetRateLimit ( int rx_bytes_sec, int tx_bytes_sec, int burst_bytes, int sock_i )
+{
+	if ( !valid_socket_index ( sock_i ) ) return;
+	netSetBuckets ( sock_i, rx_bytes_sec, tx_bytes_sec, burst_bytes );
+}
+
+void NetworkSystem::netSetBuckets ( int sock_i, int rx_bytes_sec, int tx_bytes_sec, int burst_bytes )
+{
+	NetSock& s = m_socks[ sock_i ];
+	sjtime now = TimeX::GetSystemNSec ( );
+	s.rxBucket.set ( rx_bytes_sec, ( burst_bytes > 0 ) ? burst_bytes : std::max ( rx_bytes_sec / 10, 65536 ), now );
+	s.txBucket.set ( tx_bytes_sec, ( burst_bytes > 0 ) ? burst_bytes : std::max ( tx_bytes_sec / 10, 65536 ), now );
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 // -> SECURITY CONFIG API <-
 //----------------------------------------------------------------------------------------------------------------------
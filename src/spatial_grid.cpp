@@ -0,0 +1,252 @@
+//--------------------------------------------------------------------------------
+// Copyright 2007-2022 (c) Quanta Sciences, Rama Hoetzlein, ramakarl.com
+//
+//
+// * Derivative works may append the above copyright notice but should not remove or modify earlier notices.
+//
+// MIT License:
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+// associated documentation files (the "Software"), to deal in the Software without restriction, including without
+// limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+// OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "spatial_grid.h"
+#include "task_pool.h"
+#include <algorithm>
+
+SpatialGrid::SpatialGrid ()
+{
+	mSrc = 0x0;
+	mPosBuf = 0;
+	mNum = 0;
+	mCellSize = 1;
+	mInvCell = 1;
+	mTableMask = 0;
+	mLo.Set ( 0, 0, 0 );
+	mHi.Set ( -1, -1, -1 );
+}
+
+void SpatialGrid::Clear ()
+{
+	mGrid.DeleteAllBuffers ();
+	mNewCell.clear ();
+	mSrc = 0x0;
+	mNum = 0;
+	mTableMask = 0;
+	mLo.Set ( 0, 0, 0 );
+	mHi.Set ( -1, -1, -1 );
+}
+
+void SpatialGrid::Prepare ( int num )
+{
+	int table = (int) mTableMask + 1;
+	if ( !mGrid.hasBuf ( GRID_START ) ) {
+		mGrid.AddBuffer ( GRID_START, "start", sizeof(int), table );
+		mGrid.AddBuffer ( GRID_COUNT, "count", sizeof(int), table );
+		mGrid.AddBuffer ( GRID_INDEX, "index", sizeof(int), num );
+		mGrid.AddBuffer ( GRID_CELL,  "cell",  sizeof(uint), num );
+	}
+	mGrid.ResizeBuffer ( GRID_START, table );
+	mGrid.ResizeBuffer ( GRID_COUNT, table );
+	mGrid.ResizeBuffer ( GRID_INDEX, num );
+	mGrid.ResizeBuffer ( GRID_CELL, num );
+	mGrid.ReserveBuffer ( GRID_START, table );
+	mGrid.ReserveBuffer ( GRID_COUNT, table );
+	mGrid.ReserveBuffer ( GRID_INDEX, num );
+	mGrid.ReserveBuffer ( GRID_CELL, num );
+}
+
+void SpatialGrid::Build ( DataX* src, int posbuf, float cell_size, int table )
+{
+	if ( src == 0x0 || !src->hasBuf ( posbuf ) || cell_size <= 0 ) {
+		dbgprintf ( "ERROR: SpatialGrid::Build. Invalid source buffer or cell size.\n" );
+		return;
+	}
+	mSrc = src;
+	mPosBuf = posbuf;
+	mNum = src->GetNumElem ( posbuf );
+	mCellSize = cell_size;
+	mInvCell = 1.0f / cell_size;
+
+	if ( table <= 0 ) table = mNum * 2;
+	int t = 64;
+	while ( t < table && t < GRID_TABLE_MAX ) t <<= 1;
+	mTableMask = (uint) t - 1;
+	Prepare ( mNum );
+
+	// Sort element indices by cell. Initial order is by element, so the
+	// stable sort leaves each cell in element order.
+	uint* cells = mGrid.bufUI ( GRID_CELL );
+	ComputeCells ( cells );
+	std::vector<uint32_t> perm;
+	DataX::RadixSort ( cells, mNum, perm );
+	if ( mNum > 0 ) TaskPool::Memcpy ( mGrid.bufI ( GRID_INDEX ), perm.data(), (uint64_t) mNum * sizeof(int) );
+	FillTable ();
+}
+
+// Table entry of each element, and the cell bounds of all of them
+void SpatialGrid::ComputeCells ( uint* cells )
+{
+	mLo.Set ( 0, 0, 0 );
+	mHi.Set ( -1, -1, -1 );
+	if ( mNum == 0 ) return;
+	Vec3F bmin, bmax, sum;
+	mSrc->ReduceF3 ( mPosBuf, bmin, bmax, sum );
+	mLo.Set ( getCellCoord ( bmin.x ), getCellCoord ( bmin.y ), getCellCoord ( bmin.z ) );
+	mHi.Set ( getCellCoord ( bmax.x ), getCellCoord ( bmax.y ), getCellCoord ( bmax.z ) );
+
+	const Vec3F* pos = mSrc->bufF3 ( mPosBuf );
+	mSrc->ForEachRange ( mPosBuf, [=] ( uint64_t begin, uint64_t end ) {
+		for (uint64_t n = begin; n < end; n++)
+			cells[n] = getHash ( getCellCoord ( pos[n].x ), getCellCoord ( pos[n].y ), getCellCoord ( pos[n].z ) );
+	} );
+}
+
+// Start and count of each table entry from the sorted index. Every run of
+// equal entries has one first and one last slot, so the two passes below
+// write each table entry from a single thread.
+void SpatialGrid::FillTable ()
+{
+	int table = (int) mTableMask + 1;
+	int* start = mGrid.bufI ( GRID_START );
+	int* count = mGrid.bufI ( GRID_COUNT );
+	const int* idx = mGrid.bufI ( GRID_INDEX );
+	const uint* cells = mGrid.bufUI ( GRID_CELL );
+	int num = mNum;
+	TaskPool::Memset ( start, 0, (uint64_t) table * sizeof(int) );
+	TaskPool::Memset ( count, 0, (uint64_t) table * sizeof(int) );
+	if ( num == 0 ) return;
+
+	TaskPool& pool = TaskPool::Get ();
+	uint64_t grain = pool.getGrain ( num );
+	pool.Run ( num, grain, [=] ( int /*c*/, uint64_t begin, uint64_t end ) {		// first slot, last slot+1
+		for (uint64_t i = begin; i < end; i++) {
+			uint h = cells[ idx[i] ];
+			if ( i == 0 || cells[ idx[i-1] ] != h )			start[h] = (int) i;
+			if ( i + 1 == (uint64_t) num || cells[ idx[i+1] ] != h )		count[h] = (int) i + 1;
+		}
+	} );
+	pool.Run ( num, grain, [=] ( int /*c*/, uint64_t begin, uint64_t end ) {		// last+1 to count
+		for (uint64_t i = begin; i < end; i++) {
+			uint h = cells[ idx[i] ];
+			if ( i == 0 || cells[ idx[i-1] ] != h )			count[h] -= (int) i;
+		}
+	} );
+	mGrid.GetBuffer ( GRID_START )->MarkAllDirty ();
+	mGrid.GetBuffer ( GRID_COUNT )->MarkAllDirty ();
+	mGrid.GetBuffer ( GRID_INDEX )->MarkAllDirty ();
+	mGrid.GetBuffer ( GRID_CELL )->MarkAllDirty ();
+}
+
+// Re-bin after positions change. When few elements changed cell, the ones
+// that stayed are already in order, so only the movers are sorted and then
+// merged back in, giving the same order a full Build would.
+int SpatialGrid::Rebuild ()
+{
+	if ( mSrc == 0x0 ) return 0;
+	if ( mSrc->GetNumElem ( mPosBuf ) != mNum ) {					// elements added or removed
+		Build ( mSrc, mPosBuf, mCellSize, (int) mTableMask + 1 );
+		return mNum;
+	}
+	if ( mNum == 0 ) return 0;
+
+	mNewCell.resize ( mNum );
+	uint* nc = mNewCell.data();
+	ComputeCells ( nc );
+	uint* cells = mGrid.bufUI ( GRID_CELL );
+	int* idx = mGrid.bufI ( GRID_INDEX );
+
+	TaskPool& pool = TaskPool::Get ();
+	uint64_t grain = pool.getGrain ( mNum );
+	std::vector<int> moved_chunk ( TaskPool::getNumChunks ( mNum, grain ), 0 );
+	pool.Run ( mNum, grain, [&] ( int c, uint64_t begin, uint64_t end ) {
+		int m = 0;
+		for (uint64_t n = begin; n < end; n++) if ( nc[n] != cells[n] ) m++;
+		moved_chunk[c] = m;
+	} );
+	int moved = 0;
+	for (int m : moved_chunk) moved += m;
+	if ( moved == 0 ) return 0;
+
+	if ( moved > mNum / GRID_MERGE_FRAC ) {							// many moved, full sort
+		TaskPool::Memcpy ( cells, nc, (uint64_t) mNum * sizeof(uint) );
+		std::vector<uint32_t> perm;
+		DataX::RadixSort ( cells, mNum, perm );
+		TaskPool::Memcpy ( idx, perm.data(), (uint64_t) mNum * sizeof(int) );
+	} else {
+		std::vector<int> stay, move;
+		stay.reserve ( mNum - moved );
+		move.reserve ( moved );
+		for (int i = 0; i < mNum; i++) {
+			int e = idx[i];
+			if ( nc[e] == cells[e] ) stay.push_back ( e ); else move.push_back ( e );
+		}
+		auto less = [nc] ( int a, int b ) { return nc[a] < nc[b] || ( nc[a] == nc[b] && a < b ); };
+		std::sort ( move.begin(), move.end(), less );
+		std::merge ( stay.begin(), stay.end(), move.begin(), move.end(), idx, less );
+		memcpy ( cells, nc, (uint64_t) mNum * sizeof(uint) );
+	}
+	FillTable ();
+	return moved;
+}
+
+int SpatialGrid::QueryRadius ( Vec3F p, float r, std::vector<int>& out )
+{
+	out.clear ();
+	ForEachInRadius ( p, r, [&out] ( int e, float /*d2*/ ) { out.push_back ( e ); } );
+	return (int) out.size();
+}
+
+// Visits shells of cells around p's cell, outward. Elements beyond shell s
+// are at least s cells away, so the search stops once the k-th best is
+// closer than that, or the shells pass maxr or the element bounds.
+int SpatialGrid::QueryNearest ( Vec3F p, int k, std::vector<int>& out, float maxr )
+{
+	out.clear ();
+	if ( mNum == 0 || k <= 0 ) return 0;
+	typedef std::pair<float, int> cand;								// dist_sq, element. max-heap on dist
+	std::vector<cand> best;
+	best.reserve ( k + 1 );
+	float r2 = ( maxr < 0 ) ? 3.4e38f : maxr * maxr;
+	auto take = [&] ( int e, float d2 ) {
+		if ( (int) best.size() < k ) {
+			best.push_back ( cand ( d2, e ) );
+			std::push_heap ( best.begin(), best.end() );
+		} else if ( cand ( d2, e ) < best.front() ) {
+			std::pop_heap ( best.begin(), best.end() );
+			best.back() = cand ( d2, e );
+			std::push_heap ( best.begin(), best.end() );
+		}
+	};
+	Vec3I c ( getCellCoord ( p.x ), getCellCoord ( p.y ), getCellCoord ( p.z ) );
+	int smax = imax ( imax ( imax ( c.x - mLo.x, mHi.x - c.x ), imax ( c.y - mLo.y, mHi.y - c.y ) ), imax ( c.z - mLo.z, mHi.z - c.z ) );
+	for (int s = 0; s <= smax; s++) {
+		float reach = ( s - 1 ) * mCellSize;						// nearest any shell-s element can be
+		if ( reach > 0 && reach * reach > r2 ) break;
+		if ( (int) best.size() == k && reach > 0 && best.front().first <= reach * reach ) break;
+		int z0 = imax ( c.z - s, mLo.z ), z1 = imin ( c.z + s, mHi.z );
+		int y0 = imax ( c.y - s, mLo.y ), y1 = imin ( c.y + s, mHi.y );
+		int x0 = imax ( c.x - s, mLo.x ), x1 = imin ( c.x + s, mHi.x );
+		for (int z = z0; z <= z1; z++) {
+			for (int y = y0; y <= y1; y++) {
+				float rq = ( (int) best.size() == k ) ? imin ( best.front().first, r2 ) : r2;
+				if ( z == c.z - s || z == c.z + s || y == c.y - s || y == c.y + s ) {
+					for (int x = x0; x <= x1; x++) VisitCell ( x, y, z, p, rq, take );
+				} else {											// inside the shell, only its two x ends
+					if ( c.x - s >= x0 ) VisitCell ( c.x - s, y, z, p, rq, take );
+					if ( c.x + s <= x1 ) VisitCell ( c.x + s, y, z, p, rq, take );
+				}
+			}
+		}
+	}
+	std::sort_heap ( best.begin(), best.end() );
+	for (auto& b : best) out.push_back ( b.second );
+	return (int) out.size();
+}
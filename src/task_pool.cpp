@@ -0,0 +1,153 @@
+//--------------------------------------------------------------------------------
+// Copyright 2007-2022 (c) Quanta Sciences, Rama Hoetzlein, ramakarl.com
+//
+//
+// * Derivative works may append the above copyright notice but should not remove or modify earlier notices.
+//
+// MIT License:
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+// associated documentation files (the "Software"), to deal in the Software without restriction, including without
+// limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+// OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "task_pool.h"
+#include <string.h>
+
+static thread_local bool tInPool = false;		// running chunks on this thread
+
+TaskPool::TaskPool ()
+{
+	mJob = 0x0;
+	mGen = 0;
+	bStop = false;
+}
+
+TaskPool::~TaskPool ()
+{
+	Stop ();
+}
+
+TaskPool& TaskPool::Get ()
+{
+	static TaskPool pool;
+	static std::once_flag started;
+	std::call_once ( started, [] { pool.Start (); } );
+	return pool;
+}
+
+void TaskPool::Start ( int threads )
+{
+	Stop ();
+	if ( threads <= 0 ) threads = (int) std::thread::hardware_concurrency ();
+	{
+		std::lock_guard<std::mutex> lk ( mLock );
+		bStop = false;
+	}
+	for (int n = 1; n < threads; n++)						// caller is one of the threads
+		mThreads.push_back ( std::thread ( &TaskPool::Worker, this ) );
+}
+
+void TaskPool::Stop ()
+{
+	{
+		std::lock_guard<std::mutex> lk ( mLock );
+		bStop = true;
+	}
+	mWake.notify_all ();
+	for (size_t n = 0; n < mThreads.size(); n++)
+		mThreads[n].join ();
+	mThreads.clear ();
+}
+
+uint64_t TaskPool::getGrain ( uint64_t num )
+{
+	uint64_t parts = (uint64_t) getNumThreads() * 4;		// slack for uneven chunks
+	uint64_t grain = (num + parts-1) / parts;
+	return (grain > 0) ? grain : 1;
+}
+
+void TaskPool::RunChunks ( Job* job )
+{
+	uint64_t c;
+	while ( (c = job->next.fetch_add ( 1 )) < job->chunks ) {
+		uint64_t begin = c * job->grain;
+		uint64_t end = begin + job->grain;
+		if ( end > job->num ) end = job->num;
+		(*job->fn) ( (int) c, begin, end );
+	}
+}
+
+void TaskPool::Worker ()
+{
+	tInPool = true;
+	uint64_t seen = 0;
+	std::unique_lock<std::mutex> lk ( mLock );
+	for (;;) {
+		mWake.wait ( lk, [&] { return bStop || ( mJob != 0x0 && mGen != seen ); } );
+		if ( bStop ) return;
+		seen = mGen;
+		Job* job = mJob;
+		job->active++;
+		lk.unlock ();
+		RunChunks ( job );
+		lk.lock ();
+		if ( --job->active == 0 ) mDone.notify_all ();
+	}
+}
+
+void TaskPool::Run ( uint64_t num, uint64_t grain, const RangeFunc& fn )
+{
+	if ( num == 0 ) return;
+	if ( grain == 0 ) grain = getGrain ( num );
+
+	Job job;
+	job.fn = &fn;
+	job.num = num;
+	job.grain = grain;
+	job.chunks = getNumChunks ( num, grain );
+	job.next = 0;
+	job.active = 0;
+
+	if ( tInPool || mThreads.size() == 0 || job.chunks == 1 ) {
+		RunChunks ( &job );									// nested, or nothing to share
+		return;
+	}
+	std::lock_guard<std::mutex> run ( mRunLock );
+	{
+		std::lock_guard<std::mutex> lk ( mLock );
+		mJob = &job;
+		mGen++;
+	}
+	mWake.notify_all ();
+
+	tInPool = true;
+	RunChunks ( &job );
+	tInPool = false;
+
+	std::unique_lock<std::mutex> lk ( mLock );
+	mJob = 0x0;												// late wakers skip this job
+	mDone.wait ( lk, [&] { return job.active == 0; } );
+}
+
+void TaskPool::Memcpy ( void* dst, const void* src, uint64_t sz )
+{
+	if ( sz < TASK_PAR_BYTES ) { memcpy ( dst, src, sz ); return; }
+	Get().Run ( sz, TASK_PAR_BYTES / 2, [=] ( int /*c*/, uint64_t begin, uint64_t end ) {
+		memcpy ( (char*) dst + begin, (const char*) src + begin, end - begin );
+	} );
+}
+
+void TaskPool::Memset ( void* dst, int v, uint64_t sz )
+{
+	if ( sz < TASK_PAR_BYTES ) { memset ( dst, v, sz ); return; }
+	Get().Run ( sz, TASK_PAR_BYTES / 2, [=] ( int /*c*/, uint64_t begin, uint64_t end ) {
+		memset ( (char*) dst + begin, v, end - begin );
+	} );
+}
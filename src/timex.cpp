@@ -58,6 +58,9 @@
 	bool				g_perfGPU = false;			// Do GPU timing? Set with PERF_SET
 	std::string			g_perfFName = "";			// File name for CPU output. Set with PERF_SET
 	FILE*				g_perfFile = 0x0;			// File handle for output
+	bool				g_perfAggr = false;			// Accumulate timings per message? Set with PERF_AGGREGATE
+	PerfStat			g_perfStats[PERF_STAT_MAX];	// Timing aggregates
+	int					g_perfStatCnt = 0;
 
 	float strToDateF(std::string s, int mp, int mc, int dp, int dc, int yp, int yc)
 	{
@@ -73,7 +76,7 @@
 		t.GetDateF(f, m, d, y);
 	}
 
-	void PERF_PRINTF ( char* format, ... )
+	void PERF_PRINTF ( const char* format, ... )
 	{
 		if ( g_perfCons == 0x0 ) {
 				va_list  vlist;
@@ -99,11 +102,13 @@
 		if ( !g_perfInit ) return;
 		if ( g_perfOn ) {
 			strncpy ( (char*) g_perfMsg[g_perfLevel], msg, 256 );			
-			if ( g_perfGPU ) (*g_nvtxPush) ( (char*) g_perfMsg[g_perfLevel] );
+			if ( g_perfGPU && g_nvtxPush ) (*g_nvtxPush) ( (char*) g_perfMsg[g_perfLevel] );
 			if ( g_perfCPU && g_perfLevel < g_perfPrintLev ) {			
 				PERF_PRINTF ( "%*s%s\n", g_perfLevel <<1, "", g_perfMsg[g_perfLevel] );
 				if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s\n", g_perfLevel << 1, "", (char*) g_perfMsg[g_perfLevel]  );
 				g_perfStack [ g_perfLevel ] = TimeX::GetSystemNSec ();
+			} else if ( g_perfAggr ) {
+				g_perfStack [ g_perfLevel ] = TimeX::GetSystemNSec ();
 			}
 			g_perfLevel++;
 		} 
@@ -111,20 +116,57 @@
 	float PERF_POP ()
 	{
 		if ( g_perfOn ) {
-			if ( g_perfGPU ) (*g_nvtxPop) ();
+			if ( g_perfGPU && g_nvtxPop ) (*g_nvtxPop) ();
 			g_perfLevel--;
-			if ( g_perfCPU && g_perfLevel < g_perfPrintLev ) {
+			bool print = ( g_perfCPU && g_perfLevel < g_perfPrintLev );
+			if ( print || g_perfAggr ) {
 				sjtime curr = TimeX::GetSystemNSec ();
 				curr -= g_perfStack [ g_perfLevel ];
 				float msec = ((float) curr)/MSEC_SCALAR;
-				PERF_PRINTF ( "%*s%s: %f ms\n", g_perfLevel <<1, "", g_perfMsg[g_perfLevel], msec );		
+				if ( print ) PERF_PRINTF ( "%*s%s: %f ms\n", g_perfLevel <<1, "", g_perfMsg[g_perfLevel], msec );		
 				//if ( g_perfFile != 0x0 ) fprintf ( g_perfFile, "%*s%s: %f ms\n", g_perfLevel <<1, "", g_perfMsg[g_perfLevel], msec );
+				if ( g_perfAggr ) PERF_ACCUM ( (char*) g_perfMsg[g_perfLevel], msec );
 				return msec;
 			}
 		} 
 		return 0.0;
 	}
 
+	// Add one timing to the aggregate for msg. Messages beyond PERF_STAT_MAX are not tracked.
+	void PERF_ACCUM ( const char* msg, float msec )
+	{
+		int n = 0;
+		for ( ; n < g_perfStatCnt; n++ ) {
+			if ( strncmp ( g_perfStats[n].name, msg, PERF_STAT_NAME-1 ) == 0 ) break;
+		}
+		if ( n == g_perfStatCnt ) {
+			if ( g_perfStatCnt >= PERF_STAT_MAX ) return;
+			memset ( &g_perfStats[n], 0, sizeof(PerfStat) );
+			strncpy ( g_perfStats[n].name, msg, PERF_STAT_NAME-1 );
+			g_perfStatCnt++;
+		}
+		PerfStat& st = g_perfStats[n];
+		st.count++;
+		st.totalMs += msec;
+		if ( msec > st.maxMs ) st.maxMs = msec;
+	}
+
+	void PERF_AGGREGATE ( bool on )
+	{
+		g_perfAggr = on;
+		if ( on ) {
+			g_perfInit = true;
+			g_perfOn = true;
+		}
+	}
+
+	int PERF_GET_STATS ( PerfStat* out, int max )
+	{
+		int cnt = ( g_perfStatCnt < max ) ? g_perfStatCnt : max;
+		memcpy ( out, g_perfStats, cnt * sizeof(PerfStat) );
+		return cnt;
+	}
+
 	void PERF_START ()
 	{
 		g_perfStack [ g_perfLevel ] = TimeX::GetSystemNSec ();